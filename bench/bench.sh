@@ -0,0 +1,142 @@
+#!/bin/bash -e
+
+# Runs the benchmark kernels in bench/ and reports moves per second, cycles
+# per element, memory bandwidth and the size of the program on the device,
+# in the fixed instruction layout and packed.
+#
+# Inputs are generated from a fixed seed, so runs are reproducible.
+# All kernels run on host/simulate, which counts moves, cycles and memory
+# accesses. Times are derived from simulated cycles at the given clock.
+# With -a the kernels also run on the FPGA (or emulator) through host/run,
+# times are then the runtime of the control unit kernel.
+
+BENCHDIR="$(dirname "$0")"
+HOSTDIR="$BENCHDIR/../host"
+
+# Default values
+PROCESSOR="$BENCHDIR/../device/basic_banyan.xml"
+AOCX=
+SIZE=
+CLOCK=200
+SEED=1
+KERNELS="vector_add dot_product prefix_sum matrix_multiply histogram stencil pointer_chase"
+
+function usage {
+echo "Usage: $0 [-p <processor.xml>] [-a <processor.aocx>] [-n <size>] [-c <clock MHz>] [-s <seed>] [<kernel> ...]"
+echo
+echo "Kernels: $KERNELS"
+echo "Default size is 8 for matrix_multiply and 256 for all others."
+echo
+}
+
+while getopts "p:a:n:c:s:h" option
+do
+	case "$option" in
+		p) PROCESSOR="$OPTARG" ;;
+		a) AOCX="$OPTARG" ;;
+		n) SIZE="$OPTARG" ;;
+		c) CLOCK="$OPTARG" ;;
+		s) SEED="$OPTARG" ;;
+		*) usage; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+if [ $# -gt 0 ]
+then
+	KERNELS="$*"
+fi
+
+# Memory file: mem[0] = N followed by the kernel's inputs and outputs.
+function generate_memory {
+	awk -v kernel="$1" -v n="$2" -v seed="$3" '
+	function random(limit) { return int(rand() * limit) }
+	function zeros(count,   i) { for(i = 0; i < count; i++) print 0 }
+	BEGIN {
+		srand(seed)
+		print n
+		if(kernel == "vector_add") {
+			for(i = 0; i < 2 * n; i++) print random(2^20)
+			zeros(n)
+		} else if(kernel == "dot_product") {
+			for(i = 0; i < 2 * n; i++) print random(2^16)
+			zeros(1)
+		} else if(kernel == "prefix_sum" || kernel == "stencil") {
+			for(i = 0; i < n; i++) print random(2^20)
+			zeros(n)
+		} else if(kernel == "matrix_multiply") {
+			for(i = 0; i < 2 * n * n; i++) print random(256)
+			zeros(n * n)
+		} else if(kernel == "histogram") {
+			for(i = 0; i < n; i++) print random(16)
+			zeros(16)
+		} else if(kernel == "pointer_chase") {
+			# One cycle through all elements in random order.
+			for(i = 1; i <= n; i++) order[i] = i
+			for(i = n; i > 1; i--) { j = 1 + random(i); t = order[i]; order[i] = order[j]; order[j] = t }
+			for(i = 1; i <= n; i++) next_index[order[i]] = order[i % n + 1]
+			for(i = 1; i <= n; i++) print next_index[i]
+			zeros(1)
+		}
+	}'
+}
+
+# Number of elements the cycles are divided by.
+function elements {
+	if [ "$1" == matrix_multiply ]
+	then
+		echo $(($2 * $2 * $2))
+	else
+		echo $2
+	fi
+}
+
+# Value of a numeric field in the last JSON line of stdin.
+function json_field {
+	grep '^{' | tail -n 1 | sed -n 's/.*"'"$1"'": \([0-9.e+-]*\).*/\1/p'
+}
+
+MEMORY_FILE=$(mktemp)
+trap 'rm -f "$MEMORY_FILE"' EXIT
+
+printf "%-16s %8s %10s %12s %12s %12s %12s %10s %10s\n" kernel N moves cycles "cycles/elem" "Mmoves/s" "MB/s" \
+       "fixed B" "packed B"
+for KERNEL in $KERNELS
+do
+	if [ ! -f "$BENCHDIR/$KERNEL.asm" ]
+	then
+		echo "Unknown kernel: $KERNEL"
+		usage
+		exit 1
+	fi
+
+	N=$SIZE
+	if [ -z "$N" ]
+	then
+		[ "$KERNEL" == matrix_multiply ] && N=8 || N=256
+	fi
+	generate_memory "$KERNEL" "$N" "$SEED" > "$MEMORY_FILE"
+
+	SIMULATION=$("$HOSTDIR/simulate" "$PROCESSOR" "$BENCHDIR/$KERNEL.asm" "$MEMORY_FILE")
+	MOVES=$(echo "$SIMULATION" | json_field moves)
+	CYCLES=$(echo "$SIMULATION" | json_field cycles)
+	LOADS=$(echo "$SIMULATION" | json_field loads)
+	STORES=$(echo "$SIMULATION" | json_field stores)
+	SIZES=$("$HOSTDIR/assembler" -s "$PROCESSOR" "$BENCHDIR/$KERNEL.asm" 2>/dev/null)
+	FIXED_BYTES=$(echo "$SIZES" | json_field fixed_bytes)
+	PACKED_BYTES=$(echo "$SIZES" | json_field packed_bytes)
+
+	if [ -z "$AOCX" ]
+	then
+		SECONDS_TAKEN=$(awk -v cycles="$CYCLES" -v clock="$CLOCK" 'BEGIN { print cycles / (clock * 1e6) }')
+	else
+		SECONDS_TAKEN=$("$HOSTDIR/run" -m "$MEMORY_FILE" "$PROCESSOR" "$AOCX" "$BENCHDIR/$KERNEL.asm" | json_field cu)
+		CYCLES=$(awk -v seconds="$SECONDS_TAKEN" -v clock="$CLOCK" 'BEGIN { printf "%d", seconds * clock * 1e6 }')
+	fi
+
+	awk -v kernel="$KERNEL" -v n="$N" -v moves="$MOVES" -v cycles="$CYCLES" \
+	    -v elements="$(elements "$KERNEL" "$N")" -v seconds="$SECONDS_TAKEN" \
+	    -v bytes="$(( (LOADS + STORES) * 8 ))" -v fixed="$FIXED_BYTES" -v packed="$PACKED_BYTES" 'BEGIN {
+		printf "%-16s %8d %10d %12d %12.2f %12.2f %12.2f %10d %10d\n", kernel, n, moves, cycles,
+		       cycles / elements, moves / seconds / 1e6, bytes / seconds / 1e6, fixed, packed
+	}'
+done
@@ -0,0 +1,71 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// H[A[i]] = H[A[i]] + 1
+// Memory: mem[0] = N, A = mem[1 .. N] with values below 16, H = mem[N+1 .. N+16]
+// Units: lsu, pu0 .. pu2
+
+setup:
+	$0        -> lsu@in0
+	(lda, 2)  -> lsu@opc // N x2
+	
+	lsu@out   -> pu0@in0
+	$0        -> pu0@in1
+	(orB, 2)  -> pu0@opc // pu0: i = N x2
+	
+	lsu@out   -> pu1@in0
+	$1        -> pu1@in1
+	(addN, 2) -> pu1@opc // pu1: N + 1 x2
+
+loop:
+	// A[i]
+	pu0@out   -> lsu@in0
+	(lda, 1)  -> lsu@opc
+	
+	// pu2: address of H[A[i]] x2
+	lsu@out   -> pu2@in0
+	pu1@out   -> pu2@in1
+	(addN, 2) -> pu2@opc
+	
+	// H[A[i]], stays in order with the store of the last iteration
+	pu2@out   -> lsu@in0
+	(lda, 1)  -> lsu@opc
+	pu2@out   -> lsu@in0
+	
+	// H[A[i]] = H[A[i]] + 1
+	lsu@out   -> pu2@in0
+	$1        -> pu2@in1
+	(addN, 1) -> pu2@opc
+	pu2@out   -> lsu@in1
+	st        -> lsu@opc
+	
+	// pu1: N + 1 x2 for the next iteration
+	pu1@out   -> pu1@in0
+	$0        -> pu1@in1
+	(orB, 2)  -> pu1@opc
+	
+	// i = i - 1, x2 for the next iteration
+	pu0@out   -> pu0@in0
+	$1        -> pu0@in1
+	(subN, 3) -> pu0@opc
+	
+	// (i != 0) -> branch to loop
+	loop      -> cu@in1
+	pu0@out   -> cu@in0
+
+cleanup:
+	pu0@out   -> null
+	pu0@out   -> null
+	pu1@out   -> null
+	pu1@out   -> null
@@ -0,0 +1,165 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// C = A * B for N x N matrices
+// Memory: mem[0] = N,
+//         A = mem[1 .. N^2] row-major:              A[r][k] = mem[1 + r*N + k]
+//         B = mem[N^2+1 .. 2N^2] column-major:       B[k][c] = mem[1 + N^2 + c*N + k]
+//         C = mem[2N^2+1 .. 3N^2] row-major:         C[r][c] = mem[1 + 2N^2 + r*N + c]
+// Units: lsu, rob, pu0 .. pu4
+//
+// Outer loop over e = N^2 .. 1 with e - 1 = r*N + c, rob holds its state
+// (e, N, N^2, 2N^2 + 1) while the inner loop runs.
+// Inner loop over k = N .. 1, pu1 and pu2 count down the addresses of
+// A[r][k - 1] and B[k - 1][c], pu4 holds the sum.
+
+setup:
+	$0        -> lsu@in0
+	(lda, 3)  -> lsu@opc // N x3
+	
+	lsu@out   -> pu0@in0
+	lsu@out   -> pu0@in1
+	(mulN, 4) -> pu0@opc // pu0: N^2 x4
+	
+	pu0@out   -> pu1@in0
+	pu0@out   -> pu1@in1
+	(addN, 1) -> pu1@opc
+	pu1@out   -> pu1@in0
+	$1        -> pu1@in1
+	(addN, 1) -> pu1@opc // pu1: 2N^2 + 1
+	
+	// rob: e = N^2, N, N^2, 2N^2 + 1
+	pu0@out   -> rob@in0
+	lsu@out   -> rob@in0
+	pu0@out   -> rob@in0
+	pu1@out   -> rob@in0
+
+outer:
+	rob@out   -> pu0@in0
+	$1        -> pu0@in1
+	(subN, 5) -> pu0@opc // pu0: e - 1 x5
+	rob@out   -> pu1@in0
+	$0        -> pu1@in1
+	(orB, 6)  -> pu1@opc // pu1: N x6
+	rob@out   -> pu2@in0
+	$0        -> pu2@in1
+	(orB, 2)  -> pu2@opc // pu2: N^2 x2
+	rob@out   -> pu3@in0
+	$0        -> pu3@in1
+	(orB, 2)  -> pu3@opc // pu3: 2N^2 + 1 x2
+	
+	// address of C[r][c]: 2N^2 + 1 + e - 1
+	pu3@out   -> pu4@in0
+	pu0@out   -> pu4@in1
+	(addN, 1) -> pu4@opc
+	
+	// rob: C address, branch condition e - 1 and state of the next iteration
+	pu4@out   -> rob@in0
+	pu0@out   -> rob@in0
+	pu0@out   -> rob@in0
+	pu1@out   -> rob@in0
+	pu2@out   -> rob@in0
+	pu3@out   -> rob@in0
+	
+	// r + 1 = (e - 1) / N + 1
+	pu0@out   -> pu3@in0
+	pu1@out   -> pu3@in1
+	(divN, 1) -> pu3@opc
+	pu3@out   -> pu3@in0
+	$1        -> pu3@in1
+	(addN, 1) -> pu3@opc
+	
+	// pu1: address of A[r][N - 1] = (r + 1) * N x2
+	pu3@out   -> pu1@in0
+	pu1@out   -> pu1@in1
+	(mulN, 2) -> pu1@opc
+	
+	// (c + 1) * N = ((e - 1) % N + 1) * N
+	pu0@out   -> pu4@in0
+	pu1@out   -> pu4@in1
+	(modN, 1) -> pu4@opc
+	pu4@out   -> pu4@in0
+	$1        -> pu4@in1
+	(addN, 1) -> pu4@opc
+	pu4@out   -> pu4@in0
+	pu1@out   -> pu4@in1
+	(mulN, 1) -> pu4@opc
+	
+	// pu2: address of B[N - 1][c] = N^2 + (c + 1) * N x2
+	pu4@out   -> pu2@in0
+	pu2@out   -> pu2@in1
+	(addN, 2) -> pu2@opc
+	
+	// pu4: sum = 0
+	$0        -> pu4@in0
+	$0        -> pu4@in1
+	(orB, 1)  -> pu4@opc
+	
+	// pu0: k = N
+	pu1@out   -> pu0@in0
+	$0        -> pu0@in1
+	(orB, 1)  -> pu0@opc
+
+inner:
+	// k = k - 1 x2
+	pu0@out   -> pu0@in0
+	$1        -> pu0@in1
+	(subN, 2) -> pu0@opc
+	
+	// A[r][k]
+	pu1@out   -> lsu@in0
+	(lda, 1)  -> lsu@opc
+	pu1@out   -> pu1@in0
+	$1        -> pu1@in1
+	(subN, 2) -> pu1@opc
+	
+	// B[k][c]
+	pu2@out   -> lsu@in0
+	(lda, 1)  -> lsu@opc
+	pu2@out   -> pu2@in0
+	$1        -> pu2@in1
+	(subN, 2) -> pu2@opc
+	
+	// sum = sum + A[r][k] * B[k][c]
+	lsu@out   -> pu3@in0
+	lsu@out   -> pu3@in1
+	(mulN, 1) -> pu3@opc
+	pu3@out   -> pu4@in0
+	pu4@out   -> pu4@in1
+	(addN, 1) -> pu4@opc
+	
+	// (k != 0) -> branch to inner
+	inner     -> cu@in1
+	pu0@out   -> cu@in0
+	
+	// C[r][c] = sum
+	rob@out   -> lsu@in0
+	pu4@out   -> lsu@in1
+	st        -> lsu@opc
+	
+	pu0@out   -> null
+	pu1@out   -> null
+	pu1@out   -> null
+	pu2@out   -> null
+	pu2@out   -> null
+	
+	// (e - 1 != 0) -> branch to outer
+	outer     -> cu@in1
+	rob@out   -> cu@in0
+
+cleanup:
+	rob@out   -> null
+	rob@out   -> null
+	rob@out   -> null
+	rob@out   -> null
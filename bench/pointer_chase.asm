@@ -0,0 +1,55 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// p = 1, N times p = mem[p], mem[N+1] = p
+// Memory: mem[0] = N (at least 2), mem[1 .. N] = next index in 1 .. N
+// Units: lsu, pu0, pu1
+//
+// Every load depends on the last one: measures load latency.
+
+setup:
+	$0        -> lsu@in0
+	(lda, 2)  -> lsu@opc // N x2
+	
+	lsu@out   -> pu0@in0
+	$1        -> pu0@in1
+	(subN, 1) -> pu0@opc // pu0: N - 1 links after the first one
+	
+	lsu@out   -> pu1@in0
+	$1        -> pu1@in1
+	(addN, 1) -> pu1@opc // pu1: N + 1
+	
+	// p = mem[1]
+	$1        -> lsu@in0
+	(lda, 1)  -> lsu@opc
+
+loop:
+	// p = mem[p]
+	lsu@out   -> lsu@in0
+	(lda, 1)  -> lsu@opc
+	
+	// j = j - 1, (j != 0) -> branch to loop
+	pu0@out   -> pu0@in0
+	$1        -> pu0@in1
+	(subN, 2) -> pu0@opc
+	loop      -> cu@in1
+	pu0@out   -> cu@in0
+
+cleanup:
+	pu0@out   -> null
+	
+	// mem[N + 1] = p
+	pu1@out   -> lsu@in0
+	lsu@out   -> lsu@in1
+	st        -> lsu@opc
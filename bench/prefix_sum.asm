@@ -0,0 +1,79 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// B[i] = A[1] + ... + A[i]
+// Memory: mem[0] = N, A = mem[1 .. N], B = mem[N+1 .. 2N]
+// Units: lsu, rob, pu0 .. pu2
+
+setup:
+	$0        -> lsu@in0
+	(lda, 1)  -> lsu@opc // N
+	
+	lsu@out   -> pu1@in0
+	$0        -> pu1@in1
+	(orB, 3)  -> pu1@opc // pu1: N x3
+	
+	$1        -> pu0@in0
+	$0        -> pu0@in1
+	(orB, 4)  -> pu0@opc // pu0: i = 1 x4
+	
+	$0        -> rob@in0 // sum
+
+loop:
+	// A[i]
+	pu0@out   -> lsu@in0
+	(lda, 1)  -> lsu@opc
+	
+	// sum = sum + A[i], x2
+	lsu@out   -> pu2@in0
+	rob@out   -> pu2@in1
+	(addN, 2) -> pu2@opc
+	pu2@out   -> rob@in0
+	pu2@out   -> lsu@in1
+	
+	// B[i] = sum
+	pu0@out   -> pu2@in0
+	pu1@out   -> pu2@in1
+	(addN, 1) -> pu2@opc
+	pu2@out   -> lsu@in0
+	st        -> lsu@opc
+	
+	// branch condition: N - i
+	pu1@out   -> pu2@in0
+	pu0@out   -> pu2@in1
+	(subN, 1) -> pu2@opc
+	
+	// pu1: N x3 for the next iteration
+	pu1@out   -> pu1@in0
+	$0        -> pu1@in1
+	(orB, 3)  -> pu1@opc
+	
+	// i = i + 1, x4 for the next iteration
+	pu0@out   -> pu0@in0
+	$1        -> pu0@in1
+	(addN, 4) -> pu0@opc
+	
+	// (N - i != 0) -> branch to loop
+	loop      -> cu@in1
+	pu2@out   -> cu@in0
+
+cleanup:
+	rob@out   -> null
+	pu0@out   -> null
+	pu0@out   -> null
+	pu0@out   -> null
+	pu0@out   -> null
+	pu1@out   -> null
+	pu1@out   -> null
+	pu1@out   -> null
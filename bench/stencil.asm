@@ -0,0 +1,97 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// B[i] = A[i-1] + A[i] + A[i+1] for 1 < i < N
+// Memory: mem[0] = N (at least 3), A = mem[1 .. N], B = mem[N+1 .. 2N]
+// Units: lsu, rob, 3 pus for the virtual units pu.k, pu.n, pu.a, pu.sum, pu.addr
+//
+// Every element is loaded once, rob holds the window of the next iteration.
+// k = i - 1 runs from N - 2 down to 1.
+
+setup:
+	$0          -> lsu@in0
+	(lda, 4)    -> lsu@opc // N x4
+	
+	// A[N]
+	lsu@out     -> lsu@in0
+	(lda, 1)    -> lsu@opc
+	
+	// A[N - 1] x2
+	lsu@out     -> pu.a@in0
+	$1          -> pu.a@in1
+	(subN, 1)   -> pu.a@opc
+	pu.a@out    -> lsu@in0
+	(lda, 2)    -> lsu@opc
+	
+	lsu@out     -> pu.k@in0
+	$2          -> pu.k@in1
+	(subN, 3)   -> pu.k@opc // k = N - 2 x3
+	
+	lsu@out     -> pu.n@in0
+	$1          -> pu.n@in1
+	(addN, 2)   -> pu.n@opc // N + 1 x2
+	
+	// rob: A[k + 2], A[k + 1], A[k + 1]
+	lsu@out     -> rob@in0
+	lsu@out     -> rob@in0
+	lsu@out     -> rob@in0
+
+loop:
+	// A[k] x3
+	pu.k@out    -> lsu@in0
+	(lda, 3)    -> lsu@opc
+	
+	// A[k + 2] + A[k + 1] + A[k]
+	rob@out     -> pu.sum@in0
+	rob@out     -> pu.sum@in1
+	(addN, 1)   -> pu.sum@opc
+	pu.sum@out  -> pu.sum@in0
+	lsu@out     -> pu.sum@in1
+	(addN, 1)   -> pu.sum@opc
+	
+	// window of the next iteration
+	lsu@out     -> rob@in0
+	lsu@out     -> rob@in0
+	
+	// B[k + 1] at N + 1 + k
+	pu.k@out    -> pu.addr@in0
+	pu.n@out    -> pu.addr@in1
+	(addN, 1)   -> pu.addr@opc
+	pu.sum@out  -> lsu@in1
+	pu.addr@out -> lsu@in0
+	st          -> lsu@opc
+	
+	// N + 1 x2 for the next iteration
+	pu.n@out    -> pu.n@in0
+	$0          -> pu.n@in1
+	(orB, 2)    -> pu.n@opc
+	
+	// k = k - 1, x3 for the next iteration
+	pu.k@out    -> pu.k@in0
+	$1          -> pu.k@in1
+	(subN, 4)   -> pu.k@opc
+	
+	// (k != 0) -> branch to loop
+	loop        -> cu@in1
+	pu.k@out    -> cu@in0
+
+cleanup:
+	rob@out     -> null
+	rob@out     -> null
+	rob@out     -> null
+	pu.k@out    -> null
+	pu.k@out    -> null
+	pu.k@out    -> null
+	pu.n@out    -> null
+	pu.n@out    -> null
@@ -0,0 +1,82 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// C = A + B
+// Memory: mem[0] = N, A = mem[1 .. N], B = mem[N+1 .. 2N], C = mem[2N+1 .. 3N]
+// Units: lsu, rob, pu0 .. pu2
+
+setup:
+	$0        -> lsu@in0
+	(lda, 2)  -> lsu@opc // N x2
+	
+	lsu@out   -> rob@in0 // i = N
+	
+	lsu@out   -> pu1@in0
+	$0        -> pu1@in1
+	(orB, 3)  -> pu1@opc // pu1: N x3
+
+loop:
+	// pu0: i x3
+	rob@out   -> pu0@in0
+	$0        -> pu0@in1
+	(orB, 3)  -> pu0@opc
+	
+	// A[i]
+	pu0@out   -> lsu@in0
+	(lda, 1)  -> lsu@opc
+	
+	// pu2: N + i x2
+	pu0@out   -> pu2@in0
+	pu1@out   -> pu2@in1
+	(addN, 2) -> pu2@opc
+	
+	// B[i]
+	pu2@out   -> lsu@in0
+	(lda, 1)  -> lsu@opc
+	
+	// pu2: 2N + i
+	pu2@out   -> pu2@in0
+	pu1@out   -> pu2@in1
+	(addN, 1) -> pu2@opc
+	
+	// pu2: A[i] + B[i]
+	lsu@out   -> pu2@in0
+	lsu@out   -> pu2@in1
+	(addN, 1) -> pu2@opc
+	
+	// C[i] = A[i] + B[i]
+	pu2@out   -> lsu@in0
+	pu2@out   -> lsu@in1
+	st        -> lsu@opc
+	
+	// pu1: N x3 for the next iteration
+	pu1@out   -> pu1@in0
+	$0        -> pu1@in1
+	(orB, 3)  -> pu1@opc
+	
+	// i = i - 1
+	pu0@out   -> pu0@in0
+	$1        -> pu0@in1
+	(subN, 2) -> pu0@opc
+	pu0@out   -> rob@in0
+	
+	// (i != 0) -> branch to loop
+	loop      -> cu@in1
+	pu0@out   -> cu@in0
+
+cleanup:
+	rob@out   -> null
+	pu1@out   -> null
+	pu1@out   -> null
+	pu1@out   -> null
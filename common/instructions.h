@@ -6,6 +6,7 @@
 
 // Type adaptions because cl_* types are not natively available in OpenCL
 #define cl_uchar unsigned char
+#define cl_ushort ushort
 #define cl_uint uint
 #define cl_ulong ulong
 #define cl_double double
@@ -29,6 +30,10 @@ typedef union {
 	} op;
 } scad_data;
 
+// Words moved per global memory access by the memory stream units:
+// 8 * 64 bit = 512 bit. Stream buffers are padded to a multiple of this.
+#define SCAD_STREAM_BURST_WORDS 8
+
 enum scad_opcodes {
 	SCAD_MOVE_INVALID = 0,
 	SCAD_MOVE = 1,
@@ -40,6 +45,8 @@ enum scad_lsu_opcode {
 	SCAD_LSU_INVALID = 0,
 	SCAD_LSU_LOAD = 1,
 	SCAD_LSU_STORE = 2,
+	// Load without value operand: only opc and in0 are consumed.
+	SCAD_LSU_LOAD_ADDRESS = 3,
 };
 
 enum scad_pu_opcode {
@@ -68,8 +75,31 @@ enum scad_pu_opcode {
 	SCAD_PU_NEQB = 22,
 };
 
+// Bits of unit and buffer numbers, 8 or 16. configure sets it for each
+// processor in config.cl, 8 unless it has more than 255 interconnect ports.
+// The host tools use 16 and convert programs and traces for the device, see
+// device_layout.hpp.
+#ifndef SCAD_ADDRESS_WIDTH
+#ifdef __cplusplus
+#define SCAD_ADDRESS_WIDTH 16
+#else
+#define SCAD_ADDRESS_WIDTH 8
+#endif
+#endif
+
+#if SCAD_ADDRESS_WIDTH == 8
+typedef cl_uchar scad_address_part;
+#elif SCAD_ADDRESS_WIDTH == 16
+typedef cl_ushort scad_address_part;
+#else
+#error "SCAD_ADDRESS_WIDTH needs to be 8 or 16"
+#endif
+
+// Unit and buffer of the null address, moves to it discard their data.
+#define SCAD_ADDRESS_NULL ((scad_address_part) -1)
+
 struct __attribute__((packed)) scad_buffer_address {
-	cl_uchar unit, buffer;
+	scad_address_part unit, buffer;
 };
 
 struct __attribute__((packed)) scad_instruction {
@@ -84,6 +114,63 @@ struct __attribute__((packed)) scad_instruction {
 	struct scad_buffer_address to;
 };
 
+// Compact program encoding read by the control units. Every instruction is
+// one word of 4 * SCAD_ADDRESS_WIDTH bits, so the program counter stays an
+// index. Fields from the lowest bit, W being the address width:
+//   op (2 bits), to.buffer (W - 1), to.unit (W),
+//   then from.buffer (W - 1) and from.unit (W) of a move,
+//   or the index (2W - 1 bits) of the immediate in a pool of scad_data.
+// A buffer field of all ones is the null buffer. The words end with an
+// invalid instruction, the pool follows them aligned to 8 bytes.
+// An index of all ones is the long form for programs that fill the pool:
+// the immediate is at that index plus pc, after the full pool.
+// The host packs programs in device_layout.cpp.
+#define SCAD_PACKED_BUFFER_BITS(width) ((width) - 1)
+#define SCAD_PACKED_TO_BUFFER(width) 2
+#define SCAD_PACKED_TO_UNIT(width) ((width) + 1)
+#define SCAD_PACKED_FROM_BUFFER(width) (2 * (width) + 1)
+#define SCAD_PACKED_FROM_UNIT(width) (3 * (width))
+#define SCAD_PACKED_IMMEDIATE(width) (2 * (width) + 1)
+#define SCAD_PACKED_IMMEDIATE_LONG(width) ((((cl_ulong) 1) << (2 * (width) - 1)) - 1)
+// Byte offset of the pool in a program of length instructions.
+#define SCAD_PACKED_POOL_OFFSET(width, length) ((((length) + 1) * ((width) / 2) + 7) / 8 * 8)
+
+#if SCAD_ADDRESS_WIDTH == 8
+typedef cl_uint scad_packed_instruction;
+#else
+typedef cl_ulong scad_packed_instruction;
+#endif
+
+#if defined(ALTERA_CL)
+// Instruction at pc of a packed program with program_length instructions.
+struct scad_instruction scad_unpack_instruction(__global const scad_packed_instruction * restrict program,
+                                                cl_uint program_length, cl_ulong pc) {
+	scad_packed_instruction word = program[pc];
+	scad_packed_instruction buffer_mask = (1 << SCAD_PACKED_BUFFER_BITS(SCAD_ADDRESS_WIDTH)) - 1;
+	scad_packed_instruction buffer;
+	
+	struct scad_instruction instr;
+	instr.op = (enum scad_opcodes) (word & 3);
+	buffer = (word >> SCAD_PACKED_TO_BUFFER(SCAD_ADDRESS_WIDTH)) & buffer_mask;
+	instr.to.buffer = buffer == buffer_mask ? SCAD_ADDRESS_NULL : (scad_address_part) buffer;
+	instr.to.unit = (scad_address_part) (word >> SCAD_PACKED_TO_UNIT(SCAD_ADDRESS_WIDTH));
+	if(instr.op == SCAD_MOVE) {
+		buffer = (word >> SCAD_PACKED_FROM_BUFFER(SCAD_ADDRESS_WIDTH)) & buffer_mask;
+		instr.from.buffer = buffer == buffer_mask ? SCAD_ADDRESS_NULL : (scad_address_part) buffer;
+		instr.from.unit = (scad_address_part) (word >> SCAD_PACKED_FROM_UNIT(SCAD_ADDRESS_WIDTH));
+	} else if(instr.op == SCAD_MOVE_IMMEDIATE || instr.op == SCAD_MOVE_PC) {
+		__global const scad_data *immediates = (__global const scad_data *)
+			((__global const cl_uchar *) program + SCAD_PACKED_POOL_OFFSET(SCAD_ADDRESS_WIDTH, program_length));
+		cl_ulong index = word >> SCAD_PACKED_IMMEDIATE(SCAD_ADDRESS_WIDTH);
+		if(index == SCAD_PACKED_IMMEDIATE_LONG(SCAD_ADDRESS_WIDTH)) {
+			index += pc;
+		}
+		instr.immediate = immediates[index];
+	}
+	return instr;
+}
+#endif /* ALTERA_CL */
+
 struct __attribute__((packed)) scad_data_packet {
 	
 	scad_data data;
@@ -93,6 +180,43 @@ struct __attribute__((packed)) scad_data_packet {
 	struct scad_buffer_address to;
 };
 
+// Performance counters of one side (input or output) of a unit,
+// or of the interconnect.
+struct scad_unit_counters {
+	// Set if the unit answered the counter request.
+	cl_ulong valid;
+	// Iterations of the unit's main loop.
+	cl_ulong cycles;
+	// Operations executed, unit specific.
+	cl_ulong operations;
+	// Cycles with a move pending whose data did not yet arrive.
+	cl_ulong stall_input;
+	// Cycles with a full output buffer.
+	cl_ulong stall_output;
+	cl_ulong packets_sent;
+	cl_ulong packets_received;
+};
+
+enum scad_trace_kind {
+	SCAD_TRACE_INVALID = 0,
+	// Move dispatched by the control unit.
+	SCAD_TRACE_MOVE = 1,
+	// Packet delivered by the interconnect.
+	SCAD_TRACE_PACKET = 2,
+	// Control unit is done, last event of a trace.
+	SCAD_TRACE_END = 3,
+};
+
+struct __attribute__((packed)) scad_trace_event {
+	// Cycle of the trace unit when the event was recorded.
+	cl_ulong cycle;
+	// Immediate value of a move, data of a packet.
+	scad_data value;
+	struct scad_buffer_address from;
+	struct scad_buffer_address to;
+	cl_uchar kind;
+};
+
 struct __attribute__((packed)) scad_data_packet_nb {
 	bool valid;
 	
@@ -235,11 +235,20 @@ struct scad_data_packet buffer_output_pop(struct scad_buffer_output *buffer,
  * ABSTRACTED CHANNEL AND BUFFER HANDLING                                     *
  ******************************************************************************/
 
-struct scad_buffer_management scad_input_init(cl_uchar unit, cl_uchar buff_count,
+struct scad_unit_counters scad_counters_init() {
+	return (struct scad_unit_counters) {
+		.valid = 1, .cycles = 0, .operations = 0,
+		.stall_input = 0, .stall_output = 0,
+		.packets_sent = 0, .packets_received = 0
+	};
+}
+
+struct scad_buffer_management scad_input_init(scad_address_part unit, cl_uchar buff_count,
                                               struct scad_buffer_input *buff) {
 	struct scad_buffer_management man_result = {
 		.unit = unit, .buff_count = buff_count,
-		.pending_valid = false
+		.pending_valid = false,
+		.counters = scad_counters_init()
 	};
 	for(int i = 0; i < buff_count; i++) {
 		buffer_input_init(&buff[i]);
@@ -247,7 +256,7 @@ struct scad_buffer_management scad_input_init(cl_uchar unit, cl_uchar buff_count
 	return man_result;
 }
 
-void scad_input_handle(cl_uchar unit,
+void scad_input_handle(scad_address_part unit,
                        struct scad_buffer_management *man,
                        struct scad_buffer_input buff[]){
 	if(!man->pending_valid) {
@@ -286,14 +295,35 @@ void scad_input_handle(cl_uchar unit,
 		       packet.data.integer);
 #endif
 		buffer_input_push_data(&buff[packet.to.buffer], packet);
+		man->counters.packets_received++;
+	}
+	
+	// Waiting for data: a move is pending but its data has not arrived.
+	bool waiting = false;
+	for(int i = 0; i < man->buff_count; i++) {
+		if((buff[i].end != buff[i].start || buff[i].from_full)
+		   && !buff[i].data_set[buff[i].start]) {
+			waiting = true;
+		}
+	}
+	if(waiting) {
+		man->counters.stall_input++;
+	}
+	man->counters.cycles++;
+	
+	bool counters_requested;
+	read_channel_nb_altera(channel_counters_input_request[unit], &counters_requested);
+	if(counters_requested) {
+		write_channel_nb_altera(channel_counters_input[unit], man->counters);
 	}
 }
 
-struct scad_buffer_management scad_output_init(cl_uchar unit, cl_uchar buff_count,
+struct scad_buffer_management scad_output_init(scad_address_part unit, cl_uchar buff_count,
                       struct scad_buffer_output *buff) {
 	struct scad_buffer_management man_result = {
 		.unit = unit, .buff_count = buff_count,
-		.pending_valid = false
+		.pending_valid = false,
+		.counters = scad_counters_init()
 	};
 	//man->unit = unit;
 	//man->buff_count = buff_count;
@@ -304,7 +334,7 @@ struct scad_buffer_management scad_output_init(cl_uchar unit, cl_uchar buff_coun
 	return man_result;
 }
 
-void scad_output_handle(cl_uchar unit,
+void scad_output_handle(scad_address_part unit,
                         struct scad_buffer_management *man,
                         struct scad_buffer_output buff[]){
 	if(!man->pending_valid) {
@@ -354,6 +384,7 @@ void scad_output_handle(cl_uchar unit,
 			// This is used to delete data.
 			if(!buffer_address_is_reserved(packet.to)) {
 				write_channel_altera(channel_to_interconnect[unit], packet);
+				man->counters.packets_sent++;
 				#ifdef EMULATOR
 					printf("buffer: output packet sent: %d.%d -> %d.%d: 0x%lx\n", packet.from.unit, packet.from.buffer,
 					       packet.to.unit, packet.to.buffer, packet.data.integer);
@@ -362,6 +393,24 @@ void scad_output_handle(cl_uchar unit,
 		}
 	}
 // output will never be pending o.o
+	
+	// Blocked: the unit cannot push results to a full output buffer.
+	bool blocked = false;
+	for(int i = 0; i < man->buff_count; i++) {
+		if(buffer_output_data_full(&buff[i])) {
+			blocked = true;
+		}
+	}
+	if(blocked) {
+		man->counters.stall_output++;
+	}
+	man->counters.cycles++;
+	
+	bool counters_requested;
+	read_channel_nb_altera(channel_counters_output_request[unit], &counters_requested);
+	if(counters_requested) {
+		write_channel_nb_altera(channel_counters_output[unit], man->counters);
+	}
 }
 
 #endif /* SCAD_BUFFER_CL */
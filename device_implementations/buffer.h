@@ -41,10 +41,10 @@
 // Special address that is used for synchronisation in input buffers
 // and data deletion in output buffers.
 #define RESERVED_ADDRESS ((struct scad_buffer_address) \
-                         {.unit = (cl_uchar) -1, .buffer = (cl_uchar) -1})
+                         {.unit = SCAD_ADDRESS_NULL, .buffer = SCAD_ADDRESS_NULL})
 bool buffer_address_is_reserved(struct scad_buffer_address addr) {
-	return addr.unit == (cl_uchar) -1
-	       && addr.buffer == (cl_uchar) -1;
+	return addr.unit == SCAD_ADDRESS_NULL
+	       && addr.buffer == SCAD_ADDRESS_NULL;
 }
 
 /******************************************************************************
@@ -126,22 +126,28 @@ struct scad_data_packet buffer_output_pop(struct scad_buffer_output *buffer,
 
 // All data stored only once per set of buffers
 struct scad_buffer_management {
-	cl_uchar unit, buff_count;
+	scad_address_part unit;
+	cl_uchar buff_count;
 	struct scad_instruction pending;
 	bool pending_valid;
+	// Updated by the handle functions, operations by the unit itself.
+	struct scad_unit_counters counters;
 };
 
-struct scad_buffer_management scad_input_init(cl_uchar unit, cl_uchar buff_count,
+// Zeroed counters, valid set.
+struct scad_unit_counters scad_counters_init();
+
+struct scad_buffer_management scad_input_init(scad_address_part unit, cl_uchar buff_count,
                                               struct scad_buffer_input *buff);
 
-void scad_input_handle(cl_uchar unit,
+void scad_input_handle(scad_address_part unit,
                        struct scad_buffer_management *man,
                        struct scad_buffer_input buff[]);
 
-struct scad_buffer_management scad_output_init(cl_uchar unit, cl_uchar buff_count,
+struct scad_buffer_management scad_output_init(scad_address_part unit, cl_uchar buff_count,
                                                struct scad_buffer_output *buff);
 
-void scad_output_handle(cl_uchar unit,
+void scad_output_handle(scad_address_part unit,
                         struct scad_buffer_management *man,
                         struct scad_buffer_output buff[]);
 
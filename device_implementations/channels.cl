@@ -37,4 +37,27 @@ channel struct scad_data_packet channel_to_interconnect[UNIT_COUNT]
 channel struct scad_data_packet channel_from_interconnect[UNIT_COUNT]
 	__attribute__((depth(CHANNEL_DEPTH)));
 
+// Performance counter requests from the counters kernel, answered from
+// the input and output buffer handling of every unit and the interconnect.
+channel bool channel_counters_input_request[UNIT_COUNT]
+	__attribute__((depth(1)));
+channel struct scad_unit_counters channel_counters_input[UNIT_COUNT]
+	__attribute__((depth(1)));
+channel bool channel_counters_output_request[UNIT_COUNT]
+	__attribute__((depth(1)));
+channel struct scad_unit_counters channel_counters_output[UNIT_COUNT]
+	__attribute__((depth(1)));
+channel bool channel_counters_interconnect_request
+	__attribute__((depth(1)));
+channel struct scad_unit_counters channel_counters_interconnect
+	__attribute__((depth(1)));
+
+#if TRACE_SAMPLE > 0
+// Sampled events for the trace unit.
+channel struct scad_trace_event channel_trace_move
+	__attribute__((depth(16)));
+channel struct scad_trace_event channel_trace_packet
+	__attribute__((depth(16)));
+#endif
+
 #endif /* SCAD_CHANNELS_CL */
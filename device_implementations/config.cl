@@ -6,6 +6,10 @@
 
 // Number of functional units to allocate endpoints for
 #define  UNIT_COUNT ${UNIT_COUNT}
+#define  UNIT_COUNT_LOG2 ${UNIT_COUNT_LOG2}
+
+// Bits of unit and buffer numbers in instructions and packets.
+#define  SCAD_ADDRESS_WIDTH ${ADDRESS_WIDTH}
 
 // Altera channel depth (different from buffer size).
 // TODO: With the trivial interconnect, emulation hangs for depth of 1,
@@ -13,4 +17,7 @@
 //       -> invesitage when we have access to hardware.
 #define  CHANNEL_DEPTH 1
 
+// Trace every TRACE_SAMPLE-th move and packet, 0 disables the trace unit.
+#define  TRACE_SAMPLE ${TRACE_SAMPLE}
+
 #endif /* SCAD_CONFIG_CL */
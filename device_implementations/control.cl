@@ -15,62 +15,76 @@
 #include "common/instructions.h"
 
 #include "channels.cl"
+#include "trace.cl"
 
 // The control unit needs to be number 0
 #if ${NUMBER} > 0
 #error "The control unit needs to be given number 0"
 #endif
 
-void send_move_instr_to(cl_uchar to_unit, struct scad_instruction instr) {
+// Channel indices have to be constant, so every unit gets its case. The ACK
+// is read in the same case: a unit number without channel is dropped instead
+// of waiting forever, the emulator reports it.
 #ifdef EMULATOR
-	printf("control: send_move_instr_to(%d)\n", to_unit);
-	write_channel_altera(channel_move_instructions_to[to_unit], instr);
+#define SEND_MOVE_INSTR_CASE(UNIT) \
+	case UNIT: \
+		write_channel_altera(channel_move_instructions_to[UNIT], instr); \
+		mem_fence(CLK_CHANNEL_MEM_FENCE); \
+		printf("control: Waiting for ACK from %d.\n", to_unit); \
+		read_channel_altera(channel_move_instructions_to_ack[UNIT]); \
+		printf("control: Received ACK from %d.\n", to_unit); \
+		break;
+#define SEND_MOVE_INSTR_DEFAULT \
+	default: \
+		printf("control: ERROR: dropping move to unit %d, it has no channel.\n", to_unit); \
+		break;
 #else
-	switch(to_unit) {
-                case 0: write_channel_altera(channel_move_instructions_to[0], instr); break;
-                case 1: write_channel_altera(channel_move_instructions_to[1], instr); break;
-                case 2: write_channel_altera(channel_move_instructions_to[2], instr); break;
-                case 3: write_channel_altera(channel_move_instructions_to[3], instr); break;
-                case 4: write_channel_altera(channel_move_instructions_to[4], instr); break;
-                case 5: write_channel_altera(channel_move_instructions_to[5], instr); break;
-                case 6: write_channel_altera(channel_move_instructions_to[6], instr); break;
-                case 7: write_channel_altera(channel_move_instructions_to[7], instr); break;
-                case 8: write_channel_altera(channel_move_instructions_to[8], instr); break;
-                case 9: write_channel_altera(channel_move_instructions_to[9], instr); break;
-                case 10: write_channel_altera(channel_move_instructions_to[10], instr); break;
-                case 11: write_channel_altera(channel_move_instructions_to[11], instr); break;
-                case 12: write_channel_altera(channel_move_instructions_to[12], instr); break;
-                case 13: write_channel_altera(channel_move_instructions_to[13], instr); break;
-                case 14: write_channel_altera(channel_move_instructions_to[14], instr); break;
-                case 15: write_channel_altera(channel_move_instructions_to[15], instr); break;
-                case 16: write_channel_altera(channel_move_instructions_to[16], instr); break;
-                case 17: write_channel_altera(channel_move_instructions_to[17], instr); break;
-                case 18: write_channel_altera(channel_move_instructions_to[18], instr); break;
-                case 19: write_channel_altera(channel_move_instructions_to[19], instr); break;
-                case 20: write_channel_altera(channel_move_instructions_to[20], instr); break;
-                case 21: write_channel_altera(channel_move_instructions_to[21], instr); break;
-                case 22: write_channel_altera(channel_move_instructions_to[22], instr); break;
-                case 23: write_channel_altera(channel_move_instructions_to[23], instr); break;
-                case 24: write_channel_altera(channel_move_instructions_to[24], instr); break;
-                case 25: write_channel_altera(channel_move_instructions_to[25], instr); break;
-                case 26: write_channel_altera(channel_move_instructions_to[26], instr); break;
-                case 27: write_channel_altera(channel_move_instructions_to[27], instr); break;
-                case 28: write_channel_altera(channel_move_instructions_to[28], instr); break;
-                case 29: write_channel_altera(channel_move_instructions_to[29], instr); break;
-                case 30: write_channel_altera(channel_move_instructions_to[30], instr); break;
-                case 31: write_channel_altera(channel_move_instructions_to[31], instr); break;
-		default: break;
-	}
-	mem_fence(CLK_CHANNEL_MEM_FENCE);
-#endif
-	// Wait for ACK
-#ifdef EMULATOR
-	printf("control: Waiting for ACK from %d.\n", to_unit);
+#define SEND_MOVE_INSTR_CASE(UNIT) \
+	case UNIT: \
+		write_channel_altera(channel_move_instructions_to[UNIT], instr); \
+		mem_fence(CLK_CHANNEL_MEM_FENCE); \
+		read_channel_altera(channel_move_instructions_to_ack[UNIT]); \
+		break;
+#define SEND_MOVE_INSTR_DEFAULT \
+	default: \
+		break;
 #endif
-	read_channel_altera(channel_move_instructions_to_ack[to_unit]);
+
+void send_move_instr_to(scad_address_part to_unit, struct scad_instruction instr) {
 #ifdef EMULATOR
-	printf("control: Received ACK from %d.\n", to_unit);
+	printf("control: send_move_instr_to(%d)\n", to_unit);
 #endif
+${if DISPATCH_TREE}
+	// Two levels for large machines: the group of the unit, then the unit.
+	switch(to_unit & ~(${DISPATCH_GROUP} - 1)) {
+${for GROUP in 0..DISPATCH_LAST_GROUP by DISPATCH_GROUP}
+		case ${GROUP}:
+			switch(to_unit) {
+${for UNIT in GROUP..GROUP+DISPATCH_GROUP}
+				SEND_MOVE_INSTR_CASE(${UNIT})
+${end}
+				SEND_MOVE_INSTR_DEFAULT
+			}
+			break;
+${end}
+		case ${DISPATCH_LAST_GROUP}:
+			switch(to_unit) {
+${for UNIT in DISPATCH_LAST_GROUP..UNIT_COUNT}
+				SEND_MOVE_INSTR_CASE(${UNIT})
+${end}
+				SEND_MOVE_INSTR_DEFAULT
+			}
+			break;
+		SEND_MOVE_INSTR_DEFAULT
+	}
+${else}
+	switch(to_unit) {
+${for UNIT in 0..UNIT_COUNT}
+		SEND_MOVE_INSTR_CASE(${UNIT})
+${end}
+		SEND_MOVE_INSTR_DEFAULT
+	}
+${end}
 }
 
 void send_move_sync(struct scad_buffer_address addr) {
@@ -79,14 +93,14 @@ void send_move_sync(struct scad_buffer_address addr) {
 #endif
 	send_move_instr_to(addr.unit, (struct scad_instruction)
 	                   {.op = SCAD_MOVE,
-	                    .to = addr, .from = {(cl_uchar) -1,(cl_uchar) -1}});
+	                    .to = addr, .from = {SCAD_ADDRESS_NULL,SCAD_ADDRESS_NULL}});
 #ifdef EMULATOR
 	printf("control: done sending sync to 0x%x.0x%x.\n", addr.unit, addr.buffer);
 #endif
 }
 
 
-void send_move_instr_from(cl_uchar from_unit, struct scad_instruction instr) {
+void send_move_instr_from(scad_address_part from_unit, struct scad_instruction instr) {
 #ifdef EMULATOR
 	printf("control: send_move_instr_from(%d)\n", from_unit);
 #endif
@@ -99,7 +113,7 @@ void send_data_packet(struct scad_data_packet packet) {
 }
 
 /*
-void send_move_instr(cl_uchar to_unit, struct scad_instruction instr) {
+void send_move_instr(scad_address_part to_unit, struct scad_instruction instr) {
 	switch(to_unit) {
 		case 0:
 #ifdef EMULATOR
@@ -114,18 +128,22 @@ void send_move_instr(cl_uchar to_unit, struct scad_instruction instr) {
 */
 
 // Might speed up the program reads.
-__kernel void ${NAME}(read_only __global struct scad_instruction program[],
+__kernel void ${NAME}(read_only __global scad_packed_instruction program[],
                            read_only cl_uint program_length) {
 	cl_ulong pc = 0;
 	cl_ulong branch_target = 0;
 	bool branch_valid = false;
 	
+#if TRACE_SAMPLE > 0
+	cl_uint trace_skip = 0;
+#endif
+	
 #ifdef EMULATOR
 	printf("control: starting at address 0\n");
 #endif
 	
 	while(pc < program_length) {
-		struct scad_instruction instr = program[pc];
+		struct scad_instruction instr = scad_unpack_instruction(program, program_length, pc);
 		switch(instr.op) {
 			
 			case SCAD_MOVE:
@@ -162,7 +180,7 @@ __kernel void ${NAME}(read_only __global struct scad_instruction program[],
 					
 					// Else: Normal move, send the instruction to sender and receiver
 					} else {
-						if(instr.to.unit != (cl_uchar) -1) {
+						if(instr.to.unit != SCAD_ADDRESS_NULL) {
 #ifdef EMULATOR
 							printf("control: sending move to destination\n");
 #endif
@@ -173,6 +191,9 @@ __kernel void ${NAME}(read_only __global struct scad_instruction program[],
 						printf("control: sending move to source\n");
 #endif
 						send_move_instr_from(instr.from.unit, instr);
+#if TRACE_SAMPLE > 0
+						scad_trace_move(&trace_skip, instr.from, instr.to, (scad_data) {.integer = 0});
+#endif
 						pc++;
 					}
 				break;
@@ -201,6 +222,9 @@ __kernel void ${NAME}(read_only __global struct scad_instruction program[],
 						send_data_packet((struct scad_data_packet)
 							{.data = instr.immediate,
 							 .to = instr.to, .from = {0,0}});
+#if TRACE_SAMPLE > 0
+						scad_trace_move(&trace_skip, (struct scad_buffer_address) {0, 0}, instr.to, instr.immediate);
+#endif
 					}
 					pc++;
 				break;
@@ -231,5 +255,8 @@ __kernel void ${NAME}(read_only __global struct scad_instruction program[],
 	for(int i = 0; sync_units[i].unit; i++) {
 		send_move_sync(sync_units[i]);
 	}
+#if TRACE_SAMPLE > 0
+	scad_trace_end();
+#endif
 }
 
@@ -16,13 +16,14 @@
 
 #include "channels.cl"
 #include "buffer.cl"
+#include "trace.cl"
 
 // The control unit needs to be number 0
 #if ${NUMBER} > 0
 #error "The control unit needs to be given number 0"
 #endif
 
-void send_move_instr_to(cl_uchar to_unit, struct scad_instruction instr) {
+void send_move_instr_to(scad_address_part to_unit, struct scad_instruction instr) {
 #ifdef EMULATOR
 	printf("control: send_move_instr_to(%d)\n", to_unit);
 #endif
@@ -52,10 +53,10 @@ struct scad_instruction sync_instr_to(struct scad_buffer_address to_addr) {
 #ifdef EMULATOR
 	printf("control: sync_instr_to(%d, %d)\n", to_addr.unit, to_addr.buffer);
 #endif
-	return (struct scad_instruction) {.op = SCAD_MOVE, .to = to_addr, .from = {(cl_uchar) -1,(cl_uchar) -1}};
+	return (struct scad_instruction) {.op = SCAD_MOVE, .to = to_addr, .from = {SCAD_ADDRESS_NULL,SCAD_ADDRESS_NULL}};
 }
 
-void send_move_instr_from(cl_uchar from_unit, struct scad_instruction instr) {
+void send_move_instr_from(scad_address_part from_unit, struct scad_instruction instr) {
 #ifdef EMULATOR
 	printf("control: send_move_instr_from(%d)\n", from_unit);
 #endif
@@ -118,7 +119,7 @@ enum ${NAME}_STATE {
 };
 
 // CONTROL: Main logic kernel, run from host.
-__kernel void ${NAME}(read_only __global struct scad_instruction * restrict program,
+__kernel void ${NAME}(read_only __global scad_packed_instruction * restrict program,
                       cl_uint program_length) {
 	enum ${NAME}_STATE state = PROGRAM;
 	
@@ -128,12 +129,17 @@ __kernel void ${NAME}(read_only __global struct scad_instruction * restrict prog
 	
 	cl_ulong pc = 0;
 	
+#if TRACE_SAMPLE > 0
+	cl_uint trace_skip = 0;
+#endif
+	
 #ifdef EMULATOR
 	printf("control: starting at address 0\n");
 #endif
 	
 	while(state == PROGRAM || state == SYNC) {
-		struct scad_instruction instr = (state == PROGRAM) ? program[pc] : sync_instr_to(sync_units[pc]);
+		struct scad_instruction instr = (state == PROGRAM) ? scad_unpack_instruction(program, program_length, pc)
+		                                                   : sync_instr_to(sync_units[pc]);
 		#ifdef EMULATOR
 			printf("control: [state:%u] [pc:%lu] instr(op: %d, from: %d.%d, to: %d.%d)\n",
 			       state, pc, instr.op, instr.from.unit, instr.from.buffer, instr.to.unit, instr.to.buffer);
@@ -165,9 +171,13 @@ __kernel void ${NAME}(read_only __global struct scad_instruction * restrict prog
 			// Send move:
 			if(send_move) {
 				send_move_instr_to(move_instr.to.unit, move_instr);
-				if(move_instr.to.unit != (cl_uchar) -1) {
+				if(move_instr.to.unit != SCAD_ADDRESS_NULL) {
 					send_move_instr_from(move_instr.from.unit, move_instr);
 				}
+#if TRACE_SAMPLE > 0
+				scad_trace_move(&trace_skip, move_instr.from, move_instr.to,
+				                (instr.op == SCAD_MOVE_IMMEDIATE) ? instr.immediate : (scad_data) {.integer = 0});
+#endif
 			}
 		}
 		{ // Immediate move data
@@ -219,6 +229,9 @@ __kernel void ${NAME}(read_only __global struct scad_instruction * restrict prog
 			}
 		}
 	}
+#if TRACE_SAMPLE > 0
+	scad_trace_end();
+#endif
 	#ifdef EMULATOR
 		printf("control: DONE. TERMINATING.\n");
 	#endif
@@ -0,0 +1,84 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+/* PERFORMANCE COUNTERS
+ * Run from host to collect the counters of all units and the interconnect:
+ *   scad_counters(counters, timeout) writes 2 * UNIT_COUNT + 1 entries:
+ *     counters[2 * unit]:      input side of unit
+ *     counters[2 * unit + 1]:  output side of unit
+ *     counters[2 * UNIT_COUNT]: interconnect
+ * Every side is polled for up to timeout iterations. Sides that are not
+ * running (host kernels already done, missing buffers, unused numbers)
+ * do not answer and are returned with valid == 0.
+ * Late answers to an earlier run are drained before each request, sides
+ * drop answers while their channel is full.
+ */
+
+#ifndef SCAD_COUNTERS_CL
+#define SCAD_COUNTERS_CL
+
+#include "common/instructions.h"
+#include "config.cl"
+#include "channels.cl"
+
+__kernel void scad_counters(__global struct scad_unit_counters * restrict counters,
+                            cl_uint timeout) {
+	struct scad_unit_counters invalid = {.valid = 0};
+	
+	#pragma unroll
+	for(int unit = 0; unit < UNIT_COUNT; unit++) {
+		struct scad_unit_counters input_counters = invalid;
+		struct scad_unit_counters output_counters = invalid;
+		
+		bool stale = true;
+		while(stale) {
+			read_channel_nb_altera(channel_counters_input[unit], &stale);
+		}
+		stale = true;
+		while(stale) {
+			read_channel_nb_altera(channel_counters_output[unit], &stale);
+		}
+		write_channel_nb_altera(channel_counters_input_request[unit], true);
+		write_channel_nb_altera(channel_counters_output_request[unit], true);
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+		
+		bool input_read = false, output_read = false;
+		for(cl_uint i = 0; i < timeout && !(input_read && output_read); i++) {
+			if(!input_read) {
+				input_counters = read_channel_nb_altera(channel_counters_input[unit], &input_read);
+			}
+			if(!output_read) {
+				output_counters = read_channel_nb_altera(channel_counters_output[unit], &output_read);
+			}
+		}
+		
+		counters[2 * unit] = input_read ? input_counters : invalid;
+		counters[2 * unit + 1] = output_read ? output_counters : invalid;
+	}
+	
+	struct scad_unit_counters interconnect_counters = invalid;
+	bool stale = true;
+	while(stale) {
+		read_channel_nb_altera(channel_counters_interconnect, &stale);
+	}
+	write_channel_nb_altera(channel_counters_interconnect_request, true);
+	mem_fence(CLK_CHANNEL_MEM_FENCE);
+	bool interconnect_read = false;
+	for(cl_uint i = 0; i < timeout && !interconnect_read; i++) {
+		interconnect_counters = read_channel_nb_altera(channel_counters_interconnect, &interconnect_read);
+	}
+	counters[2 * UNIT_COUNT] = interconnect_read ? interconnect_counters : invalid;
+}
+
+#endif /* SCAD_COUNTERS_CL */
@@ -112,6 +112,7 @@ kernel void ${NAME}() {
 			scad_data left_operand = buffer_input_pop(&input[0]); // lsu.in0
 			scad_data right_operand = buffer_input_pop(&input[1]); // lsu.in1
 			scad_data opc = buffer_input_pop(&input[2]); // lsu.opc
+			input_manage.counters.operations++;
 			
 			// Perform calculation.
 			pending_data = ${NAME}_eval(left_operand, right_operand, opc.op.opcode);
@@ -14,6 +14,8 @@
 
 #include "common/instructions.h"
 #include "channels.cl"
+#include "buffer.h"
+#include "trace.cl"
 
 // 1 is just wrong.
 #if UNIT_COUNT == 2
@@ -51,8 +53,14 @@
 #define BANYAN_SIZE 128
 #define BANYAN_DEPTH 7
 
+#elif (UNIT_COUNT & (UNIT_COUNT - 1)) == 0
+
+// Larger machines need 16 bit unit numbers.
+#define BANYAN_SIZE UNIT_COUNT
+#define BANYAN_DEPTH UNIT_COUNT_LOG2
+
 #else
-#error UNIT_COUNT is not a supported number (valid: 128, 64, 32, 16, 8, 4)
+#error UNIT_COUNT is not a supported number (valid: powers of two)
 #endif
 
 int ${NAME}_permutation(int size_exponent, int i) {
@@ -117,7 +125,20 @@ kernel void ${NAME}() {
 	#define ROW(Y) (Y)
 	__private __attribute__((register)) struct scad_data_packet_nb buffers[BANYAN_SIZE * (BANYAN_DEPTH+1)];
 	
+	// Operations are packets delivered.
+	struct scad_unit_counters counters = scad_counters_init();
+#if TRACE_SAMPLE > 0
+	cl_uint trace_skip = 0;
+#endif
+	
 	while(1) {
+		counters.cycles++;
+		bool counters_requested;
+		read_channel_nb_altera(channel_counters_interconnect_request, &counters_requested);
+		if(counters_requested) {
+			write_channel_nb_altera(channel_counters_interconnect, counters);
+		}
+		
 		// INPUT:
 		// Read values into empty buffers
 		#pragma ivdep
@@ -125,6 +146,9 @@ kernel void ${NAME}() {
 		for(int i = 0; i < BANYAN_SIZE; i++) {
 			if(!buffers[COL(0) + ROW(i)].valid) {
 				buffers[COL(0) + ROW(i)].packet = read_channel_nb_altera(channel_to_interconnect[i], &buffers[COL(0) + ROW(i)].valid);
+				if(buffers[COL(0) + ROW(i)].valid) {
+					counters.packets_received++;
+				}
 	#ifdef EMULATOR
 				if(buffers[COL(0) + ROW(i)].valid) {
 					struct scad_data_packet packet = buffers[COL(0) + ROW(i)].packet;
@@ -161,6 +185,11 @@ kernel void ${NAME}() {
 					!write_channel_nb_altera(channel_from_interconnect[i],
 					                         buffers[COL(BANYAN_DEPTH) + ROW(i)].packet);
 				if(!buffers[COL(BANYAN_DEPTH) + ROW(i)].valid) {
+					counters.packets_sent++;
+					counters.operations++;
+#if TRACE_SAMPLE > 0
+					scad_trace_packet(&trace_skip, buffers[COL(BANYAN_DEPTH) + ROW(i)].packet);
+#endif
 	#ifdef EMULATOR
 					struct scad_data_packet packet = buffers[COL(BANYAN_DEPTH) + ROW(i)].packet;
 					printf("Interconnect delivered %d.%d -> %d.%d at port %d.\n",
@@ -168,6 +197,8 @@ kernel void ${NAME}() {
 					       packet.to.unit, packet.to.buffer,
 					       i);
 	#endif
+				} else {
+					counters.stall_output++;
 				}
 			}
 		}
@@ -14,6 +14,7 @@
 
 #include "common/instructions.h"
 #include "channels.cl"
+#include "buffer.h"
 
 // 1 is just wrong.
 #if UNIT_COUNT == 2
@@ -51,8 +52,14 @@
 #define BANYAN_WORK_ITEMS 64
 #define BANYAN_DEPTH 7
 
+#elif (UNIT_COUNT & (UNIT_COUNT - 1)) == 0
+
+// Larger machines need 16 bit unit numbers.
+#define BANYAN_WORK_ITEMS (UNIT_COUNT / 2)
+#define BANYAN_DEPTH UNIT_COUNT_LOG2
+
 #else
-#error UNIT_COUNT is not a supported number (valid: 128, 64, 32, 16, 8, 4)
+#error UNIT_COUNT is not a supported number (valid: powers of two)
 #endif
 
 int ${NAME}_permutation(int size_exponent, int i) {
@@ -124,12 +131,25 @@ kernel void ${NAME}() {
 	size_t fst = gid * 2;     // first data row index
 	size_t snd = gid * 2 + 1; // second data row index
 	
+	// Work item 0 answers counter requests with the packets of its rows.
+	struct scad_unit_counters counters = scad_counters_init();
+	
 	while(1) {
+		if(gid == 0) {
+			counters.cycles++;
+			bool counters_requested;
+			read_channel_nb_altera(channel_counters_interconnect_request, &counters_requested);
+			if(counters_requested) {
+				write_channel_nb_altera(channel_counters_interconnect, counters);
+			}
+		}
+		
 		// INPUT:
 		// Read values into empty buffers
 		if(!buffers[fst][0].valid) {
 			buffers[fst][0].packet = read_channel_nb_altera(channel_to_interconnect[fst], &buffers[fst][0].valid);
 			if(buffers[fst][0].valid) {
+				counters.packets_received++;
 				struct scad_data_packet packet = buffers[fst][0].packet;
 				printf("Interconnect received: %d.%d -> %d.%d\n",
 				       packet.from.unit, packet.from.buffer,
@@ -139,6 +159,7 @@ kernel void ${NAME}() {
 		if(!buffers[snd][0].valid) {
 			buffers[snd][0].packet = read_channel_nb_altera(channel_to_interconnect[snd], &buffers[snd][0].valid);
 			if(buffers[snd][0].valid) {
+				counters.packets_received++;
 				struct scad_data_packet packet = buffers[snd][0].packet;
 				printf("Interconnect received: %d.%d -> %d.%d\n",
 				       packet.from.unit, packet.from.buffer,
@@ -166,6 +187,8 @@ kernel void ${NAME}() {
 				!write_channel_nb_altera(channel_from_interconnect[fst],
 				                         buffers[fst][BANYAN_DEPTH].packet);
 			if(!buffers[fst][BANYAN_DEPTH].valid) {
+				counters.packets_sent++;
+				counters.operations++;
 				struct scad_data_packet packet = buffers[fst][BANYAN_DEPTH].packet;
 				printf("Interconnect delivered %d.%d -> %d.%d at port %lu.\n",
 				       packet.from.unit, packet.from.buffer,
@@ -179,6 +202,8 @@ kernel void ${NAME}() {
 				!write_channel_nb_altera(channel_from_interconnect[snd],
 				                         buffers[snd][BANYAN_DEPTH].packet);
 			if(!buffers[snd][BANYAN_DEPTH].valid) {
+				counters.packets_sent++;
+				counters.operations++;
 				struct scad_data_packet packet = buffers[snd][BANYAN_DEPTH].packet;
 				printf("Interconnect delivered %d.%d -> %d.%d at port %lu.\n",
 				       packet.from.unit, packet.from.buffer,
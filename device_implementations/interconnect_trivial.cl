@@ -15,10 +15,12 @@
 #include "common/instructions.h"
 #include "config.cl"
 #include "channels.cl"
+#include "buffer.h"
+#include "trace.cl"
 
 
 // Hack to use dynamic channel indices.
-struct scad_data_packet ${NAME}_input(cl_uchar unit, bool *value_read) {
+struct scad_data_packet ${NAME}_input(scad_address_part unit, bool *value_read) {
 	struct scad_data_packet packet = {.data={.integer = -1}, .from={-1, -1}, .to={-1, -1}};
 	*value_read = false;
 	
@@ -31,7 +33,7 @@ struct scad_data_packet ${NAME}_input(cl_uchar unit, bool *value_read) {
 	return packet;
 }
 
-void ${NAME}_output(cl_uchar unit, struct scad_data_packet packet) {
+void ${NAME}_output(scad_address_part unit, struct scad_data_packet packet) {
 	#pragma unroll
 	for (int i = 0; i < UNIT_COUNT; i++) {
 		if(unit == i) {
@@ -46,12 +48,26 @@ __kernel void ${NAME}() {
 #ifdef EMULATOR
 	printf("interconnect starting.\n");
 #endif
+	// Operations are packets delivered.
+	struct scad_unit_counters counters = scad_counters_init();
+#if TRACE_SAMPLE > 0
+	cl_uint trace_skip = 0;
+#endif
+	
 	while(1) {
 		for(unsigned int from = 0;; from = (from + 1) % UNIT_COUNT) {
 			bool read_from;
 			struct scad_data_packet packet = ${NAME}_input(from, &read_from);
 			
+			counters.cycles++;
+			bool counters_requested;
+			read_channel_nb_altera(channel_counters_interconnect_request, &counters_requested);
+			if(counters_requested) {
+				write_channel_nb_altera(channel_counters_interconnect, counters);
+			}
+			
 			if(read_from) {
+				counters.packets_received++;
 #ifdef EMULATOR
 				printf("interconnect: transmitting data packet from %d.%d -> %d.%d: $0x%lx\n",
 				       packet.from.unit, packet.from.buffer, packet.to.unit, packet.to.buffer,
@@ -59,6 +75,11 @@ __kernel void ${NAME}() {
 #endif
 				if(packet.to.unit < UNIT_COUNT) {
 					${NAME}_output(packet.to.unit, packet);
+					counters.packets_sent++;
+					counters.operations++;
+#if TRACE_SAMPLE > 0
+					scad_trace_packet(&trace_skip, packet);
+#endif
 				} else {
 #ifdef EMULATOR
 				printf("interconnect: INVALID DESTINATION: %d.%d -> %d.%d: $0x%lx\n",
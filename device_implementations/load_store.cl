@@ -80,13 +80,19 @@ __kernel void ${NAME}(read_only __global scad_data * restrict mem_input,
 		
 		} else if(pending_copies == 0
 		          && buffer_input_has_data(&input[0])
-		          && buffer_input_has_data(&input[1])
-		          && buffer_input_has_data(&input[2])) {
+		          && buffer_input_has_data(&input[2])
+		          && (buffer_input_peek(&input[2]).op.opcode == SCAD_LSU_LOAD_ADDRESS
+		              || buffer_input_has_data(&input[1]))) {
 			// No more pending copies and all inputs are available
 			// Execute next operation
 			scad_data address = buffer_input_pop(&input[0]); // lsu.in0
-			scad_data value = buffer_input_pop(&input[1]); // lsu.in1
 			scad_data opc = buffer_input_pop(&input[2]); // lsu.opc
+			input_manage.counters.operations++;
+			// Loads by address have no value operand.
+			scad_data value = {.integer = 0};
+			if(opc.op.opcode != SCAD_LSU_LOAD_ADDRESS) {
+				value = buffer_input_pop(&input[1]); // lsu.in1
+			}
 			
 			cl_uchar address_prefix = (address.integer >> 62) & 0x03;
 			cl_ulong address_offset = address.integer ^ (address_prefix << 62);
@@ -129,6 +135,7 @@ __kernel void ${NAME}(read_only __global scad_data * restrict mem_input,
 					}
 					break;
 				case SCAD_LSU_LOAD:
+				case SCAD_LSU_LOAD_ADDRESS:
 #ifdef EMULATOR
 					printf("load-store: RECEIVED A LOAD: Address 0x%lx with 0x%x copies.\n", address.integer, opc.op.count);
 #endif
@@ -15,6 +15,8 @@
 /* LOAD-STORE UNIT
  * INPUTS: in0 (address), in1 (value), opc (opcode, count)
  * OUTPUT: out (non for store, results for load)
+ *
+ * Loads by address (lda) take no value from in1.
  */
 
 #include "common/instructions.h"
@@ -92,6 +94,8 @@ __kernel void ${NAME}_external_input() {
 		scad_input_init(${NUMBER}, SCAD_LSU_INPUT_NUM, input);
 	
 	enum ${NAME}_INSTATE state = ${NAME}_INSTATE_SYNC;
+	// Opcode of the operation currently relayed.
+	scad_data opc;
 	
 	while(true) {
 		scad_input_handle(${NUMBER}, &input_manage, input);
@@ -118,7 +122,8 @@ __kernel void ${NAME}_external_input() {
 				#ifdef EMULATOR
 					printf("[${NAME}_external_input] relaying opcode %lu\n", buffer_input_peek(&input[2]).integer);
 				#endif
-				buffer_input_pop(&input[2]);
+				opc = buffer_input_pop(&input[2]);
+				input_manage.counters.operations++;
 				state = ${NAME}_INSTATE_ADDRESS;
 			}
 		}
@@ -132,7 +137,12 @@ __kernel void ${NAME}_external_input() {
 					printf("[${NAME}_external_input] relaying address %lu\n", buffer_input_peek(&input[0]).integer);
 				#endif
 				buffer_input_pop(&input[0]);
-				state = ${NAME}_INSTATE_DATA;
+				// Loads by address have no value operand.
+				if(opc.op.opcode == SCAD_LSU_LOAD_ADDRESS) {
+					state = ${NAME}_INSTATE_SYNC;
+				} else {
+					state = ${NAME}_INSTATE_DATA;
+				}
 			}
 			mem_fence(CLK_CHANNEL_MEM_FENCE);
 		}
@@ -187,7 +197,10 @@ __kernel void ${NAME}(__global scad_data * restrict mem,
 		mem_fence(CLK_CHANNEL_MEM_FENCE);
 		scad_data address = read_channel_altera(${NAME}_channel_input_address);
 		mem_fence(CLK_CHANNEL_MEM_FENCE);
-		scad_data value = read_channel_altera(${NAME}_channel_input_value);
+		scad_data value = {.integer = 0};
+		if(opc.op.opcode != SCAD_LSU_LOAD_ADDRESS) {
+			value = read_channel_altera(${NAME}_channel_input_value);
+		}
 		mem_fence(CLK_CHANNEL_MEM_FENCE);
 		#ifdef EMULATOR
 			printf("[${NAME}] RECEIVED A TRIPLE\n");
@@ -209,6 +222,7 @@ __kernel void ${NAME}(__global scad_data * restrict mem,
 				break;
 			
 			case SCAD_LSU_LOAD:
+			case SCAD_LSU_LOAD_ADDRESS:
 #ifdef EMULATOR
 				printf("[${NAME}] RECEIVED A LOAD: Address 0x%lx with 0x%x copies.\n", address.integer, opc.op.count);
 #endif
@@ -0,0 +1,261 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+/* CACHED LOAD-STORE UNIT
+ * INPUTS: in0 (address), in1 (value), opc (opcode, count)
+ * OUTPUT: out (non for store, results for load)
+ *
+ * PARAMETERS:
+ *   CACHE_LINES: Number of cache lines, power of two.
+ *   LINE_WORDS:  scad_data words per line, power of two.
+ *   WRITE_BACK:  1: write-back with write-allocate,
+ *                0: write-through without write-allocate.
+ *
+ * Same interface as lsu, but started from host with (mem, mem_length,
+ * counters) and terminated by a sync marker on opc.
+ * Direct-mapped, on-chip cache in front of mem:
+ *   line = address / LINE_WORDS
+ *   index = line % CACHE_LINES, tag = line / CACHE_LINES
+ * Dirty lines are written back and all lines invalidated on termination,
+ * so the host sees all stores and the next run starts with a cold cache.
+ * Loads by address (lda) take no value from in1.
+ *
+ * COUNTERS:
+ *   Written to counters when the unit terminates:
+ *     counters[0]: hits
+ *     counters[1]: misses
+ *     counters[2]: evictions of valid lines
+ *     counters[3]: lines written back to mem
+ */
+
+#include "common/instructions.h"
+
+#include "channels.cl"
+#include "buffer.h"
+
+
+// LSU
+// 3 inputs: in0, in1, opc
+#define SCAD_LSU_INPUT_NUM 3
+// 1 output: out
+#define SCAD_LSU_OUTPUT_NUM 1
+
+#define ${NAME}_CACHE_LINES ${CACHE_LINES}
+#define ${NAME}_LINE_WORDS ${LINE_WORDS}
+#define ${NAME}_WRITE_BACK ${WRITE_BACK}
+
+#if (${NAME}_CACHE_LINES & (${NAME}_CACHE_LINES - 1)) != 0
+#error "CACHE_LINES of ${NAME} needs to be a power of two"
+#endif
+#if (${NAME}_LINE_WORDS & (${NAME}_LINE_WORDS - 1)) != 0
+#error "LINE_WORDS of ${NAME} needs to be a power of two"
+#endif
+
+#define ${NAME}_COUNTER_HITS 0
+#define ${NAME}_COUNTER_MISSES 1
+#define ${NAME}_COUNTER_EVICTIONS 2
+#define ${NAME}_COUNTER_WRITEBACKS 3
+#define ${NAME}_COUNTER_NUM 4
+
+struct ${NAME}_cache {
+	scad_data data[${NAME}_CACHE_LINES][${NAME}_LINE_WORDS];
+	cl_ulong tag[${NAME}_CACHE_LINES];
+	bool valid[${NAME}_CACHE_LINES];
+	bool dirty[${NAME}_CACHE_LINES];
+};
+
+// Write one line back to mem, skipping words beyond mem_length.
+void ${NAME}_write_line(__global scad_data * restrict mem, cl_uint mem_length,
+                        struct ${NAME}_cache *cache, cl_uint index,
+                        cl_ulong *counters) {
+	cl_ulong base = (cache->tag[index] * ${NAME}_CACHE_LINES + index) * ${NAME}_LINE_WORDS;
+	#pragma unroll
+	for(int i = 0; i < ${NAME}_LINE_WORDS; i++) {
+		if(base + i < mem_length) {
+			mem[base + i] = cache->data[index][i];
+		}
+	}
+	cache->dirty[index] = false;
+	counters[${NAME}_COUNTER_WRITEBACKS]++;
+}
+
+// Make the line holding address resident, evicting the previous one.
+// Returns the line index.
+cl_uint ${NAME}_lookup(__global scad_data * restrict mem, cl_uint mem_length,
+                       struct ${NAME}_cache *cache, cl_ulong address,
+                       cl_ulong *counters) {
+	cl_ulong line = address / ${NAME}_LINE_WORDS;
+	cl_uint index = line & (${NAME}_CACHE_LINES - 1);
+	cl_ulong tag = line / ${NAME}_CACHE_LINES;
+	
+	if(cache->valid[index] && cache->tag[index] == tag) {
+		counters[${NAME}_COUNTER_HITS]++;
+		return index;
+	}
+	
+	counters[${NAME}_COUNTER_MISSES]++;
+	if(cache->valid[index]) {
+		counters[${NAME}_COUNTER_EVICTIONS]++;
+		if(cache->dirty[index]) {
+			${NAME}_write_line(mem, mem_length, cache, index, counters);
+		}
+	}
+	
+	cl_ulong base = line * ${NAME}_LINE_WORDS;
+	#pragma unroll
+	for(int i = 0; i < ${NAME}_LINE_WORDS; i++) {
+		if(base + i < mem_length) {
+			cache->data[index][i] = mem[base + i];
+		}
+	}
+	cache->tag[index] = tag;
+	cache->valid[index] = true;
+	cache->dirty[index] = false;
+	return index;
+}
+
+__kernel void ${NAME}(__global scad_data * restrict mem,
+                      cl_uint mem_length,
+                      __global cl_ulong * restrict counter_values) {
+#ifdef EMULATOR
+	printf("[${NAME}] starting with id ${NUMBER}\n");
+#endif
+	struct scad_buffer_input input[SCAD_LSU_INPUT_NUM];
+	struct scad_buffer_management input_manage =
+		scad_input_init(${NUMBER}, SCAD_LSU_INPUT_NUM, input);
+	
+	struct scad_buffer_output output[SCAD_LSU_OUTPUT_NUM];
+	struct scad_buffer_management output_manage =
+		scad_output_init(${NUMBER}, SCAD_LSU_OUTPUT_NUM, output);
+	
+	struct ${NAME}_cache cache;
+	#pragma unroll
+	for(int i = 0; i < ${NAME}_CACHE_LINES; i++) {
+		cache.valid[i] = false;
+		cache.dirty[i] = false;
+	}
+	
+	cl_ulong counters[${NAME}_COUNTER_NUM];
+	#pragma unroll
+	for(int i = 0; i < ${NAME}_COUNTER_NUM; i++) {
+		counters[i] = 0;
+	}
+	
+	// Data copies that still need to be stored in the output buffer.
+	scad_data pending_data;
+	cl_uint pending_copies = 0;
+	
+	bool finished = false;
+	
+	while(!finished || pending_copies > 0 || !buffer_output_data_empty(&output[0])) {
+		scad_input_handle(${NUMBER}, &input_manage, input);
+		
+		if(finished) {
+			// Only output left to drain.
+		
+		} else if(buffer_input_has_marker(&input[2])) {
+#ifdef EMULATOR
+			printf("[${NAME}] Received sync marker. terminating.\n");
+#endif
+			buffer_input_pop(&input[2]);
+			finished = true;
+		
+		} else if(pending_copies == 0
+		          && buffer_input_has_data(&input[0])
+		          && buffer_input_has_data(&input[2])
+		          && (buffer_input_peek(&input[2]).op.opcode == SCAD_LSU_LOAD_ADDRESS
+		              || buffer_input_has_data(&input[1]))) {
+			scad_data address = buffer_input_pop(&input[0]); // lsu.in0
+			scad_data opc = buffer_input_pop(&input[2]); // lsu.opc
+			input_manage.counters.operations++;
+			// Loads by address have no value operand.
+			scad_data value = {.integer = 0};
+			if(opc.op.opcode != SCAD_LSU_LOAD_ADDRESS) {
+				value = buffer_input_pop(&input[1]); // lsu.in1
+			}
+			cl_uint offset = address.integer & (${NAME}_LINE_WORDS - 1);
+			
+			if(address.integer >= mem_length) {
+#ifdef EMULATOR
+				printf("[${NAME}] ERROR: invalid address: 0x%lx\n", address.integer);
+#endif
+			} else {
+				switch(opc.op.opcode) {
+					case SCAD_LSU_STORE: {
+#ifdef EMULATOR
+						printf("[${NAME}] STORE. Value 0x%lx to address 0x%lx.\n", value.integer, address.integer);
+#endif
+#if ${NAME}_WRITE_BACK
+						cl_uint index = ${NAME}_lookup(mem, mem_length, &cache, address.integer, counters);
+						cache.data[index][offset] = value;
+						cache.dirty[index] = true;
+#else
+						cl_ulong line = address.integer / ${NAME}_LINE_WORDS;
+						cl_uint index = line & (${NAME}_CACHE_LINES - 1);
+						if(cache.valid[index] && cache.tag[index] == line / ${NAME}_CACHE_LINES) {
+							cache.data[index][offset] = value;
+						}
+						mem[address.integer] = value;
+#endif
+						break;
+					}
+					
+					case SCAD_LSU_LOAD:
+					case SCAD_LSU_LOAD_ADDRESS: {
+#ifdef EMULATOR
+						printf("[${NAME}] LOAD: Address 0x%lx with 0x%x copies.\n", address.integer, opc.op.count);
+#endif
+						cl_uint index = ${NAME}_lookup(mem, mem_length, &cache, address.integer, counters);
+						pending_data = cache.data[index][offset];
+						pending_copies = opc.op.count;
+						break;
+					}
+					
+					case SCAD_LSU_INVALID:
+					default:
+#ifdef EMULATOR
+						printf("[${NAME}] ERROR: Invalid OPCODE: 0x%x\n", opc.op.opcode);
+#endif
+						break;
+				}
+			}
+		}
+		
+		// Copy pending data to output buffer if there is space available.
+		if(pending_copies > 0 && !buffer_output_data_full(&output[0])) {
+			buffer_output_push_data(&output[0], pending_data);
+			pending_copies--;
+		}
+		
+		scad_output_handle(${NUMBER}, &output_manage, output);
+	}
+	
+	// Flush for the host and the next run.
+	for(int i = 0; i < ${NAME}_CACHE_LINES; i++) {
+		if(cache.valid[i] && cache.dirty[i]) {
+			${NAME}_write_line(mem, mem_length, &cache, i, counters);
+		}
+		cache.valid[i] = false;
+	}
+	
+	#pragma unroll
+	for(int i = 0; i < ${NAME}_COUNTER_NUM; i++) {
+		counter_values[i] = counters[i];
+	}
+#ifdef EMULATOR
+	printf("[${NAME}] DONE. hits %lu, misses %lu, evictions %lu, writebacks %lu\n",
+	       counters[${NAME}_COUNTER_HITS], counters[${NAME}_COUNTER_MISSES],
+	       counters[${NAME}_COUNTER_EVICTIONS], counters[${NAME}_COUNTER_WRITEBACKS]);
+#endif
+}
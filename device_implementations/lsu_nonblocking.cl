@@ -0,0 +1,322 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+/* NON-BLOCKING LOAD-STORE UNIT
+ * INPUTS: in0 (address), in1 (value), opc (opcode, count)
+ * OUTPUT: out (non for store, results for load)
+ *
+ * PARAMETERS:
+ *   LOAD_QUEUE_DEPTH: Number of loads that may be outstanding at once,
+ *                     issued but not yet taken by the output kernel.
+ *   STORE_WINDOW:     Number of stores that may be in flight at once,
+ *                     issued but not yet acknowledged.
+ *
+ * Same interface as lsu: started from host with (mem, mem_length) and
+ * terminated by a sync marker on opc. The host starts ${NAME}_loads with
+ * the same arguments.
+ *
+ * Loads and stores run in separate kernels, ${NAME}_loads and ${NAME}.
+ * The load kernel is a pipelined loop without memory dependencies between
+ * iterations, so a new load is issued every cycle while earlier loads
+ * still wait for DDR. Results are not reordered, they pass through the
+ * load queue to the output kernel in program order. The output kernel
+ * acknowledges every load it takes, the input kernel stops issuing loads
+ * while LOAD_QUEUE_DEPTH are outstanding.
+ * The store kernel acknowledges every store once it is written. The input
+ * kernel holds back a load to an address with a store in flight until the
+ * store is acknowledged, and a store to an address with a load outstanding
+ * until the load is taken.
+ * Loads by address (lda) take no value from in1.
+ */
+
+#include "common/instructions.h"
+
+#include "channels.cl"
+#include "buffer.h"
+
+
+// LSU
+// 3 inputs: in0, in1, opc
+#define SCAD_LSU_INPUT_NUM 3
+// 1 output: out
+#define SCAD_LSU_OUTPUT_NUM 1
+
+#define ${NAME}_LOAD_QUEUE_DEPTH ${LOAD_QUEUE_DEPTH}
+#define ${NAME}_STORE_WINDOW ${STORE_WINDOW}
+
+struct ${NAME}_operation {
+	bool sync;
+	scad_data opc;
+	scad_data address;
+	scad_data value;
+};
+
+// Loaded data and number of copies, in program order.
+struct ${NAME}_load {
+	scad_data data;
+	cl_uint count;
+};
+
+channel struct ${NAME}_operation ${NAME}_channel_load_operation
+	__attribute__((depth(1)));
+channel struct ${NAME}_operation ${NAME}_channel_store_operation
+	__attribute__((depth(1)));
+channel bool ${NAME}_channel_store_retired
+	__attribute__((depth(${NAME}_STORE_WINDOW)));
+channel bool ${NAME}_channel_load_taken
+	__attribute__((depth(${NAME}_LOAD_QUEUE_DEPTH)));
+channel struct ${NAME}_load ${NAME}_channel_load_queue
+	__attribute__((depth(${NAME}_LOAD_QUEUE_DEPTH)));
+
+
+// Output kernel
+// Copies load results to the output buffer.
+__attribute__((max_global_work_dim(0)))
+__attribute__((autorun))
+__kernel void ${NAME}_external_output() {
+#ifdef EMULATOR
+	printf("[${NAME}_external_output] starting with id ${NUMBER}\n");
+#endif
+	__attribute__((register)) struct scad_buffer_output output[SCAD_LSU_OUTPUT_NUM];
+	__attribute__((register)) struct scad_buffer_management output_manage =
+		scad_output_init(${NUMBER}, SCAD_LSU_OUTPUT_NUM, output);
+	
+	// Data copies that still need to be stored in the output buffer.
+	scad_data pending_data;
+	cl_uint pending_copies = 0;
+	
+	while(true) {
+		if(pending_copies == 0) {
+			bool load_read;
+			struct ${NAME}_load load =
+				read_channel_nb_altera(${NAME}_channel_load_queue, &load_read);
+			if(load_read) {
+				#ifdef EMULATOR
+					printf("[${NAME}_external_output] load returned 0x%lx.\n", load.data.integer);
+				#endif
+				pending_data = load.data;
+				pending_copies = load.count;
+				write_channel_altera(${NAME}_channel_load_taken, true);
+			}
+		}
+		
+		// Copy pending data to output buffer if there is space available.
+		if(pending_copies > 0 && !buffer_output_data_full(&output[0])) {
+			buffer_output_push_data(&output[0], pending_data);
+			pending_copies--;
+		}
+		
+		scad_output_handle(${NUMBER}, &output_manage, output);
+	}
+}
+
+// Input kernel
+// Collects opcode, address and value and hands them to the load or store
+// kernel once no access to the same address is in flight.
+__attribute__((max_global_work_dim(0)))
+__attribute__((autorun))
+__kernel void ${NAME}_external_input() {
+#ifdef EMULATOR
+	printf("[${NAME}_external_input] starting with id ${NUMBER}\n");
+#endif
+	__attribute__((register)) struct scad_buffer_input input[SCAD_LSU_INPUT_NUM];
+	__attribute__((register)) struct scad_buffer_management input_manage =
+		scad_input_init(${NUMBER}, SCAD_LSU_INPUT_NUM, input);
+	
+	// Addresses of stores in flight, oldest at store_head.
+	scad_data stores[${NAME}_STORE_WINDOW];
+	cl_uint store_head = 0, store_count = 0;
+	
+	// Addresses of outstanding loads, oldest at load_head.
+	scad_data loads[${NAME}_LOAD_QUEUE_DEPTH];
+	cl_uint load_head = 0, load_count = 0;
+	
+	// Sync markers already sent to the load and store kernel.
+	bool load_synced = false, store_synced = false;
+	
+	while(true) {
+		scad_input_handle(${NUMBER}, &input_manage, input);
+		
+		// Stores are acknowledged and loads taken in program order.
+		bool retired;
+		read_channel_nb_altera(${NAME}_channel_store_retired, &retired);
+		if(retired) {
+			store_head = (store_head + 1) % ${NAME}_STORE_WINDOW;
+			store_count--;
+		}
+		bool taken;
+		read_channel_nb_altera(${NAME}_channel_load_taken, &taken);
+		if(taken) {
+			load_head = (load_head + 1) % ${NAME}_LOAD_QUEUE_DEPTH;
+			load_count--;
+		}
+		
+		if(buffer_input_has_marker(&input[2])) {
+			// Both kernels terminate after their last access.
+			struct ${NAME}_operation operation = {.sync = true};
+			if(!load_synced) {
+				load_synced = write_channel_nb_altera(${NAME}_channel_load_operation, operation);
+			}
+			if(!store_synced) {
+				store_synced = write_channel_nb_altera(${NAME}_channel_store_operation, operation);
+			}
+			if(load_synced && store_synced) {
+				buffer_input_pop(&input[2]);
+				load_synced = false;
+				store_synced = false;
+			}
+		
+		} else if(buffer_input_has_data(&input[2])
+		          && buffer_input_has_data(&input[0])) {
+			scad_data opc = buffer_input_peek(&input[2]);
+			scad_data address = buffer_input_peek(&input[0]);
+			bool store = (opc.op.opcode == SCAD_LSU_STORE);
+			bool needs_value = (opc.op.opcode != SCAD_LSU_LOAD_ADDRESS);
+			
+			// Accesses to the same address keep their order.
+			bool hazard = false;
+			#pragma unroll
+			for(int i = 0; i < ${NAME}_STORE_WINDOW; i++) {
+				if(((i + ${NAME}_STORE_WINDOW - store_head) % ${NAME}_STORE_WINDOW) < store_count
+				   && stores[i].integer == address.integer) {
+					hazard = true;
+				}
+			}
+			#pragma unroll
+			for(int i = 0; i < ${NAME}_LOAD_QUEUE_DEPTH; i++) {
+				if(store
+				   && ((i + ${NAME}_LOAD_QUEUE_DEPTH - load_head) % ${NAME}_LOAD_QUEUE_DEPTH) < load_count
+				   && loads[i].integer == address.integer) {
+					hazard = true;
+				}
+			}
+			
+			bool ready = (!needs_value || buffer_input_has_data(&input[1]))
+			          && (store ? store_count < ${NAME}_STORE_WINDOW && !hazard
+			                    : load_count < ${NAME}_LOAD_QUEUE_DEPTH && !hazard);
+			
+			if(ready) {
+				struct ${NAME}_operation operation = {
+					.sync = false,
+					.opc = opc,
+					.address = address,
+					.value = needs_value ? buffer_input_peek(&input[1]) : (scad_data) {.integer = 0}
+				};
+				bool sent = store ? write_channel_nb_altera(${NAME}_channel_store_operation, operation)
+				                  : write_channel_nb_altera(${NAME}_channel_load_operation, operation);
+				if(sent) {
+					#ifdef EMULATOR
+						printf("[${NAME}_external_input] relaying 0x%x on address 0x%lx\n", opc.op.opcode, address.integer);
+					#endif
+					buffer_input_pop(&input[2]);
+					buffer_input_pop(&input[0]);
+					input_manage.counters.operations++;
+					if(needs_value) {
+						buffer_input_pop(&input[1]);
+					}
+					if(store) {
+						stores[(store_head + store_count) % ${NAME}_STORE_WINDOW] = address;
+						store_count++;
+					} else {
+						loads[(load_head + load_count) % ${NAME}_LOAD_QUEUE_DEPTH] = address;
+						load_count++;
+					}
+				}
+			}
+		}
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+	}
+}
+
+// Load kernel
+// Only reads mem, so its iterations are independent. volatile keeps the
+// compiler from caching mem, the store kernel writes it.
+__kernel void ${NAME}_loads(volatile __global scad_data * restrict mem,
+                            cl_uint mem_length) {
+#ifdef EMULATOR
+	printf("[${NAME}_loads] starting with id ${NUMBER}\n");
+#endif
+	bool running = true;
+	while(running) {
+		struct ${NAME}_operation operation =
+			read_channel_altera(${NAME}_channel_load_operation);
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+		
+		if(operation.sync) {
+			running = false;
+		
+		} else {
+			// Invalid loads are acknowledged by the output kernel, too.
+			struct ${NAME}_load load = {.data = {.integer = 0}, .count = 0};
+			if(operation.address.integer >= mem_length) {
+#ifdef EMULATOR
+				printf("[${NAME}_loads] ERROR: invalid address: 0x%lx\n", operation.address.integer);
+#endif
+			} else if(operation.opc.op.opcode == SCAD_LSU_LOAD
+			          || operation.opc.op.opcode == SCAD_LSU_LOAD_ADDRESS) {
+#ifdef EMULATOR
+				printf("[${NAME}_loads] LOAD: Address 0x%lx with 0x%x copies.\n", operation.address.integer, operation.opc.op.count);
+#endif
+				load.data = mem[operation.address.integer];
+				load.count = operation.opc.op.count;
+			} else {
+#ifdef EMULATOR
+				printf("[${NAME}_loads] ERROR: Invalid OPCODE: 0x%x\n", operation.opc.op.opcode);
+#endif
+			}
+			write_channel_altera(${NAME}_channel_load_queue, load);
+		}
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+	}
+	#ifdef EMULATOR
+		printf("[${NAME}_loads] DONE. TERMINATING.\n");
+	#endif
+}
+
+// Store kernel
+// A store is acknowledged only after the fence, so a load the input kernel
+// held back for it reads the stored value.
+__kernel void ${NAME}(__global scad_data * restrict mem,
+                      cl_uint mem_length) {
+#ifdef EMULATOR
+	printf("[${NAME}] starting with id ${NUMBER}\n");
+#endif
+	bool running = true;
+	while(running) {
+		struct ${NAME}_operation operation =
+			read_channel_altera(${NAME}_channel_store_operation);
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+		
+		if(operation.sync) {
+			running = false;
+		
+		} else {
+			if(operation.address.integer >= mem_length) {
+#ifdef EMULATOR
+				printf("[${NAME}] ERROR: invalid address: 0x%lx\n", operation.address.integer);
+#endif
+			} else {
+#ifdef EMULATOR
+				printf("[${NAME}] STORE. Value 0x%lx to address 0x%lx.\n", operation.value.integer, operation.address.integer);
+#endif
+				mem[operation.address.integer] = operation.value;
+			}
+			mem_fence(CLK_GLOBAL_MEM_FENCE | CLK_CHANNEL_MEM_FENCE);
+			write_channel_altera(${NAME}_channel_store_retired, true);
+		}
+	}
+	#ifdef EMULATOR
+		printf("[${NAME}] DONE. TERMINATING.\n");
+	#endif
+}
@@ -92,13 +92,19 @@ __kernel void ${NAME}(write_only __global scad_data * restrict mem_output,
 		
 		} else if(pending_copies == 0
 		          && buffer_input_has_data(&input[0])
-		          && buffer_input_has_data(&input[1])
-		          && buffer_input_has_data(&input[2])) {
+		          && buffer_input_has_data(&input[2])
+		          && (buffer_input_peek(&input[2]).op.opcode == SCAD_LSU_LOAD_ADDRESS
+		              || buffer_input_has_data(&input[1]))) {
 			// No more pending copies and all inputs are available
 			// Execute next operation
 			scad_data address = buffer_input_pop(&input[0]); // lsu.in0
-			scad_data value = buffer_input_pop(&input[1]); // lsu.in1
 			scad_data opc = buffer_input_pop(&input[2]); // lsu.opc
+			input_manage.counters.operations++;
+			// Loads by address have no value operand.
+			scad_data value = {.integer = 0};
+			if(opc.op.opcode != SCAD_LSU_LOAD_ADDRESS) {
+				value = buffer_input_pop(&input[1]); // lsu.in1
+			}
 			
 			switch(opc.op.opcode) {
 				case SCAD_LSU_STORE:
@@ -115,6 +121,7 @@ __kernel void ${NAME}(write_only __global scad_data * restrict mem_output,
 					}
 					break;
 				case SCAD_LSU_LOAD:
+				case SCAD_LSU_LOAD_ADDRESS:
 					// Place some "invalid" value into output buffer - this is intended
 					// to enforce having an output at all.
 					pending_data = (scad_data) {.integer = -1};
@@ -15,6 +15,8 @@
 /* LOAD-STORE UNIT
  * INPUTS: in0 (address), in1 (value), opc (opcode, count)
  * OUTPUT: out (non for store, results for load)
+ *
+ * Loads by address (lda) take no value from in1.
  */
 
 #include "common/instructions.h"
@@ -66,20 +68,14 @@ __kernel void ${NAME}_external_output() {
 }
 
 // Input kernel
-// It's simpler to have output in an extra kernel
-// to remove "terminated but output pending" case.
-channel bool ${NAME}_channel_input_sync
-	__attribute__((depth(1)));
-channel scad_data ${NAME}_channel_input_address
-	__attribute__((depth(1)));
-channel scad_data ${NAME}_channel_input_value
-	__attribute__((depth(1)));
-channel scad_data ${NAME}_channel_input_opc
-	__attribute__((depth(1)));
-
-enum ${NAME}_INSTATE {
-	${NAME}_INSTATE_INVALID = 0, ${NAME}_INSTATE_OPC = 1, ${NAME}_INSTATE_ADDRESS = 2, ${NAME}_INSTATE_DATA = 3
+// Assembles operations from the input buffers and hands them to the memory
+// kernel. A store waiting for its value does not block later loads without
+// value operand (lda), unless they access the address of the store.
+struct ${NAME}_operation {
+	scad_data opc, address, value;
 };
+channel struct ${NAME}_operation ${NAME}_channel_input_operation
+	__attribute__((depth(1)));
 
 __attribute__((max_global_work_dim(0)))
 __attribute__((autorun))
@@ -92,50 +88,100 @@ __kernel void ${NAME}_external_input() {
 	__attribute__((register)) struct scad_buffer_management input_manage =
 		scad_input_init(${NUMBER}, SCAD_LSU_INPUT_NUM, input);
 	
-	enum ${NAME}_INSTATE state = ${NAME}_INSTATE_OPC;
+	// Operation currently taken from opc and in0.
+	bool opc_valid = false, address_valid = false;
+	scad_data opc, address;
+	
+	// Store that still waits for its value on in1.
+	bool store_valid = false;
+	scad_data store_opc, store_address;
 	
 	while(true) {
 		scad_input_handle(${NUMBER}, &input_manage, input);
 		
-		
-		if(state == ${NAME}_INSTATE_OPC) {
-			if(write_channel_nb_altera(${NAME}_channel_input_opc,
-				                         buffer_input_peek(&input[2]))) {
+		// Retire the waiting store as soon as its value arrives.
+		if(store_valid && buffer_input_has_data(&input[1])) {
+			struct ${NAME}_operation store = {
+				.opc = store_opc, .address = store_address,
+				.value = buffer_input_peek(&input[1])
+			};
+			if(write_channel_nb_altera(${NAME}_channel_input_operation, store)) {
 				#ifdef EMULATOR
-					printf("[${NAME}_external_input] relaying opcode %lu\n", buffer_input_peek(&input[2]).integer);
+					printf("[${NAME}_external_input] relaying store to %lu\n", store_address.integer);
 				#endif
-				buffer_input_pop(&input[2]);
-				state = ${NAME}_INSTATE_ADDRESS;
+				buffer_input_pop(&input[1]);
+				store_valid = false;
 			}
+			mem_fence(CLK_CHANNEL_MEM_FENCE);
 		}
 		
-		
-		if(state == ${NAME}_INSTATE_ADDRESS
-		   && buffer_input_has_data(&input[0])) {
-			if(write_channel_nb_altera(${NAME}_channel_input_address,
-				                         buffer_input_peek(&input[0]))) {
-				#ifdef EMULATOR
-					printf("[${NAME}_external_input] relaying address %lu\n", buffer_input_peek(&input[0]).integer);
-				#endif
-				buffer_input_pop(&input[0]);
-				state = ${NAME}_INSTATE_DATA;
+		if(!opc_valid && buffer_input_has_data(&input[2])) {
+			// This unit is autorun and keeps its memory between programs:
+			// sync markers are dropped.
+			bool marker = buffer_input_has_marker(&input[2]);
+			opc = buffer_input_pop(&input[2]);
+			opc_valid = !marker;
+			if(opc_valid) {
+				input_manage.counters.operations++;
 			}
-			mem_fence(CLK_CHANNEL_MEM_FENCE);
 		}
 		
-		if(state == ${NAME}_INSTATE_DATA
-		   && buffer_input_has_data(&input[1])) {
-			if(write_channel_nb_altera(${NAME}_channel_input_value,
-				                         buffer_input_peek(&input[1]))) {
-				#ifdef EMULATOR
-					printf("[${NAME}_external_input] relaying value %lu\n", buffer_input_peek(&input[1]).integer);
-				#endif
-				buffer_input_pop(&input[1]);
-				state = ${NAME}_INSTATE_OPC;
-			}
-			mem_fence(CLK_CHANNEL_MEM_FENCE);
+		if(opc_valid && !address_valid && buffer_input_has_data(&input[0])) {
+			address = buffer_input_pop(&input[0]);
+			address_valid = true;
 		}
 		
+		if(opc_valid && address_valid) {
+			switch(opc.op.opcode) {
+				case SCAD_LSU_LOAD_ADDRESS:
+					// No value operand, may pass a waiting store to another address.
+					if(!store_valid || store_address.integer != address.integer) {
+						struct ${NAME}_operation load = {
+							.opc = opc, .address = address, .value = {.integer = 0}
+						};
+						if(write_channel_nb_altera(${NAME}_channel_input_operation, load)) {
+							#ifdef EMULATOR
+								printf("[${NAME}_external_input] relaying load from %lu\n", address.integer);
+							#endif
+							opc_valid = false;
+							address_valid = false;
+						}
+						mem_fence(CLK_CHANNEL_MEM_FENCE);
+					}
+					break;
+				
+				case SCAD_LSU_STORE:
+					// Value is collected above, stores stay in order.
+					if(!store_valid) {
+						store_opc = opc;
+						store_address = address;
+						store_valid = true;
+						opc_valid = false;
+						address_valid = false;
+					}
+					break;
+				
+				case SCAD_LSU_LOAD:
+				default:
+					// Operations with value operand wait for all earlier stores.
+					if(!store_valid && buffer_input_has_data(&input[1])) {
+						struct ${NAME}_operation operation = {
+							.opc = opc, .address = address,
+							.value = buffer_input_peek(&input[1])
+						};
+						if(write_channel_nb_altera(${NAME}_channel_input_operation, operation)) {
+							#ifdef EMULATOR
+								printf("[${NAME}_external_input] relaying opcode %u on %lu\n", opc.op.opcode, address.integer);
+							#endif
+							buffer_input_pop(&input[1]);
+							opc_valid = false;
+							address_valid = false;
+						}
+						mem_fence(CLK_CHANNEL_MEM_FENCE);
+					}
+					break;
+			}
+		}
 	}
 }
 
@@ -147,17 +193,13 @@ __kernel void ${NAME}() {
 	printf("[${NAME}] starting with id ${NUMBER}\n");
 #endif
 	while(true) {
-		#ifdef EMULATOR
-			printf("[${NAME}] SYNC(false) received");
-		#endif
-		scad_data opc = read_channel_altera(${NAME}_channel_input_opc);
-		mem_fence(CLK_CHANNEL_MEM_FENCE);
-		scad_data address = read_channel_altera(${NAME}_channel_input_address);
-		mem_fence(CLK_CHANNEL_MEM_FENCE);
-		scad_data value = read_channel_altera(${NAME}_channel_input_value);
+		struct ${NAME}_operation operation = read_channel_altera(${NAME}_channel_input_operation);
 		mem_fence(CLK_CHANNEL_MEM_FENCE);
+		scad_data opc = operation.opc;
+		scad_data address = operation.address;
+		scad_data value = operation.value;
 		#ifdef EMULATOR
-			printf("[${NAME}] RECEIVED A TRIPLE\n");
+			printf("[${NAME}] RECEIVED AN OPERATION\n");
 		#endif
 		
 		
@@ -176,6 +218,7 @@ __kernel void ${NAME}() {
 				break;
 			
 			case SCAD_LSU_LOAD:
+			case SCAD_LSU_LOAD_ADDRESS:
 #ifdef EMULATOR
 				printf("[${NAME}] RECEIVED A LOAD: Address 0x%lx with 0x%x copies.\n", address.integer, opc.op.count);
 #endif
@@ -207,7 +250,7 @@ __kernel void ${NAME}() {
 		}
 		
 		#ifdef EMULATOR
-			printf("[${NAME}] TRIPLE HANDLED.\n");
+			printf("[${NAME}] OPERATION HANDLED.\n");
 		#endif
 	}
 	#ifdef EMULATOR
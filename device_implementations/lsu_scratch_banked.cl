@@ -0,0 +1,348 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+/* BANKED SCRATCHPAD LOAD-STORE UNIT
+ * INPUTS: in0 (address), in1 (value), opc (opcode, count)
+ * OUTPUT: out (non for store, results for load)
+ *
+ * PARAMETERS:
+ *   MEMORY_SIZE: Total number of scad_data words.
+ *   BANKS:       Number of memory banks, power of two.
+ *
+ * Addresses are interleaved over the banks:
+ *   bank = address % BANKS, row = address / BANKS
+ * Every bank is served by its own kernel instance with its own port, so
+ * operations to different banks proceed in parallel.
+ * Load results are handed to the output buffer in program order.
+ * Loads by address (lda) take no value from in1 and may pass a store
+ * that still waits for its value.
+ *
+ * COUNTERS:
+ *   ${NAME}_counters(counters) writes 3 * BANKS values:
+ *     counters[0 .. BANKS-1]:           operations dispatched to each bank
+ *     counters[BANKS .. 2*BANKS-1]:     cycles the dispatch stalled on a busy bank
+ *     counters[2*BANKS .. 3*BANKS-1]:   cycles a load targeted the bank of a store
+ *                                       sent in the same cycle
+ */
+
+#include "common/instructions.h"
+
+#include "channels.cl"
+#include "buffer.h"
+
+
+// LSU
+// 3 inputs: in0, in1, opc
+#define SCAD_LSU_INPUT_NUM 3
+// 1 output: out
+#define SCAD_LSU_OUTPUT_NUM 1
+
+#define ${NAME}_BANKS ${BANKS}
+#define ${NAME}_BANK_ROWS ((${MEMORY_SIZE} + ${NAME}_BANKS - 1) / ${NAME}_BANKS)
+
+#if (${NAME}_BANKS & (${NAME}_BANKS - 1)) != 0
+#error "BANKS of ${NAME} needs to be a power of two"
+#endif
+
+// Requests queued per bank before dispatch counts as a bank conflict.
+#define ${NAME}_BANK_QUEUE_DEPTH 2
+
+struct ${NAME}_request {
+	bool store;
+	cl_uint row;
+	scad_data value;
+};
+
+// Bank and copy count of every load, in program order.
+struct ${NAME}_load {
+	cl_uint bank;
+	cl_uint count;
+};
+
+channel struct ${NAME}_request ${NAME}_channel_bank_request[${NAME}_BANKS]
+	__attribute__((depth(${NAME}_BANK_QUEUE_DEPTH)));
+channel scad_data ${NAME}_channel_bank_result[${NAME}_BANKS]
+	__attribute__((depth(${NAME}_BANK_QUEUE_DEPTH)));
+channel struct ${NAME}_load ${NAME}_channel_load_order
+	__attribute__((depth(${NAME}_BANKS * ${NAME}_BANK_QUEUE_DEPTH)));
+
+channel bool ${NAME}_channel_counters_request
+	__attribute__((depth(1)));
+channel cl_ulong ${NAME}_channel_counters;
+
+
+// Output kernel
+// Collects load results from the banks in program order.
+__attribute__((max_global_work_dim(0)))
+__attribute__((autorun))
+__kernel void ${NAME}_external_output() {
+#ifdef EMULATOR
+	printf("[${NAME}_external_output] starting with id ${NUMBER}\n");
+#endif
+	__attribute__((register)) struct scad_buffer_output output[SCAD_LSU_OUTPUT_NUM];
+	__attribute__((register)) struct scad_buffer_management output_manage =
+		scad_output_init(${NUMBER}, SCAD_LSU_OUTPUT_NUM, output);
+	
+	// Data copies that still need to be stored in the output buffer.
+	scad_data pending_data;
+	cl_uint pending_copies = 0;
+	
+	// Load whose result has not arrived from its bank yet.
+	struct ${NAME}_load waiting;
+	bool waiting_valid = false;
+	
+	while(true) {
+		if(!waiting_valid && pending_copies == 0) {
+			waiting = read_channel_nb_altera(${NAME}_channel_load_order, &waiting_valid);
+		}
+		
+		if(waiting_valid) {
+			bool data_read = false;
+			scad_data data;
+			#pragma unroll
+			for(int i = 0; i < ${NAME}_BANKS; i++) {
+				if(waiting.bank == i) {
+					data = read_channel_nb_altera(${NAME}_channel_bank_result[i], &data_read);
+				}
+			}
+			
+			if(data_read) {
+				#ifdef EMULATOR
+					printf("[${NAME}_external_output] bank %u returned 0x%lx.\n", waiting.bank, data.integer);
+				#endif
+				pending_data = data;
+				pending_copies = waiting.count;
+				waiting_valid = false;
+			}
+		}
+		
+		// Copy pending data to output buffer if there is space available.
+		if(pending_copies > 0 && !buffer_output_data_full(&output[0])) {
+			buffer_output_push_data(&output[0], pending_data);
+			pending_copies--;
+		}
+		
+		scad_output_handle(${NUMBER}, &output_manage, output);
+	}
+}
+
+// Hands one operation to the bank selected by its address.
+// Returns false if the bank is busy, the operation then needs to be retried.
+bool ${NAME}_dispatch(cl_ulong *accesses, cl_ulong *conflicts,
+                      scad_data opc, scad_data address, scad_data value) {
+	if(address.integer >= ${MEMORY_SIZE}) {
+#ifdef EMULATOR
+		printf("[${NAME}_external_input] ERROR: invalid address: 0x%lx\n", address.integer);
+#endif
+		return true;
+	}
+	
+	cl_uint bank = address.integer & (${NAME}_BANKS - 1);
+	struct ${NAME}_request request = {
+		.store = (opc.op.opcode == SCAD_LSU_STORE),
+		.row = address.integer / ${NAME}_BANKS,
+		.value = value
+	};
+	
+	bool dispatched = false;
+	#pragma unroll
+	for(int i = 0; i < ${NAME}_BANKS; i++) {
+		if(bank == i) {
+			dispatched = write_channel_nb_altera(${NAME}_channel_bank_request[i], request);
+			if(dispatched) {
+				accesses[i]++;
+			} else {
+				conflicts[i]++;
+			}
+		}
+	}
+	mem_fence(CLK_CHANNEL_MEM_FENCE);
+	
+	if(dispatched && !request.store) {
+		write_channel_altera(${NAME}_channel_load_order,
+		                     (struct ${NAME}_load) {.bank = bank, .count = opc.op.count});
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+	}
+#ifdef EMULATOR
+	if(dispatched) {
+		printf("[${NAME}_external_input] dispatched 0x%x on address 0x%lx to bank %u\n", opc.op.opcode, address.integer, bank);
+	}
+#endif
+	return dispatched;
+}
+
+// Input kernel
+// Collects opcode, address and value and dispatches them to the bank
+// selected by the address.
+__attribute__((max_global_work_dim(0)))
+__attribute__((autorun))
+__kernel void ${NAME}_external_input() {
+#ifdef EMULATOR
+	printf("[${NAME}_external_input] starting with id ${NUMBER}\n");
+#endif
+	__attribute__((register)) struct scad_buffer_input input[SCAD_LSU_INPUT_NUM];
+	__attribute__((register)) struct scad_buffer_management input_manage =
+		scad_input_init(${NUMBER}, SCAD_LSU_INPUT_NUM, input);
+	
+	cl_ulong accesses[${NAME}_BANKS];
+	cl_ulong conflicts[${NAME}_BANKS];
+	cl_ulong same_cycle[${NAME}_BANKS];
+	#pragma unroll
+	for(int i = 0; i < ${NAME}_BANKS; i++) {
+		accesses[i] = 0;
+		conflicts[i] = 0;
+		same_cycle[i] = 0;
+	}
+	
+	// Operation currently taken from opc and in0.
+	bool opc_valid = false, address_valid = false;
+	scad_data opc, address;
+	
+	// Store that still waits for its value on in1.
+	bool store_valid = false;
+	scad_data store_opc, store_address;
+	
+	while(true) {
+		scad_input_handle(${NUMBER}, &input_manage, input);
+		
+		// A store sent in this cycle and its bank.
+		bool store_sent = false;
+		cl_ulong store_bank = 0;
+		
+		if(store_valid && buffer_input_has_data(&input[1])) {
+			store_bank = store_address.integer & (${NAME}_BANKS - 1);
+			if(${NAME}_dispatch(accesses, conflicts, store_opc, store_address,
+			                    buffer_input_peek(&input[1]))) {
+				buffer_input_pop(&input[1]);
+				store_valid = false;
+				store_sent = true;
+			}
+		}
+		
+		if(!opc_valid && buffer_input_has_data(&input[2])) {
+			// This unit is autorun and keeps its memory between programs:
+			// sync markers are dropped.
+			bool marker = buffer_input_has_marker(&input[2]);
+			opc = buffer_input_pop(&input[2]);
+			opc_valid = !marker;
+			if(opc_valid) {
+				input_manage.counters.operations++;
+			}
+		}
+		
+		if(opc_valid && !address_valid && buffer_input_has_data(&input[0])) {
+			address = buffer_input_pop(&input[0]);
+			address_valid = true;
+		}
+		
+		if(opc_valid && address_valid) {
+			if(store_sent && (opc.op.opcode == SCAD_LSU_LOAD || opc.op.opcode == SCAD_LSU_LOAD_ADDRESS)
+			   && store_bank == (address.integer & (${NAME}_BANKS - 1))) {
+				#pragma unroll
+				for(int i = 0; i < ${NAME}_BANKS; i++) {
+					if(store_bank == i) {
+						same_cycle[i]++;
+					}
+				}
+			}
+			
+			switch(opc.op.opcode) {
+				case SCAD_LSU_LOAD_ADDRESS:
+					// No value operand, may pass a waiting store to another address.
+					if((!store_valid || store_address.integer != address.integer)
+					   && ${NAME}_dispatch(accesses, conflicts, opc, address,
+					                       (scad_data) {.integer = 0})) {
+						opc_valid = false;
+						address_valid = false;
+					}
+					break;
+				
+				case SCAD_LSU_STORE:
+					// Value is collected above, stores stay in order.
+					if(!store_valid) {
+						store_opc = opc;
+						store_address = address;
+						store_valid = true;
+						opc_valid = false;
+						address_valid = false;
+					}
+					break;
+				
+				case SCAD_LSU_LOAD:
+					// Loads with value operand wait for all earlier stores.
+					if(!store_valid && buffer_input_has_data(&input[1])
+					   && ${NAME}_dispatch(accesses, conflicts, opc, address,
+					                       buffer_input_peek(&input[1]))) {
+						buffer_input_pop(&input[1]);
+						opc_valid = false;
+						address_valid = false;
+					}
+					break;
+				
+				default:
+#ifdef EMULATOR
+					printf("[${NAME}_external_input] ERROR: Invalid OPCODE: 0x%x\n", opc.op.opcode);
+#endif
+					opc_valid = false;
+					address_valid = false;
+					break;
+			}
+		}
+		
+		bool counters_requested;
+		read_channel_nb_altera(${NAME}_channel_counters_request, &counters_requested);
+		if(counters_requested) {
+			for(int i = 0; i < ${NAME}_BANKS; i++) {
+				write_channel_altera(${NAME}_channel_counters, accesses[i]);
+			}
+			for(int i = 0; i < ${NAME}_BANKS; i++) {
+				write_channel_altera(${NAME}_channel_counters, conflicts[i]);
+			}
+			for(int i = 0; i < ${NAME}_BANKS; i++) {
+				write_channel_altera(${NAME}_channel_counters, same_cycle[i]);
+			}
+		}
+	}
+}
+
+// One kernel instance per bank, each with its own memory port.
+__attribute__((max_global_work_dim(0)))
+__attribute__((autorun))
+__attribute__((num_compute_units(${NAME}_BANKS)))
+__kernel void ${NAME}_bank() {
+	int bank = get_compute_id(0);
+	scad_data mem[${NAME}_BANK_ROWS];
+#ifdef EMULATOR
+	printf("[${NAME}_bank] bank %d starting with id ${NUMBER}\n", bank);
+#endif
+	while(true) {
+		struct ${NAME}_request request = read_channel_altera(${NAME}_channel_bank_request[bank]);
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+		if(request.store) {
+			mem[request.row] = request.value;
+		} else {
+			write_channel_altera(${NAME}_channel_bank_result[bank], mem[request.row]);
+		}
+	}
+}
+
+// Run from host to read the counters.
+__kernel void ${NAME}_counters(__global cl_ulong * restrict counters) {
+	write_channel_altera(${NAME}_channel_counters_request, true);
+	mem_fence(CLK_CHANNEL_MEM_FENCE);
+	for(int i = 0; i < 3 * ${NAME}_BANKS; i++) {
+		counters[i] = read_channel_altera(${NAME}_channel_counters);
+	}
+}
+
@@ -12,33 +12,131 @@
 //   See the License for the specific language governing permissions and
 //   limitations under the License.
 
+/* MEMORY STREAM INPUT UNIT
+ * OUTPUT: out (mem_in[0] ... mem_in[mem_in_length-1])
+ *
+ * Started from host with (mem_in, mem_in_length). mem_in has to be padded
+ * to a multiple of SCAD_STREAM_BURST_WORDS words.
+ *
+ * The host kernel fetches 512 bit bursts from global memory into a
+ * two-entry channel, so one burst is drained into the output buffer while
+ * the next is fetched. The autorun drain kernel pushes the words on.
+ *
+ * ${NAME}_reset() is run from host when the program is done. The drain
+ * kernel then drops words nobody moved and the bursts still to come from
+ * this run, so the host kernel finishes and the next run starts empty.
+ */
+
 #include "common/instructions.h"
 
 #include "channels.cl"
 #include "buffer.h"
 
-// Reads data from given memory into its output buffer.
 
-__kernel void ${NAME}(__global scad_data * restrict mem_in,
-                      cl_uint mem_in_length) {
-	
+struct ${NAME}_burst {
+	scad_data data[SCAD_STREAM_BURST_WORDS];
+	// Valid words in data.
+	cl_uint length;
+	// Last burst of a run.
+	bool last;
+};
+
+// Ping-pong between fetch and drain.
+channel struct ${NAME}_burst ${NAME}_channel_burst
+	__attribute__((depth(2)));
+channel bool ${NAME}_channel_reset
+	__attribute__((depth(1)));
+
+
+// Drain kernel
+// Pushes words of fetched bursts to the output buffer.
+__attribute__((max_global_work_dim(0)))
+__attribute__((autorun))
+__kernel void ${NAME}_drain() {
 #ifdef EMULATOR
-	printf("memory stream input starting with id %d\n", ${NUMBER});
+	printf("[${NAME}_drain] starting with id ${NUMBER}\n");
 #endif
-	
-	// One output buffer.
-	struct scad_buffer_management output_manage;
 	struct scad_buffer_output output[1];
-	scad_output_init(${NUMBER}, 1, &output_manage, output);
+	struct scad_buffer_management output_manage =
+		scad_output_init(${NUMBER}, 1, output);
 	
-	cl_ulong index = 0;
+	struct ${NAME}_burst burst;
+	cl_uint index = 0;
+	burst.length = 0;
+	// The last burst of the current run was read.
+	bool last_read = true;
+	// Bursts are dropped until the last one of the run.
+	bool discard = false;
 	
-	while(index < mem_in_length) {
-		if(!buffer_output_data_full(&output[0])) {
-			buffer_output_push_data(&output[0], mem_in[index++]);
+	while(true) {
+		bool reset_read;
+		read_channel_nb_altera(${NAME}_channel_reset, &reset_read);
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+		if(reset_read) {
+#ifdef EMULATOR
+			printf("[${NAME}_drain] reset, dropping %u words.\n", burst.length - index);
+#endif
+			buffer_output_init(&output[0]);
+			output_manage.pending_valid = false;
+			index = burst.length;
+			discard = !last_read;
+		}
+		
+		if(index == burst.length) {
+			bool burst_read;
+			struct ${NAME}_burst next = read_channel_nb_altera(${NAME}_channel_burst, &burst_read);
+			if(burst_read) {
+				burst = next;
+				index = discard ? burst.length : 0;
+				last_read = burst.last;
+				discard = discard && !burst.last;
+			}
+		}
+		
+		if(index < burst.length && !buffer_output_data_full(&output[0])) {
+			scad_data word;
+			#pragma unroll
+			for(int i = 0; i < SCAD_STREAM_BURST_WORDS; i++) {
+				if(index == i) {
+					word = burst.data[i];
+				}
+			}
+			buffer_output_push_data(&output[0], word);
+			index++;
+			output_manage.counters.operations++;
 		}
 		
 		scad_output_handle(${NUMBER}, &output_manage, output);
 	}
 }
 
+// Fetch kernel
+__kernel void ${NAME}(__global scad_data * restrict mem_in,
+                      cl_uint mem_in_length) {
+#ifdef EMULATOR
+	printf("[${NAME}] starting with id ${NUMBER}\n");
+#endif
+	// At least one burst, the drain kernel needs to see the last one.
+	cl_uint base = 0;
+	bool last = false;
+	while(!last) {
+		struct ${NAME}_burst burst;
+		#pragma unroll
+		for(int i = 0; i < SCAD_STREAM_BURST_WORDS; i++) {
+			burst.data[i] = mem_in[base + i];
+		}
+		last = (base + SCAD_STREAM_BURST_WORDS >= mem_in_length);
+		burst.length = last ? mem_in_length - base : SCAD_STREAM_BURST_WORDS;
+		burst.last = last;
+		write_channel_altera(${NAME}_channel_burst, burst);
+		base += SCAD_STREAM_BURST_WORDS;
+	}
+#ifdef EMULATOR
+	printf("[${NAME}] DONE.\n");
+#endif
+}
+
+// Reset kernel
+__kernel void ${NAME}_reset() {
+	write_channel_altera(${NAME}_channel_reset, true);
+}
@@ -12,33 +12,116 @@
 //   See the License for the specific language governing permissions and
 //   limitations under the License.
 
+/* MEMORY STREAM OUTPUT UNIT
+ * INPUT: in0 (stored to mem_out[0] ... mem_out[mem_out_length-1])
+ *
+ * Started from host with (mem_out, mem_out_length, stored). mem_out has to
+ * be padded to a multiple of SCAD_STREAM_BURST_WORDS words.
+ *
+ * The autorun collect kernel gathers words from the input buffer into
+ * 512 bit bursts and hands them through a two-entry channel to the host
+ * kernel, which writes one burst to global memory while the next is
+ * collected. The run ends with the sync marker on in0, so the unit needs
+ * to be in SYNC_TO of the control unit. The last burst is handed on then,
+ * even if it is not full, and the number of words received is written to
+ * stored[0]. Words beyond mem_out_length are dropped.
+ */
+
 #include "common/instructions.h"
 
 #include "channels.cl"
 #include "buffer.h"
 
-// Stores all data it receives from the interconnect into the given memory.
 
-__kernel void ${NAME}(write_only __global scad_data * restrict mem_out,
-                      read_only cl_uint mem_out_length) {
-	
+struct ${NAME}_burst {
+	scad_data data[SCAD_STREAM_BURST_WORDS];
+	// Valid words in data.
+	cl_uint length;
+	// Last burst of a run.
+	bool last;
+};
+
+// Ping-pong between collect and store.
+channel struct ${NAME}_burst ${NAME}_channel_burst
+	__attribute__((depth(2)));
+
+
+// Collect kernel
+// Gathers words from the input buffer into bursts.
+__attribute__((max_global_work_dim(0)))
+__attribute__((autorun))
+__kernel void ${NAME}_collect() {
 #ifdef EMULATOR
-	printf("memory stream output starting with id %d\n", ${NUMBER});
+	printf("[${NAME}_collect] starting with id ${NUMBER}\n");
 #endif
-	
-	// One input buffer.
-	struct scad_buffer_management input_manage;
 	struct scad_buffer_input input[1];
-	scad_input_init(${NUMBER}, 1, &input_manage, input);
+	struct scad_buffer_management input_manage =
+		scad_input_init(${NUMBER}, 1, input);
 	
-	cl_ulong index = 0;
+	struct ${NAME}_burst burst;
+	cl_uint index = 0;
+	bool burst_full = false;
 	
-	while(index < mem_in_length) {
+	while(true) {
 		scad_input_handle(${NUMBER}, &input_manage, input);
 		
-		if(buffer_input_has_data(&input[0])) {
-			mem_out[index++] = buffer_input_pop(&input[0]);
+		if(burst_full) {
+			if(write_channel_nb_altera(${NAME}_channel_burst, burst)) {
+				index = 0;
+				burst_full = false;
+			}
+		
+		} else if(buffer_input_has_marker(&input[0])) {
+#ifdef EMULATOR
+			printf("[${NAME}_collect] Received sync marker, flushing %u words.\n", index);
+#endif
+			buffer_input_pop(&input[0]);
+			burst.length = index;
+			burst.last = true;
+			burst_full = true;
+		
+		} else if(buffer_input_has_data(&input[0])) {
+			scad_data word = buffer_input_pop(&input[0]);
+			#pragma unroll
+			for(int i = 0; i < SCAD_STREAM_BURST_WORDS; i++) {
+				if(index == i) {
+					burst.data[i] = word;
+				}
+			}
+			index++;
+			input_manage.counters.operations++;
+			burst.length = index;
+			burst.last = false;
+			burst_full = (index == SCAD_STREAM_BURST_WORDS);
 		}
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
 	}
 }
 
+// Store kernel
+__kernel void ${NAME}(__global scad_data * restrict mem_out,
+                      cl_uint mem_out_length,
+                      __global cl_uint * restrict stored) {
+#ifdef EMULATOR
+	printf("[${NAME}] starting with id ${NUMBER}\n");
+#endif
+	cl_uint base = 0;
+	bool last = false;
+	while(!last) {
+		struct ${NAME}_burst burst = read_channel_altera(${NAME}_channel_burst);
+		// Only the last burst is partial, so base stays a multiple of the
+		// burst and its words beyond mem_out_length land in the padding.
+		if(base < mem_out_length) {
+			#pragma unroll
+			for(int i = 0; i < SCAD_STREAM_BURST_WORDS; i++) {
+				mem_out[base + i] = burst.data[i];
+			}
+		}
+		base += burst.length;
+		last = burst.last;
+	}
+	stored[0] = base;
+#ifdef EMULATOR
+	printf("[${NAME}] DONE, %u words.\n", base);
+#endif
+}
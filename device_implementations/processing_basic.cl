@@ -130,6 +130,7 @@ kernel void ${NAME}() {
 			// Perform calculation.
 			pending_data = ${NAME}_eval(left_operand, right_operand, opc.op.opcode);
 			pending_copies = opc.op.count;
+			input_manage.counters.operations++;
 			
 #ifdef EMULATOR
 			printf("[processing](%d): 0x%x(0x%lx, 0x%lx) = 0x%lx (0x%x copies)\n",
@@ -43,6 +43,7 @@ kernel void ${NAME}() {
 			   && !buffer_output_data_full(&output[i])) {
 				scad_data value = buffer_input_pop(&input[i]);
 				buffer_output_push_data(&output[i], value);
+				input_manage.counters.operations++;
 #ifdef EMULATOR
 				printf("[reorder] buffer %d fired 0x%lx\n", i, value.integer);
 #endif
@@ -0,0 +1,110 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+/* TRACE UNIT
+ * Enabled by the processor attribute trace="N": every N-th move dispatched
+ * by the control unit and every N-th packet delivered by the interconnect
+ * is recorded, N = 1 traces everything.
+ *
+ * Run from host before the control unit:
+ *   scad_trace(events, capacity, count)
+ * Events are stamped with the cycle of this kernel when they are received
+ * and written to the ring buffer events[capacity]. The kernel terminates
+ * with the SCAD_TRACE_END event of the control unit and writes the total
+ * number of events, including overwritten ones, to count[0].
+ */
+
+#ifndef SCAD_TRACE_CL
+#define SCAD_TRACE_CL
+
+#include "common/instructions.h"
+#include "config.cl"
+#include "channels.cl"
+
+#if TRACE_SAMPLE > 0
+
+// Event helpers for the traced units. skip is the sample counter of the
+// caller. Writes do not block, events are dropped while the trace unit
+// is busy or not running.
+void scad_trace_move(cl_uint *skip, struct scad_buffer_address from,
+                     struct scad_buffer_address to, scad_data value) {
+	if(++(*skip) == TRACE_SAMPLE) {
+		*skip = 0;
+		write_channel_nb_altera(channel_trace_move, (struct scad_trace_event) {
+			.cycle = 0, .value = value, .from = from, .to = to, .kind = SCAD_TRACE_MOVE});
+	}
+}
+
+void scad_trace_packet(cl_uint *skip, struct scad_data_packet packet) {
+	if(++(*skip) == TRACE_SAMPLE) {
+		*skip = 0;
+		write_channel_nb_altera(channel_trace_packet, (struct scad_trace_event) {
+			.cycle = 0, .value = packet.data, .from = packet.from, .to = packet.to,
+			.kind = SCAD_TRACE_PACKET});
+	}
+}
+
+// Blocks, the trace unit needs to see the end of every program. run starts
+// it whenever the processor has one, with or without a trace file.
+void scad_trace_end() {
+	write_channel_altera(channel_trace_move, (struct scad_trace_event) {
+		.cycle = 0, .value = {.integer = 0},
+		.from = {0, 0}, .to = {0, 0}, .kind = SCAD_TRACE_END});
+}
+
+__kernel void scad_trace(__global struct scad_trace_event * restrict events,
+                         cl_uint capacity,
+                         __global cl_ulong * restrict count) {
+#ifdef EMULATOR
+	printf("[trace] starting with capacity %u\n", capacity);
+#endif
+	cl_ulong cycle = 0;
+	cl_ulong written = 0;
+	cl_uint position = 0;
+	bool done = false;
+	
+	while(!done) {
+		bool move_read, packet_read;
+		struct scad_trace_event move = read_channel_nb_altera(channel_trace_move, &move_read);
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+		struct scad_trace_event packet = read_channel_nb_altera(channel_trace_packet, &packet_read);
+		mem_fence(CLK_CHANNEL_MEM_FENCE);
+		
+		if(move_read) {
+			move.cycle = cycle;
+			events[position] = move;
+			position = (position + 1 == capacity) ? 0 : position + 1;
+			written++;
+			done = (move.kind == SCAD_TRACE_END);
+		}
+		
+		if(packet_read) {
+			packet.cycle = cycle;
+			events[position] = packet;
+			position = (position + 1 == capacity) ? 0 : position + 1;
+			written++;
+		}
+		
+		cycle++;
+	}
+	
+	count[0] = written;
+#ifdef EMULATOR
+	printf("[trace] DONE. %lu events in %lu cycles.\n", written, cycle);
+#endif
+}
+
+#endif /* TRACE_SAMPLE > 0 */
+
+#endif /* SCAD_TRACE_CL */
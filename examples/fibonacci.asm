@@ -15,8 +15,7 @@
 setup:
 	
 	$0 -> lsu@in0 // addr
-	$0 -> lsu@in1 // value, ignored
-	(ld, 1) -> lsu@opc // value, ignored
+	(lda, 1) -> lsu@opc // load by address
 	
 	// input -> 2x n
 	lsu@out -> pu0@in0
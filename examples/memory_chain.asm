@@ -1,13 +1,11 @@
 
 // load input[0]
 $0 -> lsu_input@in0 // addr
-$0 -> lsu_input@in1 // value, ignored for load
-(ld, 1) -> lsu_input@opc // store value
+(lda, 1) -> lsu_input@opc // load by address
 
 // load input[1]
 $1 -> lsu_input@in0 // addr
-$0 -> lsu_input@in1 // value, ignored for load
-(ld, 1) -> lsu_input@opc // store value
+(lda, 1) -> lsu_input@opc // load by address
 
 // input -> scratchpad[0]
 $0 -> lsu@in0 // addr
@@ -26,8 +24,7 @@ st -> lsu_output@opc // store value
 
 // load scratchpad[0]
 $0 -> lsu@in0 // addr
-$0 -> lsu@in1 // value, ignored for load
-(ld, 1) -> lsu@opc // store value
+(lda, 1) -> lsu@opc // load by address
 
 // scratchpad -> output[2]
 $3 -> lsu_output@in0 // addr
@@ -0,0 +1,21 @@
+// Copy all elements of the input memory to stream_out.
+// Number of elements
+mov $256 -> rob@in0
+
+loop:
+	// i = i - 1
+	rob@out       -> pu0@in0
+	mov $1        -> pu0@in1
+	mov (subN, 2) -> pu0@opc
+	pu0@out       -> rob@in0
+	pu0@out       -> rob@in0
+	
+	stream_in@out -> stream_out@in0
+	
+	// loop condition
+	// (i != 0) -> branch to loop
+	loop    -> cu@in1
+	rob@out -> cu@in0
+
+// cleanup
+rob@out -> null
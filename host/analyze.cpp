@@ -0,0 +1,109 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+
+#include "description.hpp"
+#include "assembly.hpp"
+#include "analysis.hpp"
+
+#include "common/instructions.h"
+
+using namespace scad;
+
+int main (int argc, char *argv[]) {
+	std::vector<std::string> args(argv+1, argv+argc);
+	
+	// Preprocessor symbols, "-D NAME=<expr>" or "-DNAME=<expr>".
+	std::vector<std::string> definitions;
+	for(auto option = args.begin(); option != args.end();) {
+		if(*option == "-D" && option + 1 != args.end()) {
+			definitions.push_back(*(option + 1));
+			option = args.erase(option, option + 2);
+		} else if(option->compare(0, 2, "-D") == 0 && option->size() > 2) {
+			definitions.push_back(option->substr(2));
+			option = args.erase(option);
+		} else {
+			option++;
+		}
+	}
+	
+	if(args.size() != 2) {
+		std::cerr << "usage: analyze [-D <name>=<value>]... <processor_description> <assembly program>" << std::endl
+		          << std::endl
+		          << "Predicts buffer occupancy and deadlocks of a program without running it." << std::endl
+		          << "Exits with 6 if the program deadlocks with the configured buffer size." << std::endl;
+		exit(1);
+	}
+	
+	try {
+		processor_description proc(args[0]);
+		
+		std::ifstream assembly_stream(args[1]);
+		std::string assembly_src((std::istreambuf_iterator<char>(assembly_stream)),
+		                         std::istreambuf_iterator<char>());
+		scad::assembly assembly(proc);
+		for(auto const& definition: definitions) {
+			assembly.define(definition);
+		}
+		assembly.parse(assembly_src);
+		std::vector<struct scad_instruction> prog = assembly.build();
+		
+		analysis_result result = analyze(proc, prog);
+		
+		printf("%-24s %8s %10s\n", "buffer", "minimal", "no stall");
+		for(auto const& buffer: result.buffers) {
+			if(buffer.second.no_stall == 0 && !buffer.second.unbounded) {
+				continue;
+			}
+			printf("%-24s %8d %10d%s\n", buffer.first.c_str(),
+			       buffer.second.minimal, buffer.second.no_stall,
+			       buffer.second.unbounded ? "  unbounded" : "");
+		}
+		std::cout << std::endl;
+		
+		for(auto const& deadlock: result.deadlocks) {
+			std::cout << "deadlock: " << deadlock << std::endl;
+		}
+		for(auto const& warning: result.warnings) {
+			std::cout << "warning: " << warning << std::endl;
+		}
+		if(!result.complete) {
+			std::cout << "warning: not all paths were analyzed, numbers are lower bounds." << std::endl;
+		}
+		
+		if(result.minimal_depth == 0) {
+			std::cout << "minimal BUFFER_DEPTH: none, the program deadlocks with any depth" << std::endl;
+		} else {
+			std::cout << "minimal BUFFER_DEPTH: " << result.minimal_depth << std::endl;
+		}
+		std::cout << "BUFFER_DEPTH without control stalls: " << result.no_stall_depth << std::endl
+		          << "configured BUFFER_DEPTH: " << proc.buffer_size << std::endl;
+		
+		if(!result.deadlocks.empty()) {
+			exit(6);
+		}
+	} catch(description_exception& e) {
+		std::cerr << e.what() << '\n'; exit(2);
+	} catch(assembly_exception& e) {
+		std::cerr << e.what() << '\n'; exit(3);
+	}
+	
+	return 0;
+}
@@ -33,22 +33,78 @@
 
 #include "description.hpp"
 #include "assembly.hpp"
+#include "preprocess.hpp"
+#include "optimize.hpp"
+#include "device_layout.hpp"
 
 using namespace scad;
 
-std::vector<struct scad_instruction> assemble(processor_description proc, std::string text) {
-	scad::assembly a(proc);
-	a.parse(text);
-	return a.build();
-}
-
 int main (int argc, char *argv[]) {
 	std::vector<std::string> args(argv+1, argv+argc);
+	
+	// Only print the preprocessed source.
+	bool expand = false;
+	auto expand_option = std::find(args.begin(), args.end(), "-E");
+	if(expand_option != args.end()) {
+		expand = true;
+		args.erase(expand_option);
+	}
+	
+	// Only print the size of the program on the device.
+	bool sizes = false;
+	auto sizes_option = std::find(args.begin(), args.end(), "-s");
+	if(sizes_option != args.end()) {
+		sizes = true;
+		args.erase(sizes_option);
+	}
+	
+	// Move scheduling and its dependency graph.
+	bool optimize = false;
+	auto optimize_option = std::find(args.begin(), args.end(), "-O");
+	if(optimize_option != args.end()) {
+		optimize = true;
+		args.erase(optimize_option);
+	}
+	std::string graph_filename = "";
+	auto graph_option = std::find(args.begin(), args.end(), "-g");
+	if(graph_option != args.end() && graph_option + 1 != args.end()) {
+		graph_filename = *(graph_option + 1);
+		args.erase(graph_option, graph_option + 2);
+	}
+	
+	// Loops whose branch condition is computed an iteration ahead.
+	std::vector<std::string> pipelined;
+	for(auto option = std::find(args.begin(), args.end(), "-P");
+	    option != args.end() && option + 1 != args.end();
+	    option = std::find(args.begin(), args.end(), "-P")) {
+		pipelined.push_back(*(option + 1));
+		args.erase(option, option + 2);
+	}
+	
+	// Preprocessor symbols, "-D NAME=<expr>" or "-DNAME=<expr>".
+	std::vector<std::string> definitions;
+	for(auto option = args.begin(); option != args.end();) {
+		if(*option == "-D" && option + 1 != args.end()) {
+			definitions.push_back(*(option + 1));
+			option = args.erase(option, option + 2);
+		} else if(option->compare(0, 2, "-D") == 0 && option->size() > 2) {
+			definitions.push_back(option->substr(2));
+			option = args.erase(option);
+		} else {
+			option++;
+		}
+	}
+	
 	if(args.size() != 2) {
-		std::cerr << "usage: assembler <platform_description> <assembly file>" << std::endl
+		std::cerr << "usage: assembler [-E] [-s] [-D <name>=<value>]... [-O] [-g <graph.dot>] [-P <loop label>]... <platform_description> <assembly file>" << std::endl
 		          << std::endl
 		          << "This tool is meant to test the assembly library." << std::endl
-		          << "Assembly is meant to be done by the 'run' tool." << std::endl;
+		          << "Assembly is meant to be done by the 'run' tool." << std::endl
+		          << "-O removes discarded copies and reorders independent moves," << std::endl
+		          << "-E prints the source after macro expansion," << std::endl
+		          << "-s prints the program size in the fixed and the packed layout," << std::endl
+		          << "-g writes the dependency graph of the moves," << std::endl
+		          << "-P computes the branch condition of a loop an iteration ahead." << std::endl;
 		exit(1);
 	}
 	
@@ -59,7 +115,87 @@ int main (int argc, char *argv[]) {
 	                     std::istreambuf_iterator<char>());
 	//std::cout << prog_str << std::endl;;
 	
-	auto prog = assemble(proc, prog_str);
+	if(expand) {
+		preprocessor source;
+		for(auto const& definition: definitions) {
+			source.define(definition);
+		}
+		source.run(prog_str, [](std::string const& line) {
+			std::cout << line << std::endl;
+		});
+		return EXIT_SUCCESS;
+	}
+	
+	scad::assembly assembly(proc);
+	for(auto const& definition: definitions) {
+		assembly.define(definition);
+	}
+	assembly.parse(prog_str);
+	auto prog = assembly.build();
+	for(auto const& it: assembly.allocation()) {
+		for(auto const& unit: proc.units) {
+			if(unit.second->number == it.second) {
+				std::cerr << it.first << " -> " << unit.first << std::endl;
+			}
+		}
+	}
+	
+	std::set<cl_ulong> labels = assembly.labels();
+	std::set<cl_ulong> references = assembly.label_references();
+	// Later loops first, pipelining moves the addresses after a loop.
+	std::sort(pipelined.begin(), pipelined.end(), [&](std::string const& a, std::string const& b) {
+		return assembly.label(a) > assembly.label(b);
+	});
+	for(auto const& label: pipelined) {
+		pipeline_result pipeline = pipeline_loop(proc, prog, labels, references, assembly.label(label));
+		if(pipeline.skipped != "") {
+			std::cerr << "pipelining " << label << " skipped: " << pipeline.skipped << std::endl;
+		} else {
+			std::cerr << "pipelining " << label << ": " << pipeline.ahead.size() << " moves run one iteration ahead, estimated cycles per iteration: "
+			                    << pipeline.cycles_before << " -> " << pipeline.cycles_after << std::endl;
+		}
+		prog = pipeline.program;
+		labels = pipeline.labels;
+		references = pipeline.references;
+	}
+	if(optimize) {
+		elimination_result dead = eliminate_dead_copies(proc, prog, labels, references);
+		if(dead.skipped != "") {
+			std::cerr << "dead copy elimination skipped: " << dead.skipped << std::endl;
+		}
+		std::cerr << "removed " << dead.removed_copies << " copies and "
+		          << dead.removed_moves << " moves" << std::endl;
+		prog = dead.program;
+		labels = dead.labels;
+	}
+	if(optimize || graph_filename != "") {
+		schedule_result schedule = schedule_moves(proc, prog, labels);
+		if(graph_filename != "") {
+			std::ofstream graph(graph_filename);
+			schedule_write_dot(graph, proc, prog, schedule);
+		}
+		if(optimize) {
+			prog = schedule.program;
+			std::cerr << "estimated cycles: " << schedule.cycles_before
+			          << " -> " << schedule.cycles_after
+			          << (schedule.reverted ? " (reverted, schedule deadlocks)" : "") << std::endl;
+		}
+	}
+	
+	if(sizes) {
+		size_t fixed = prog.size() * device_instruction_size(proc.address_width);
+		size_t packed = 0;
+		try {
+			packed = device_program(prog, proc.address_width).size();
+		} catch(layout_exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cout << "{\"instructions\": " << prog.size()
+		          << ", \"fixed_bytes\": " << fixed
+		          << ", \"packed_bytes\": " << packed << "}" << std::endl;
+		return EXIT_SUCCESS;
+	}
 	
 	for(struct scad_instruction instr: prog) {
 		switch(instr.op) {
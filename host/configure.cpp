@@ -23,6 +23,14 @@
 #include <string>
 #include <regex>
 #include <map>
+#include <set>
+#include <sstream>
+#include <limits>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <thread>
 
 extern "C" {
 #include <unistd.h>
@@ -34,42 +42,179 @@ extern "C" {
 #include "util.hpp"
 #include "common/instructions.h"
 #include "assembly.hpp"
+#include "template.hpp"
 
 #include "description.hpp"
+#include "compiled_description.hpp"
+#include "resources.hpp"
 
 using namespace scad;
 
+// https://stackoverflow.com/questions/874134/find-if-string-ends-with-another-string-in-c
+inline bool ends_with(std::string const & value, std::string const & ending) {
+    if (ending.size() > value.size()) return false;
+    return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
+}
+
 class configuration_exception : public std::runtime_error {
 	public: using runtime_error::runtime_error;
 };
 
-class configuration {
+// Machines with more units dispatch moves in two levels, on groups of
+// dispatch_group units.
+static int const dispatch_flat_limit = 32;
+static int const dispatch_group = 16;
+
+// Implementation sources, read and parsed once for all configurations by
+// the thread that asks first. Entries are read only after that.
+class implementation_cache {
+	public:
+		struct entry {
+			std::string hash;
+			std::shared_ptr<text_template const> parsed;
+			// Includes that are not implementations.
+			std::set<std::string> headers;
+		};
+		
 	private:
-		// Set by constructor
-		std::string base_dir = "";
-		std::string implementations_dir = "";
-		processor_description proc;
+		std::string implementations_dir;
+		std::mutex lock;
+		std::map<std::string, std::shared_future<std::shared_ptr<entry const>>> entries;
 		
-		void translateFile(std::string file_in, std::string file_out, std::map<std::string, std::string> parameters) {
+		std::shared_ptr<entry const> load(std::string file_in) {
 			// Check for source file readability
 			if(access(file_in.c_str(), R_OK)) {
 				throw configuration_exception("Could not open implementation file '" + file_in + "': " + std::strerror(errno));
 			}
 			
 			std::ifstream in_stream(file_in);
-			std::ofstream out_stream(base_dir +"/"+ file_out);
 			std::string content((std::istreambuf_iterator<char>(in_stream)),
 			                    std::istreambuf_iterator<char>());
-			for(auto it: parameters) {
-				std::string replace = "${" + it.first + "}";
-				std::string with = it.second;
-				
-				// https://stackoverflow.com/questions/9053687/trying-to-replace-words-in-a-string
-				while (content.find(replace) != std::string::npos)
-				       content.replace(content.find(replace), replace.length(), with);
+			auto loaded = std::make_shared<entry>();
+			loaded->hash = content_hash(content);
+			try {
+				loaded->parsed = std::make_shared<text_template const>(content);
+			} catch(template_exception& e) {
+				throw configuration_exception(file_in + ": " + e.what());
 			}
 			
+			// Includes of other implementations resolve to their generated copies
+			// next to the including file, anything else is a header of the repository.
+			static std::regex const include_pattern("#include\\s*\"([^\"]+)\"");
+			for(std::sregex_iterator it(content.begin(), content.end(), include_pattern), end; it != end; ++it) {
+				std::string included = (*it)[1];
+				if(access((implementations_dir + "/" + included).c_str(), F_OK)
+				   && !access(included.c_str(), R_OK)) {
+					loaded->headers.insert(included);
+				}
+			}
+			return loaded;
+		}
+		
+	public:
+		implementation_cache(std::string implementations_dir)
+			:implementations_dir(implementations_dir) { }
+		
+		std::string const& directory() const {
+			return implementations_dir;
+		}
+		
+		// Errors while loading are thrown to every caller of the file.
+		std::shared_ptr<entry const> get(std::string const& file_in) {
+			std::promise<std::shared_ptr<entry const>> promise;
+			std::shared_future<std::shared_ptr<entry const>> loaded;
+			bool load_here = false;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = entries.find(file_in);
+				if(it == entries.end()) {
+					loaded = promise.get_future().share();
+					entries[file_in] = loaded;
+					load_here = true;
+				} else {
+					loaded = it->second;
+				}
+			}
+			
+			if(load_here) {
+				try {
+					promise.set_value(load(file_in));
+				} catch(...) {
+					promise.set_exception(std::current_exception());
+				}
+			}
+			return loaded.get();
+		}
+};
+
+class configuration {
+	private:
+		// Set by constructor
+		std::string base_dir = "";
+		std::string implementations_dir = "";
+		processor_description proc;
+		implementation_cache &cache;
+		
+		// Content hash of every file read, for the manifest and depfile.
+		std::map<std::string, std::string> inputs;
+		// Headers outside the implementations that generated files include.
+		std::set<std::string> headers;
+		// Generated files (relative to base_dir) with content hash, source
+		// and hash of the parameters.
+		std::map<std::string, std::vector<std::string>> outputs;
+		unsigned long changed = 0;
+		
+		// Files that are no implementations, only their hash is needed.
+		void readInput(std::string file_in) {
+			std::ifstream in_stream(file_in);
+			if(!in_stream) {
+				throw configuration_exception("Could not open '" + file_in + "': " + std::strerror(errno));
+			}
+			std::string content((std::istreambuf_iterator<char>(in_stream)),
+			                    std::istreambuf_iterator<char>());
+			inputs[file_in] = content_hash(content);
+		}
+		
+		// Writes only if the content differs, so make does not rebuild what
+		// depends on unchanged files.
+		void writeIfChanged(std::string file_out, std::string const& content, std::string from, std::string parameters) {
+			std::string path = base_dir + "/" + file_out;
+			outputs[file_out] = {content_hash(content), from, content_hash(parameters)};
+			
+			std::ifstream existing_stream(path);
+			if(existing_stream) {
+				std::string existing((std::istreambuf_iterator<char>(existing_stream)),
+				                     std::istreambuf_iterator<char>());
+				if(existing == content) {
+					return;
+				}
+			}
+			
+			std::ofstream out_stream(path);
 			out_stream << content;
+			if(!out_stream) {
+				throw configuration_exception("Could not write '" + path + "': " + std::strerror(errno));
+			}
+			changed++;
+		}
+		
+		void translateFile(std::string file_in, std::string file_out, std::map<std::string, std::string> parameters) {
+			std::string parameter_list;
+			for(auto it: parameters) {
+				parameter_list += it.first + "=" + it.second + "\n";
+			}
+			
+			auto implementation = cache.get(file_in);
+			inputs[file_in] = implementation->hash;
+			headers.insert(implementation->headers.begin(), implementation->headers.end());
+			
+			std::ostringstream content;
+			try {
+				implementation->parsed->render(content, parameters);
+			} catch(template_exception& e) {
+				throw configuration_exception(file_in + ": " + e.what());
+			}
+			writeIfChanged(file_out, content.str(), file_in, parameter_list);
 		}
 		
 		void create_proc_folder(std::string proc_dir) {
@@ -82,10 +227,17 @@ class configuration {
 		}
 	
 		void writeConfig(std::string from, std::string to) {
+			int log2 = 0;
+			while((1 << log2) < proc.interconnect->size) {
+				log2++;
+			}
 			std::map<std::string, std::string> parameters = {
 				{"BUFFER_DEPTH", std::to_string(proc.buffer_size)},
 				// Number of channels taken from interconnect config for now.
 				{"UNIT_COUNT", std::to_string(proc.interconnect->size)},
+				{"UNIT_COUNT_LOG2", std::to_string(log2)},
+				{"ADDRESS_WIDTH", std::to_string(proc.address_width)},
+				{"TRACE_SAMPLE", std::to_string(proc.trace_sample)},
 			};
 			translateFile(from, to, parameters);
 		}
@@ -104,6 +256,16 @@ class configuration {
 			translateFile(from, to, parameters);
 		}
 		
+		void writeCounters(std::string from, std::string to) {
+			std::map<std::string, std::string> parameters = {};
+			translateFile(from, to, parameters);
+		}
+		
+		void writeTrace(std::string from, std::string to) {
+			std::map<std::string, std::string> parameters = {};
+			translateFile(from, to, parameters);
+		}
+		
 		void writeInterconnect(std::string from, std::string to) {
 			std::map<std::string, std::string> parameters = {
 				{"NAME", proc.interconnect->name},
@@ -114,14 +276,23 @@ class configuration {
 			std::map<std::string, std::string> parameters = {
 				{"NAME", unit->name},
 				{"NUMBER", std::to_string(unit->number)},
+				{"UNIT_COUNT", std::to_string(proc.interconnect->size)},
 			};
 			
+			// Groups of the control unit's move dispatch.
+			if(unit->type == "cu") {
+				int size = proc.interconnect->size;
+				parameters["DISPATCH_TREE"] = size > dispatch_flat_limit ? "1" : "0";
+				parameters["DISPATCH_GROUP"] = std::to_string(dispatch_group);
+				parameters["DISPATCH_LAST_GROUP"] = std::to_string((std::max(size, 1) - 1) / dispatch_group * dispatch_group);
+			}
+			
 			parameters.insert(unit->parameters.begin(), unit->parameters.end());
 			
 			translateFile(from, to, parameters);
 		}
 		void writeCombineFile(std::string to, std::vector<std::string> to_include) {
-			std::ofstream combined(base_dir +"/"+ to);
+			std::ostringstream combined;
 			combined << "// ############################################################ //" << std::endl;
 			combined << "// # COMBINED FILE FOR ONE CONFIGURATION OF THE SCAD MACHINE. # //" << std::endl;
 			combined << "// ############################################################ //" << std::endl;
@@ -132,13 +303,93 @@ class configuration {
 			}
 			combined << std::endl;
 			combined << std::endl;
+			writeIfChanged(to, combined.str(), "", "");
+		}
+		
+		// Path as make sees it, relative to the working directory.
+		std::string outputPath(std::string file_out) {
+			return base_dir == "." ? file_out : base_dir + "/" + file_out;
+		}
+		
+		// Hashes of all inputs and outputs. Written on every run, make uses
+		// it as the time configure last ran. Outputs of an earlier run that
+		// are not generated any more are removed.
+		void writeManifest(std::string manifest) {
+			std::ifstream old_stream(base_dir + "/" + manifest);
+			std::string kind, hash, path;
+			while(old_stream >> kind >> hash >> path) {
+				if(kind == "output" && !outputs.count(path)) {
+					unlink((base_dir + "/" + path).c_str());
+				}
+				old_stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			}
+			old_stream.close();
+			
+			std::ofstream out(base_dir + "/" + manifest);
+			out << "# written by host/configure: <kind> <fnv1a-64> <path> [<source> <parameters>]" << std::endl;
+			for(auto const& input: inputs) {
+				out << "input " << input.second << " " << input.first << std::endl;
+			}
+			for(auto const& output: outputs) {
+				out << "output " << output.second[0] << " " << output.first;
+				if(output.second[1] != "") {
+					out << " " << output.second[1] << " " << output.second[2];
+				}
+				out << std::endl;
+			}
+			if(!out) {
+				throw configuration_exception("Could not write manifest '" + manifest + "': " + std::strerror(errno));
+			}
+		}
+		
+		// Make rules: configure reruns when an input changes, synthesis when
+		// a generated file or an included header does. Inputs and components
+		// get empty rules so removing one does not stop make.
+		void writeDepfile(std::string depfile, std::string manifest) {
+			std::ofstream out(base_dir + "/" + depfile);
+			out << outputPath(manifest) << ":";
+			for(auto const& input: inputs) {
+				out << " " << input.first;
+			}
+			out << std::endl << std::endl;
+			
+			out << outputPath(proc.name + ".aocx") << ":";
+			for(auto const& output: outputs) {
+				if(!ends_with(output.first, ".scadc")) {
+					out << " " << outputPath(output.first);
+				}
+			}
+			for(auto const& header: headers) {
+				out << " " << header;
+			}
+			out << std::endl << std::endl;
+			
+			for(auto const& input: inputs) {
+				out << input.first << ":" << std::endl;
+			}
+			for(auto const& header: headers) {
+				out << header << ":" << std::endl;
+			}
+			for(auto const& output: outputs) {
+				if(output.first != proc.name + ".cl") {
+					out << outputPath(output.first) << ":" << std::endl;
+				}
+			}
 		}
 		
 	public:
-		configuration(processor_description proc, std::string implementations_dir)
-			:implementations_dir(implementations_dir), proc(proc) { }
+		configuration(processor_description proc, implementation_cache &cache)
+			:implementations_dir(cache.directory()), proc(proc), cache(cache) { }
 		
-		void writeProcessor(std::string out_dir) {
+		// Of the files generated by writeProcessor.
+		unsigned long changedFiles() const {
+			return changed;
+		}
+		unsigned long generatedFiles() const {
+			return outputs.size();
+		}
+		
+		void writeProcessor(std::string out_dir, std::string description_filename) {
 			if(out_dir == "") {
 				throw configuration_exception("writeProcessor cannot handle empty output directory.");
 			}
@@ -149,6 +400,7 @@ class configuration {
 			
 			std::string proc_dir = proc.name + "_components";
 			create_proc_folder(proc_dir);
+			readInput(description_filename);
 			
 			writeConfig(implementations_dir + "/config.cl", proc_dir + "/config.cl");
 			to_include.push_back(proc_dir + "/config.cl");
@@ -161,6 +413,12 @@ class configuration {
 			writeBuffersH(implementations_dir + "/buffer.h", proc_dir + "/buffer.h");
 			to_include.push_back(proc_dir + "/buffer.h");
 			
+			writeCounters(implementations_dir + "/counters.cl", proc_dir + "/counters.cl");
+			to_include.push_back(proc_dir + "/counters.cl");
+			
+			writeTrace(implementations_dir + "/trace.cl", proc_dir + "/trace.cl");
+			to_include.push_back(proc_dir + "/trace.cl");
+			
 			writeInterconnect(implementations_dir + "/" + proc.interconnect->implementation + ".cl", proc_dir + "/" + proc.interconnect->implementation + ".cl");
 			to_include.push_back(proc_dir + "/" + proc.interconnect->implementation + ".cl");
 			
@@ -172,60 +430,185 @@ class configuration {
 			
 			writeCombineFile(proc.name + ".cl", to_include);
 			
+			// Binary form of the description for the host tools.
+			std::string compiled = compiled_description::path(description_filename);
+			try {
+				writeIfChanged(compiled.substr(compiled.find_last_of("/") + 1),
+				               compiled_description::serialize(proc), "", "");
+			} catch(description_exception& e) {
+				throw configuration_exception(e.what());
+			}
+			
+			writeManifest(proc_dir + "/manifest");
+			writeDepfile(proc.name + ".d", proc_dir + "/manifest");
 		}
 };
 
-// https://stackoverflow.com/questions/874134/find-if-string-ends-with-another-string-in-c
-inline bool ends_with(std::string const & value, std::string const & ending) {
-    if (ending.size() > value.size()) return false;
-    return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
-}
+// One processor description given on the command line.
+struct configure_job {
+	std::string description_filename;
+	std::string output_dir;
+	std::shared_ptr<processor_description> proc;
+	unsigned long changed = 0;
+	unsigned long generated = 0;
+	bool estimated = false;
+	resource_usage usage;
+	// Exit code and message of the first error.
+	int status = 0;
+	std::string error;
+};
 
 int main (int argc, char *argv[]) {
 	std::vector<std::string> args(argv+1, argv+argc);
 	
-	std::string description_filename = ""; // Will be set by first param
-	std::string implementations_dir = "device_implementations"; // Default value - may be overridden
+	// Descriptions configured at the same time, one per hardware thread by default.
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	auto threads_option = std::find(args.begin(), args.end(), "-j");
+	if(threads_option != args.end() && threads_option + 1 != args.end()) {
+		threads = std::max(1, std::atoi((threads_option + 1)->c_str()));
+		args.erase(threads_option, threads_option + 2);
+	}
 	
-	switch(args.size())  {
-		case 2:
-			implementations_dir = args[1];
-		case 1:
-			description_filename = args[0];
-			break;
-		default:
-		std::cout << "usage: configure <platform_description> [<implementations location>]" << std::endl;
+	// Descriptions that do not fit this board are not configured.
+	std::string board_name = "";
+	auto board_option = std::find(args.begin(), args.end(), "-b");
+	if(board_option != args.end() && board_option + 1 != args.end()) {
+		board_name = *(board_option + 1);
+		args.erase(board_option, board_option + 2);
+	}
+	
+	std::string implementations_dir = "device_implementations"; // Default value - may be overridden
+	if(args.size() >= 2 && !ends_with(args.back(), ".xml")) {
+		implementations_dir = args.back();
+		args.pop_back();
+	}
+	if(args.empty()) {
+		std::cout << "usage: configure [-j <threads>] [-b <board>] <platform_description>... [<implementations location>]" << std::endl;
 		exit(1);
 	}
 	
-	// Minimal sanitizing on filename
-	if(!ends_with(description_filename, ".xml")) {
-		std::cout << "Platform description should end in \".xml\"." << std::endl;
-		exit(2);
+	std::vector<configure_job> jobs(args.size());
+	for(size_t i = 0; i < args.size(); i++) {
+		jobs[i].description_filename = args[i];
+		
+		// Minimal sanitizing on filename
+		if(!ends_with(args[i], ".xml")) {
+			jobs[i].status = 2;
+			jobs[i].error = "Platform description should end in \".xml\": " + args[i];
+			continue;
+		}
+		
+		// If the description filename contains a "/" then use the folder for output
+		// otherwise current working directory
+		std::string output_dir = args[i];
+		if(output_dir.find_last_of("/") == std::string::npos) {
+			output_dir = ".";
+		} else {
+			output_dir.erase(output_dir.find_last_of("/"), std::string::npos);
+		}
+		jobs[i].output_dir = output_dir;
 	}
 	
-	// If the description filename contains a "/" then use the folder for output
-	// otherwise current working directory
-	std::string output_dir = description_filename;
-	if(output_dir.find_last_of("/") == std::string::npos) {
-		output_dir = ".";
-	} else {
-		output_dir.erase(output_dir.find_last_of("/"), std::string::npos);
+	parallel_for(jobs.size(), threads, [&](size_t i) {
+		if(jobs[i].status == 0) {
+			try {
+				jobs[i].proc = std::make_shared<processor_description>(jobs[i].description_filename);
+			} catch(description_exception& e) {
+				jobs[i].status = 2;
+				jobs[i].error = e.what();
+			}
+		}
+	});
+	
+	// Two descriptions of the same processor would write the same files.
+	std::map<std::string, size_t> written_by;
+	for(size_t i = 0; i < jobs.size(); i++) {
+		if(jobs[i].status == 0) {
+			std::string combined = jobs[i].output_dir + "/" + jobs[i].proc->name + ".cl";
+			if(written_by.count(combined)) {
+				jobs[i].status = 3;
+				jobs[i].error = "'" + jobs[i].description_filename + "' and '"
+				                + jobs[written_by[combined]].description_filename
+				                + "' both configure '" + combined + "'";
+			} else {
+				written_by[combined] = i;
+			}
+		}
 	}
 	
+	// Without a cost table there is no estimate, unless a board needs one.
+	std::shared_ptr<resource_model> model;
 	try {
-		processor_description proc(description_filename);
-		
-		try {
-			configuration conf(proc, implementations_dir);
-			conf.writeProcessor(output_dir);
-		} catch(configuration_exception& e) {
+		model = std::make_shared<resource_model>(implementations_dir + "/resources.txt");
+		if(board_name != "") {
+			model->board(board_name);
+		}
+	} catch(resource_exception& e) {
+		if(board_name != "") {
 			std::cerr << e.what() << '\n'; exit(3);
 		}
-	} catch(description_exception& e) {
-		std::cerr << e.what() << '\n'; exit(2);
+		model = nullptr;
+	}
+	for(auto &job: jobs) {
+		if(job.status == 0 && model) {
+			try {
+				job.usage = model->estimate(*job.proc);
+				job.estimated = true;
+			} catch(resource_exception& e) {
+				job.status = 3;
+				job.error = job.description_filename + ": " + e.what();
+				continue;
+			}
+			if(board_name != "") {
+				std::string problems;
+				for(auto const& problem: model->check(job.usage, model->board(board_name))) {
+					problems += (problems == "" ? "" : ", ") + problem;
+				}
+				if(problems != "") {
+					job.status = 3;
+					job.error = job.description_filename + ": does not fit " + board_name + ": " + problems;
+				}
+			}
+		}
 	}
 	
+	implementation_cache cache(implementations_dir);
+	parallel_for(jobs.size(), threads, [&](size_t i) {
+		if(jobs[i].status == 0) {
+			try {
+				configuration conf(*jobs[i].proc, cache);
+				conf.writeProcessor(jobs[i].output_dir, jobs[i].description_filename);
+				jobs[i].changed = conf.changedFiles();
+				jobs[i].generated = conf.generatedFiles();
+			} catch(configuration_exception& e) {
+				jobs[i].status = 3;
+				jobs[i].error = e.what();
+			}
+		}
+	});
+	
+	// Reported in the order of the arguments, whichever finished first.
+	int status = 0;
+	for(auto const& job: jobs) {
+		if(job.status != 0) {
+			std::cerr << job.error << '\n';
+			status = status ? status : job.status;
+		} else {
+			for(auto const& warning: job.proc->warnings) {
+				std::cerr << "configure: " << job.description_filename << ": warning: " << warning << std::endl;
+			}
+			if(job.estimated) {
+				for(auto const& unknown: job.usage.unknown) {
+					std::cerr << "configure: " << job.description_filename << ": warning: no resource costs for "
+					          << unknown << std::endl;
+				}
+				std::cout << "configure: " << job.description_filename << ": estimate "
+				          << format_usage(job.usage) << std::endl;
+			}
+			std::cout << "configure: " << job.description_filename << ": " << job.changed
+			          << " of " << job.generated << " files changed" << std::endl;
+		}
+	}
 	
-	return 0;
+	return status;
 }
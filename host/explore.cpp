@@ -0,0 +1,385 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <memory>
+
+extern "C" {
+#include <sys/stat.h>
+#include <sys/types.h>
+}
+
+#include "util.hpp"
+#include "description.hpp"
+#include "assembly.hpp"
+#include "simulator.hpp"
+#include "memory_file.hpp"
+#include "template.hpp"
+#include "resources.hpp"
+
+#include "common/instructions.h"
+
+using namespace scad;
+
+class explore_exception : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+#define EXPLORE_STRING(x) #x
+#define EXPLORE_EXPAND(x) EXPLORE_STRING(x)
+
+// Cost table of the source tree the tool was built in (host/ next to
+// device_implementations/), otherwise the installed one.
+static std::string default_resources(std::string const& tool) {
+	if(tool.find("/") != std::string::npos) {
+		std::string built = tool.substr(0, tool.find_last_of("/") + 1) + "../device_implementations/resources.txt";
+		if(std::ifstream(built).good()) {
+			return built;
+		}
+	}
+#ifdef PREFIX
+	return EXPLORE_EXPAND(PREFIX) "/device_implementations/resources.txt";
+#else
+	return "device_implementations/resources.txt";
+#endif
+}
+
+// Values of one explored parameter: "4,8,16", "1..4" (inclusive) or both.
+static std::vector<std::string> parameter_values(std::string const& list) {
+	std::vector<std::string> values;
+	std::istringstream items(list);
+	std::string item;
+	while(std::getline(items, item, ',')) {
+		size_t range = item.find("..");
+		if(range == std::string::npos) {
+			values.push_back(item);
+			continue;
+		}
+		try {
+			long from = std::stol(item.substr(0, range)), to = std::stol(item.substr(range + 2));
+			for(long value = from; value <= to; value++) {
+				values.push_back(std::to_string(value));
+			}
+		} catch(std::exception &e) {
+			throw explore_exception("Invalid range: " + item);
+		}
+	}
+	if(values.empty()) {
+		throw explore_exception("No values in: " + list);
+	}
+	return values;
+}
+
+// One processor generated from the template.
+struct variant {
+	std::map<std::string, std::string> parameters;
+	std::string name;
+	std::string filename;
+	
+	bool simulated = false;
+	std::string error;
+	simulator_statistics stats;
+	resource_usage usage;
+	bool fits = true;
+	std::string problems;
+	bool pareto = false;
+};
+
+int main (int argc, char *argv[]) {
+	std::vector<std::string> args(argv+1, argv+argc);
+	
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	auto threads_option = std::find(args.begin(), args.end(), "-j");
+	if(threads_option != args.end() && threads_option + 1 != args.end()) {
+		threads = std::max(1, std::atoi((threads_option + 1)->c_str()));
+		args.erase(threads_option, threads_option + 2);
+	}
+	
+	// Generate the device sources of every variant.
+	bool configure = false;
+	auto configure_option = std::find(args.begin(), args.end(), "-c");
+	if(configure_option != args.end()) {
+		configure = true;
+		args.erase(configure_option);
+	}
+	
+	std::string output_dir = "";
+	auto output_option = std::find(args.begin(), args.end(), "-o");
+	if(output_option != args.end() && output_option + 1 != args.end()) {
+		output_dir = *(output_option + 1);
+		args.erase(output_option, output_option + 2);
+	}
+	
+	std::string resources_filename = default_resources(argv[0]);
+	auto resources_option = std::find(args.begin(), args.end(), "-r");
+	if(resources_option != args.end() && resources_option + 1 != args.end()) {
+		resources_filename = *(resources_option + 1);
+		args.erase(resources_option, resources_option + 2);
+	}
+	
+	// Variants that do not fit this board are not on the Pareto front.
+	std::string board_name = "";
+	auto board_option = std::find(args.begin(), args.end(), "-b");
+	if(board_option != args.end() && board_option + 1 != args.end()) {
+		board_name = *(board_option + 1);
+		args.erase(board_option, board_option + 2);
+	}
+	
+	// Explored parameters in the order given, "-p NAME=<values>".
+	std::vector<std::pair<std::string, std::vector<std::string>>> explored;
+	// Preprocessor symbols, "-D NAME=<expr>" or "-DNAME=<expr>".
+	std::vector<std::string> definitions;
+	try {
+		for(auto option = args.begin(); option != args.end();) {
+			if(*option == "-p" && option + 1 != args.end()) {
+				std::string parameter = *(option + 1);
+				size_t equals = parameter.find('=');
+				if(equals == std::string::npos || equals == 0) {
+					throw explore_exception("Parameter needs NAME=<values>: " + parameter);
+				}
+				explored.push_back({parameter.substr(0, equals), parameter_values(parameter.substr(equals + 1))});
+				option = args.erase(option, option + 2);
+			} else if(*option == "-D" && option + 1 != args.end()) {
+				definitions.push_back(*(option + 1));
+				option = args.erase(option, option + 2);
+			} else if(option->compare(0, 2, "-D") == 0 && option->size() > 2) {
+				definitions.push_back(option->substr(2));
+				option = args.erase(option);
+			} else {
+				option++;
+			}
+		}
+	} catch(explore_exception& e) {
+		std::cerr << e.what() << '\n'; exit(1);
+	}
+	
+	std::string template_filename = "", assembly_filename = "", memory_filename = "";
+	switch(args.size()) {
+		case 3:
+			memory_filename = args[2];
+			// fall through
+		case 2:
+			template_filename = args[0];
+			assembly_filename = args[1];
+			break;
+		default:
+			std::cerr << "usage: explore [-j <threads>] [-c] [-o <output dir>] [-r <cost table>] [-b <board>]" << std::endl
+			          << "               [-D <name>=<value>]... [-p <NAME>=<values>]..." << std::endl
+			          << "               <description template> <assembly program> [<memory file>]" << std::endl
+			          << std::endl
+			          << "Writes a processor description for every combination of the values" << std::endl
+			          << "(\"4,8,16\" or \"1..4\") of the parameters, simulates the program on each" << std::endl
+			          << "and marks the ones no other is faster and smaller (in estimated ALMs) than." << std::endl
+			          << "The template sees the parameters and ${VARIANT}, a name unique per" << std::endl
+			          << "description, the program sees the numeric parameters as symbols." << std::endl
+			          << "-b leaves variants that do not fit the board off the front," << std::endl
+			          << "-c configures the descriptions for synthesis." << std::endl;
+			exit(1);
+	}
+	
+	// Not next to the template by default, the Makefile synthesizes every
+	// description in device/.
+	std::string base = template_filename.substr(template_filename.find_last_of("/") + 1);
+	base = base.substr(0, base.find_last_of("."));
+	if(output_dir == "") {
+		output_dir = "explore_" + base;
+	}
+	if(mkdir(output_dir.c_str(), S_IRWXU | S_IXGRP | S_IRGRP | S_IXOTH | S_IROTH) && errno != EEXIST) {
+		std::cerr << "Could not create '" << output_dir << "': " << std::strerror(errno) << '\n'; exit(1);
+	}
+	
+	std::vector<variant> variants(1);
+	for(auto const& parameter: explored) {
+		std::vector<variant> extended;
+		for(auto const& partial: variants) {
+			for(auto const& value: parameter.second) {
+				variant next = partial;
+				next.parameters[parameter.first] = value;
+				next.name += (next.name == "" ? "" : "_") + value;
+				extended.push_back(next);
+			}
+		}
+		variants = extended;
+	}
+	
+	std::vector<scad_data> input;
+	std::string assembly_src;
+	std::shared_ptr<resource_model> model;
+	board_preset const *board = nullptr;
+	try {
+		model = std::make_shared<resource_model>(resources_filename);
+		if(board_name != "") {
+			board = &model->board(board_name);
+		}
+		
+		std::ifstream template_stream(template_filename);
+		if(!template_stream) {
+			std::cerr << "Could not open template '" << template_filename << "'" << '\n'; exit(2);
+		}
+		std::string template_src((std::istreambuf_iterator<char>(template_stream)),
+		                         std::istreambuf_iterator<char>());
+		text_template description_template(template_src);
+		for(auto &v: variants) {
+			v.name = base + (v.name == "" ? "" : "_" + v.name);
+			v.filename = output_dir + "/" + v.name + ".xml";
+			std::map<std::string, std::string> parameters = v.parameters;
+			parameters["VARIANT"] = v.name;
+			std::ofstream out(v.filename);
+			description_template.render(out, parameters);
+			if(!out) {
+				std::cerr << "Could not write '" << v.filename << "'" << '\n'; exit(2);
+			}
+		}
+		
+		std::ifstream assembly_stream(assembly_filename);
+		assembly_src = std::string((std::istreambuf_iterator<char>(assembly_stream)),
+		                           std::istreambuf_iterator<char>());
+		if(memory_filename != "") {
+			input = memory_file_read(memory_filename);
+		}
+	} catch(template_exception& e) {
+		std::cerr << template_filename << ": " << e.what() << '\n'; exit(2);
+	} catch(memory_file_exception& e) {
+		std::cerr << e.what() << '\n'; exit(4);
+	} catch(resource_exception& e) {
+		std::cerr << e.what() << '\n'; exit(2);
+	}
+	
+	parallel_for(variants.size(), threads, [&](size_t i) {
+		variant &v = variants[i];
+		try {
+			processor_description proc(v.filename);
+			v.usage = model->estimate(proc);
+			if(board) {
+				for(auto const& problem: model->check(v.usage, *board)) {
+					v.problems += (v.problems == "" ? "" : ", ") + problem;
+				}
+				v.fits = v.problems == "";
+			}
+			
+			scad::assembly assembly(proc);
+			for(auto const& parameter: v.parameters) {
+				// Numbers only, not names like an implementation.
+				if(parameter.second != "" && parameter.second.find_first_not_of("0123456789") == std::string::npos) {
+					assembly.define(parameter.first + "=" + parameter.second);
+				}
+			}
+			for(auto const& definition: definitions) {
+				assembly.define(definition);
+			}
+			assembly.parse(assembly_src);
+			std::vector<struct scad_instruction> prog = assembly.build();
+			
+			simulator sim(proc, std::max<size_t>(256, input.size()));
+			if(proc.units.count("lsu")) {
+				std::copy(input.begin(), input.end(), sim.memory("lsu").begin());
+			}
+			v.stats = sim.run(prog);
+			v.simulated = true;
+		} catch(std::runtime_error& e) {
+			v.error = e.what();
+		}
+	});
+	
+	// Pareto front of cycles against estimated ALMs, of the variants that fit.
+	for(auto &v: variants) {
+		v.pareto = v.simulated && v.fits;
+		for(auto const& other: variants) {
+			if(v.pareto && other.simulated && other.fits
+			   && other.stats.cycles <= v.stats.cycles && other.usage.alms <= v.usage.alms
+			   && (other.stats.cycles < v.stats.cycles || other.usage.alms < v.usage.alms)) {
+				v.pareto = false;
+			}
+		}
+	}
+	
+	size_t name_width = 7;
+	for(auto const& v: variants) {
+		name_width = std::max(name_width, v.name.size());
+	}
+	std::cout << std::left << std::setw(name_width) << "variant" << std::right
+	          << std::setw(12) << "cycles" << std::setw(12) << "moves" << std::setw(12) << "moves/cycle"
+	          << std::setw(10) << "ALMs" << std::setw(8) << "M20Ks" << std::setw(6) << "DSPs" << std::setw(6) << "MHz"
+	          << "  pareto" << std::endl;
+	for(auto const& v: variants) {
+		std::cout << std::left << std::setw(name_width) << v.name << std::right;
+		if(!v.simulated) {
+			std::cout << "  " << v.error << std::endl;
+			continue;
+		}
+		std::cout << std::setw(12) << v.stats.cycles << std::setw(12) << v.stats.moves
+		          << std::setw(12) << std::fixed << std::setprecision(3)
+		          << (v.stats.cycles ? (double) v.stats.moves / v.stats.cycles : 0.0)
+		          << std::setprecision(0) << std::setw(10) << v.usage.alms << std::setw(8) << v.usage.m20ks
+		          << std::setw(6) << v.usage.dsps << std::setw(6) << v.usage.fmax
+		          << (v.pareto ? "  *" : "") << (v.fits ? "" : "  does not fit: " + v.problems) << std::endl;
+	}
+	
+	// Same numbers as a single JSON line for scripts.
+	std::cout << "[";
+	for(size_t i = 0; i < variants.size(); i++) {
+		variant const& v = variants[i];
+		std::cout << (i ? ", " : "") << "{\"description\": \"" << v.filename << "\", \"parameters\": {";
+		bool first = true;
+		for(auto const& parameter: v.parameters) {
+			std::cout << (first ? "" : ", ") << "\"" << parameter.first << "\": \"" << parameter.second << "\"";
+			first = false;
+		}
+		std::cout << "}";
+		if(v.simulated) {
+			std::cout << ", \"cycles\": " << v.stats.cycles << ", \"moves\": " << v.stats.moves
+			          << ", \"alms\": " << v.usage.alms << ", \"registers\": " << v.usage.registers
+			          << ", \"m20ks\": " << v.usage.m20ks << ", \"dsps\": " << v.usage.dsps
+			          << ", \"fmax\": " << v.usage.fmax << ", \"fits\": " << (v.fits ? "true" : "false")
+			          << ", \"pareto\": " << (v.pareto ? "true" : "false");
+		}
+		std::cout << "}";
+	}
+	std::cout << "]" << std::endl;
+	
+	bool any_simulated = false;
+	for(auto const& v: variants) {
+		any_simulated = any_simulated || (v.simulated && v.fits);
+		for(auto const& unknown: v.usage.unknown) {
+			std::cerr << v.name << ": warning: no resource costs for " << unknown << std::endl;
+		}
+	}
+	if(configure && any_simulated) {
+		// configure from the same directory as explore, all variants in one run.
+		std::string tool = argv[0];
+		tool = tool.find("/") == std::string::npos ? "configure" : tool.substr(0, tool.find_last_of("/") + 1) + "configure";
+		std::string command = "'" + tool + "' -j " + std::to_string(threads);
+		for(auto const& v: variants) {
+			if(v.simulated && v.fits) {
+				command += " '" + v.filename + "'";
+			}
+		}
+		if(std::system(command.c_str()) != 0) {
+			exit(3);
+		}
+	}
+	
+	return 0;
+}
@@ -21,6 +21,9 @@
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <map>
+#include <iomanip>
+#include <algorithm>
 
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
@@ -30,6 +33,11 @@
 #include "util.hpp"
 #include "machine.hpp"
 #include "assembly.hpp"
+#include "description.hpp"
+#include "trace.hpp"
+#include "memory_file.hpp"
+#include "optimize.hpp"
+#include "device_layout.hpp"
 
 #include "common/instructions.h"
 
@@ -49,6 +57,128 @@ void print_scad_vector(std::vector<scad_data, AlignedAllocator<scad_data>> data)
 		std::cout << "]";
 }
 
+// Print access and conflict counters of all banked scratchpads.
+void print_bank_counters(scad::machine &machine, processor_description &proc) {
+	for(auto const& unit_entry: proc.units) {
+		auto unit = unit_entry.second;
+		if(unit->implementation != "lsu_scratch_banked"
+		   || !machine.has_component(unit->name + "_counters")) {
+			continue;
+		}
+		
+		int banks = std::stoi(unit->parameters.at("BANKS"));
+		std::vector<cl_ulong, AlignedAllocator<cl_ulong>> counters(3 * banks, 0);
+		auto counters_buff = machine.buffer_for(CL_MEM_WRITE_ONLY, counters);
+		auto counters_kernel = machine.get_component(unit->name + "_counters");
+		counters_kernel->start(counters_buff);
+		counters_kernel->wait();
+		counters_kernel->read_buffer(counters_buff, counters);
+		
+		std::cout << std::dec << unit->name << " bank counters:" << std::endl;
+		for(int bank = 0; bank < banks; bank++) {
+			std::cout << "  bank " << bank
+			          << ": accesses " << counters[bank]
+			          << ", conflicts " << counters[banks + bank]
+			          << ", same cycle " << counters[2 * banks + bank] << std::endl;
+		}
+	}
+}
+
+// Print hit, miss, eviction and writeback counters of a cached LSU.
+void print_cache_counters(std::string const& name, std::vector<cl_ulong, AlignedAllocator<cl_ulong>> const& counters) {
+	std::cout << std::dec << name << " cache counters:"
+	          << " hits " << counters[0]
+	          << ", misses " << counters[1]
+	          << ", evictions " << counters[2]
+	          << ", writebacks " << counters[3] << std::endl;
+}
+
+// Print a table of the performance counters of all units.
+void print_unit_counters(scad::machine &machine, processor_description &proc) {
+	auto counters = machine.counters(proc.interconnect->size);
+	if(counters.empty()) {
+		return;
+	}
+	
+	std::map<int, std::string> unit_names;
+	for(auto const& unit_entry: proc.units) {
+		unit_names[unit_entry.second->number] = unit_entry.second->name;
+	}
+	
+	auto print_row = [](std::string name, std::string side, scad_unit_counters const& c) {
+		std::cout << std::setw(16) << name << std::setw(8) << side;
+		if(c.valid) {
+			std::cout << std::setw(12) << c.cycles
+			          << std::setw(12) << c.operations
+			          << std::setw(12) << c.stall_input
+			          << std::setw(12) << c.stall_output
+			          << std::setw(12) << c.packets_sent
+			          << std::setw(12) << c.packets_received;
+		} else {
+			std::cout << std::setw(12) << "-";
+		}
+		std::cout << std::endl;
+	};
+	
+	std::cout << std::dec << std::setw(16) << "unit" << std::setw(8) << "side"
+	          << std::setw(12) << "cycles" << std::setw(12) << "ops"
+	          << std::setw(12) << "stall in" << std::setw(12) << "stall out"
+	          << std::setw(12) << "sent" << std::setw(12) << "received" << std::endl;
+	for(auto const& unit_name: unit_names) {
+		print_row(unit_name.second, "input", counters.at(2 * unit_name.first));
+		print_row(unit_name.second, "output", counters.at(2 * unit_name.first + 1));
+	}
+	print_row(proc.interconnect->name, "", counters.back());
+}
+
+// Wall-clock time of consecutive phases of a run.
+class phase_timer {
+	private:
+		typedef std::chrono::steady_clock clock;
+		clock::time_point start = clock::now(), last = start;
+	
+	public:
+		std::vector<std::pair<std::string, double>> phases;
+		
+		// End the current phase, the next one starts now.
+		void end_phase(std::string name) {
+			auto now = clock::now();
+			phases.push_back({name, std::chrono::duration<double>(now - last).count()});
+			last = now;
+		}
+		
+		double total() {
+			return std::chrono::duration<double>(last - start).count();
+		}
+};
+
+// Print phase wall-clock times and kernel runtimes, followed by the same
+// numbers as a single JSON line for scripts.
+void print_timings(phase_timer &timer,
+                   std::vector<std::pair<std::string, double>> const& kernels) {
+	std::cout << std::dec << std::fixed << std::setprecision(3) << "timing:" << std::endl;
+	for(auto const& phase: timer.phases) {
+		std::cout << std::setw(16) << phase.first << std::setw(12) << phase.second * 1e3 << " ms" << std::endl;
+	}
+	std::cout << std::setw(16) << "total" << std::setw(12) << timer.total() * 1e3 << " ms" << std::endl;
+	for(auto const& kernel: kernels) {
+		std::cout << std::setw(16) << ("kernel " + kernel.first) << std::setw(12) << kernel.second * 1e3 << " ms" << std::endl;
+	}
+	
+	std::cout << std::setprecision(9) << "{\"phases\": {";
+	for(auto const& phase: timer.phases) {
+		std::cout << "\"" << phase.first << "\": " << phase.second << ", ";
+	}
+	std::cout << "\"total\": " << timer.total() << "}, \"kernels\": {";
+	bool first = true;
+	for(auto const& kernel: kernels) {
+		std::cout << (first ? "" : ", ") << "\"" << kernel.first << "\": " << kernel.second;
+		first = false;
+	}
+	std::cout << "}}" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+}
+
 
 int main (int argc, char *argv[]) {
 	// Have openCL kernels not buffer debug messages.
@@ -56,21 +186,67 @@ int main (int argc, char *argv[]) {
 	
 	std::vector<std::string> args(argv+1, argv+argc);
 	
+	// Input memory file, replaces the zeroed default memory.
+	std::string memory_filename = "";
+	auto memory_option = std::find(args.begin(), args.end(), "-m");
+	if(memory_option != args.end() && memory_option + 1 != args.end()) {
+		memory_filename = *(memory_option + 1);
+		args.erase(memory_option, memory_option + 2);
+	}
+	
+	// Reorder independent moves before upload.
+	bool optimize = false;
+	auto optimize_option = std::find(args.begin(), args.end(), "-O");
+	if(optimize_option != args.end()) {
+		optimize = true;
+		args.erase(optimize_option);
+	}
+	
+	// Loops whose branch condition is computed an iteration ahead.
+	std::vector<std::string> pipelined;
+	for(auto option = std::find(args.begin(), args.end(), "-P");
+	    option != args.end() && option + 1 != args.end();
+	    option = std::find(args.begin(), args.end(), "-P")) {
+		pipelined.push_back(*(option + 1));
+		args.erase(option, option + 2);
+	}
+	
+	// Preprocessor symbols, "-D NAME=<expr>" or "-DNAME=<expr>".
+	std::vector<std::string> definitions;
+	for(auto option = args.begin(); option != args.end();) {
+		if(*option == "-D" && option + 1 != args.end()) {
+			definitions.push_back(*(option + 1));
+			option = args.erase(option, option + 2);
+		} else if(option->compare(0, 2, "-D") == 0 && option->size() > 2) {
+			definitions.push_back(option->substr(2));
+			option = args.erase(option);
+		} else {
+			option++;
+		}
+	}
+	
 	std::string description_filename = "", aocx_filename = "", assembly_filename = "";
+	std::string trace_filename = "";
 	switch(args.size()) {
+		case 4:
+			trace_filename = args[3];
+			// fall through
 		case 3:
 			description_filename = args[0];
 			aocx_filename = args[1];
 			assembly_filename = args[2];
 			break;
 		default:
-			std::cerr << "usage: run <processor_description> <processor_aocx> <assembly program>"
+			std::cerr << "usage: run [-D <name>=<value>]... [-O] [-P <loop label>]... [-m <memory file>] <processor_description> <processor_aocx> <assembly program> [<trace file>]"
 			          << std::endl;
 			exit(1);
 	}
 	
+	phase_timer timer;
+	
 	// Processor description is used by assembler to map unit names to addresses.
 	processor_description proc(description_filename);
+	timer.end_phase("parse");
 	
 	// Read assembly program into string.
 	std::ifstream assembly_stream(assembly_filename);
@@ -79,14 +255,53 @@ int main (int argc, char *argv[]) {
 	
 	// Parse and link assembly source into vector of scad instructions.
 	scad::assembly assembly(proc);
+	for(auto const& definition: definitions) {
+		assembly.define(definition);
+	}
 	assembly.parse(assembly_src);
 	std::vector<struct scad_instruction> prog_unaligned = assembly.build();
-	// Align program for transfer to buffer.
-	std::vector<struct scad_instruction, AlignedAllocator<struct scad_instruction>>
+	std::set<cl_ulong> labels = assembly.labels();
+	std::set<cl_ulong> references = assembly.label_references();
+	// Later loops first, pipelining moves the addresses after a loop.
+	std::sort(pipelined.begin(), pipelined.end(), [&](std::string const& a, std::string const& b) {
+		return assembly.label(a) > assembly.label(b);
+	});
+	for(auto const& label: pipelined) {
+		pipeline_result pipeline = pipeline_loop(proc, prog_unaligned, labels, references, assembly.label(label));
+		if(pipeline.skipped != "") {
+			std::cout << "pipelining " << label << " skipped: " << pipeline.skipped << std::endl;
+		} else {
+			std::cout << "pipelining " << label << ": " << pipeline.ahead.size() << " moves run one iteration ahead, estimated cycles per iteration: "
+			                    << pipeline.cycles_before << " -> " << pipeline.cycles_after << std::endl;
+		}
+		prog_unaligned = pipeline.program;
+		labels = pipeline.labels;
+		references = pipeline.references;
+	}
+	if(optimize) {
+		elimination_result dead = eliminate_dead_copies(proc, prog_unaligned, labels, references);
+		std::cout << "removed " << dead.removed_copies << " copies and "
+		          << dead.removed_moves << " moves" << std::endl;
+		schedule_result schedule = schedule_moves(proc, dead.program, dead.labels);
+		prog_unaligned = schedule.program;
+		std::cout << "estimated cycles: " << schedule.cycles_before
+		          << " -> " << schedule.cycles_after
+		          << (schedule.reverted ? " (reverted, schedule deadlocks)" : "") << std::endl;
+	}
+	// Align program for transfer to buffer, in the address width of the device.
+	std::vector<unsigned char> prog_device;
+	try {
+		prog_device = device_program(prog_unaligned, proc.address_width);
+	} catch(layout_exception& e) {
+		std::cerr << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	std::vector<unsigned char, AlignedAllocator<unsigned char>>
 		prog;
 	// Copy unaligned to aligned memory.
-	std::copy(prog_unaligned.begin(), prog_unaligned.end(),
+	std::copy(prog_device.begin(), prog_device.end(),
 		std::back_inserter(prog));
+	timer.end_phase("assemble");
 	
 	
 	
@@ -101,6 +316,7 @@ int main (int argc, char *argv[]) {
 	platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
 	
 	scad::machine machine(platform, devices[0], aocx_filename);
+	timer.end_phase("load");
 	
 	// TODO: Temporary workaround to get emulator to run workgroup.
 	//       Normally, the interconnect should be an autorun kernel.
@@ -109,8 +325,13 @@ int main (int argc, char *argv[]) {
 	}
 	
 	// INPUT/OUTPUT MEMORY
+	std::vector<scad_data> memory_input;
+	if(memory_filename != "") {
+		memory_input = memory_file_read(memory_filename);
+	}
 	std::vector<scad_data, AlignedAllocator<scad_data>>
-		data(256, (scad_data){.integer = 0});
+		data(std::max<size_t>(256, memory_input.size()), (scad_data){.integer = 0});
+	std::copy(memory_input.begin(), memory_input.end(), data.begin());
 	
 	//for(size_t i = 0; i < data.size(); i++) data[i] = (scad_data){.integer = i};
 	
@@ -121,30 +342,165 @@ int main (int argc, char *argv[]) {
 	auto lsu  = machine.get_component("lsu");
 	lsu->write_buffer(data_buff, data);
 	std::cout << "starting data buffer transfer" << std::endl;
-	lsu->start(data_buff, (cl_uint) data.size());
+	// A cached LSU writes its counters to a third argument when it is done.
+	bool cached = proc.units.count("lsu") && proc.units.at("lsu")->implementation == "lsu_cache";
+	std::vector<cl_ulong, AlignedAllocator<cl_ulong>> cache_counters(4, 0);
+	cl::Buffer cache_counters_buff;
+	if(cached) {
+		cache_counters_buff = machine.buffer_for(CL_MEM_WRITE_ONLY, cache_counters);
+		lsu->start(data_buff, (cl_uint) data.size(), cache_counters_buff);
+	} else {
+		lsu->start(data_buff, (cl_uint) data.size());
+	}
+	// A non-blocking LSU runs its loads in a second kernel on the same memory.
+	std::shared_ptr<scad::machine::component> lsu_loads;
+	if(machine.has_component("lsu_loads")) {
+		lsu_loads = machine.get_component("lsu_loads");
+		lsu_loads->start(data_buff, (cl_uint) data.size());
+	}
 	std::cout << "starting lsu" << std::endl;
 	
+	// Memory stream units: inputs stream the input memory, outputs each
+	// fill an output memory of at most the same size until the sync marker
+	// at the end of the program.
+	typedef std::vector<scad_data, AlignedAllocator<scad_data>> scad_vector;
+	struct stream_output {
+		cl::Buffer buff, stored_buff;
+		scad_vector data;
+		std::vector<cl_uint, AlignedAllocator<cl_uint>> stored;
+	};
+	std::vector<std::string> stream_inputs;
+	std::map<std::string, stream_output> stream_outputs;
+	std::string sync_to = proc.units.count("cu") ? proc.units.at("cu")->parameters["SYNC_TO"] : "";
+	sync_to.erase(std::remove(sync_to.begin(), sync_to.end(), ' '), sync_to.end());
+	for(auto const& unit_entry: proc.units) {
+		auto unit = unit_entry.second;
+		if(unit->type == "memory_stream_in") {
+			auto stream_buff = machine.stream_buffer_for(CL_MEM_READ_ONLY, data);
+			auto stream = machine.get_component(unit->name);
+			stream->write_buffer(stream_buff, data);
+			stream->start_stream(stream_buff, data.size());
+			stream_inputs.push_back(unit->name);
+			std::cout << "starting " << unit->name << std::endl;
+		} else if(unit->type == "memory_stream_out") {
+			std::string marker = "{" + std::to_string(unit->number) + ",0}";
+			if(sync_to.find(marker) == std::string::npos) {
+				std::cerr << unit->name << " never ends without a sync marker, add " << marker
+				          << " to SYNC_TO of the control unit" << std::endl;
+				exit(EXIT_FAILURE);
+			}
+			stream_output &output = stream_outputs[unit->name];
+			output.data = scad_vector(data.size(), (scad_data){.integer = 0});
+			output.stored = std::vector<cl_uint, AlignedAllocator<cl_uint>>(1, 0);
+			output.buff = machine.stream_buffer_for(CL_MEM_WRITE_ONLY, output.data);
+			output.stored_buff = machine.buffer_for(CL_MEM_WRITE_ONLY, output.stored);
+			machine.get_component(unit->name)->start(output.buff, (cl_uint) output.data.size(), output.stored_buff);
+			std::cout << "starting " << unit->name << std::endl;
+		}
+	}
+	
+	// Trace unit needs to run before the program starts.
+	size_t const trace_events = 1 << 16;
+	std::vector<unsigned char, AlignedAllocator<unsigned char>>
+		trace_ring(trace_events * device_trace_event_size(proc.address_width));
+	std::vector<cl_ulong, AlignedAllocator<cl_ulong>> trace_count(1, 0);
+	cl::Buffer trace_ring_buff, trace_count_buff;
+	// Started even without a trace file: the control unit blocks on its end
+	// event, and on the full channel if nobody reads it.
+	bool tracing = machine.has_component("scad_trace");
+	if(trace_filename != "" && !tracing) {
+		std::cerr << "processor has no trace unit, set trace=\"N\" in its description" << std::endl;
+	}
+	if(tracing) {
+		trace_ring_buff = machine.buffer_for(CL_MEM_WRITE_ONLY, trace_ring);
+		trace_count_buff = machine.buffer_for(CL_MEM_WRITE_ONLY, trace_count);
+		machine.get_component("scad_trace")->start(trace_ring_buff, (cl_uint) trace_events, trace_count_buff);
+		std::cout << "starting trace" << std::endl;
+	}
+	
 	// Finally - execute our program.
 	auto control   = machine.get_component("cu");
 	auto prog_buff = machine.buffer_for(prog);
 	std::cout << "starting program buffer transfer" << std::endl;
 	control->write_buffer(prog_buff, prog);
+	timer.end_phase("upload");
 	std::cout << "control unit: start" << std::endl;
-	control->start(prog_buff, (cl_uint) prog.size());
+	control->start(prog_buff, (cl_uint) prog_unaligned.size());
+	
+	control->wait();
+	std::cout << "control unit: done" << std::endl;
+	lsu->wait();
+	if(lsu_loads) {
+		lsu_loads->wait();
+	}
+	std::cout << "lsu unit: wait" << std::endl;
+	for(auto &stream_entry: stream_outputs) {
+		machine.get_component(stream_entry.first)->wait();
+	}
+	// Words nobody moved stay in the input streams until they are reset.
+	for(auto const& name: stream_inputs) {
+		auto reset = machine.get_component(name + "_reset");
+		reset->start();
+		reset->wait();
+		machine.get_component(name)->wait();
+	}
+	timer.end_phase("run");
 	
 	std::cout << "starting data transfer back" << std::endl;
 	lsu->read_buffer(data_buff, data);
 	std::cout << "data transfer back done" << std::endl;
 	
-	lsu->wait();
-	std::cout << "lsu unit: wait" << std::endl;
-	
 	// Print output to stdout.
 	// TODO: write to file.
 	std::cout << "output: "; print_scad_vector(data); std::cout << std::endl;
 	
-	control->wait();
-	std::cout << "control unit: done" << std::endl;
+	for(auto &stream_entry: stream_outputs) {
+		auto stream = machine.get_component(stream_entry.first);
+		stream_output &output = stream_entry.second;
+		stream->read_buffer(output.stored_buff, output.stored);
+		stream->read_buffer(output.buff, output.data);
+		if(output.stored[0] > output.data.size()) {
+			std::cerr << stream_entry.first << " received " << output.stored[0] << " words, only the first "
+			          << output.data.size() << " were stored" << std::endl;
+		}
+		output.data.resize(std::min<size_t>(output.stored[0], output.data.size()));
+		std::cout << stream_entry.first << ": ";
+		print_scad_vector(output.data); std::cout << std::endl;
+	}
+	
+	if(tracing) {
+		auto trace = machine.get_component("scad_trace");
+		trace->wait();
+		if(trace_filename != "") {
+			trace->read_buffer(trace_count_buff, trace_count);
+			trace->read_buffer(trace_ring_buff, trace_ring);
+			std::vector<scad_trace_event> ring = host_trace_events(trace_ring.data(), trace_events, proc.address_width);
+			trace_write(trace_filename, trace_unwrap(ring, trace_count[0]));
+			std::cout << std::dec << "trace: " << trace_count[0] << " events written to "
+			          << trace_filename << std::endl;
+		}
+	}
+	timer.end_phase("readback");
+	
+	// Device runtimes of the kernels started by the host.
+	std::vector<std::pair<std::string, double>> kernels = {
+		{"cu", control->runtime()},
+		{"lsu", lsu->runtime()}
+	};
+	if(lsu_loads) {
+		kernels.push_back({"lsu_loads", lsu_loads->runtime()});
+	}
+	for(auto const& stream_entry: stream_outputs) {
+		kernels.push_back({stream_entry.first, machine.get_component(stream_entry.first)->runtime()});
+	}
+	print_timings(timer, kernels);
+	
+	print_bank_counters(machine, proc);
+	if(cached) {
+		lsu->read_buffer(cache_counters_buff, cache_counters);
+		print_cache_counters("lsu", cache_counters);
+	}
+	print_unit_counters(machine, proc);
 
 }
 
@@ -0,0 +1,174 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+#include "description.hpp"
+#include "assembly.hpp"
+#include "simulator.hpp"
+#include "memory_file.hpp"
+#include "optimize.hpp"
+
+#include "common/instructions.h"
+
+using namespace scad;
+
+int main (int argc, char *argv[]) {
+	std::vector<std::string> args(argv+1, argv+argc);
+	
+	bool optimize = false;
+	auto optimize_option = std::find(args.begin(), args.end(), "-O");
+	if(optimize_option != args.end()) {
+		optimize = true;
+		args.erase(optimize_option);
+	}
+	
+	// Loops whose branch condition is computed an iteration ahead.
+	std::vector<std::string> pipelined;
+	for(auto option = std::find(args.begin(), args.end(), "-P");
+	    option != args.end() && option + 1 != args.end();
+	    option = std::find(args.begin(), args.end(), "-P")) {
+		pipelined.push_back(*(option + 1));
+		args.erase(option, option + 2);
+	}
+	
+	// Preprocessor symbols, "-D NAME=<expr>" or "-DNAME=<expr>".
+	std::vector<std::string> definitions;
+	for(auto option = args.begin(); option != args.end();) {
+		if(*option == "-D" && option + 1 != args.end()) {
+			definitions.push_back(*(option + 1));
+			option = args.erase(option, option + 2);
+		} else if(option->compare(0, 2, "-D") == 0 && option->size() > 2) {
+			definitions.push_back(option->substr(2));
+			option = args.erase(option);
+		} else {
+			option++;
+		}
+	}
+	
+	std::string description_filename = "", assembly_filename = "";
+	std::string memory_filename = "", output_filename = "";
+	switch(args.size()) {
+		case 4:
+			output_filename = args[3];
+			// fall through
+		case 3:
+			memory_filename = args[2];
+			// fall through
+		case 2:
+			description_filename = args[0];
+			assembly_filename = args[1];
+			break;
+		default:
+			std::cerr << "usage: simulate [-D <name>=<value>]... [-O] [-P <loop label>]... <processor_description> <assembly program> [<memory file> [<output memory file>]]" << std::endl
+			          << std::endl
+			          << "Runs a program on a model of the processor instead of the FPGA." << std::endl
+			          << "The memory file is loaded into the memory of unit 'lsu', which is" << std::endl
+			          << "written to the output memory file afterwards." << std::endl;
+			exit(1);
+	}
+	
+	try {
+		processor_description proc(description_filename);
+		
+		std::ifstream assembly_stream(assembly_filename);
+		std::string assembly_src((std::istreambuf_iterator<char>(assembly_stream)),
+		                         std::istreambuf_iterator<char>());
+		scad::assembly assembly(proc);
+		for(auto const& definition: definitions) {
+			assembly.define(definition);
+		}
+		assembly.parse(assembly_src);
+		std::vector<struct scad_instruction> prog = assembly.build();
+		std::set<cl_ulong> labels = assembly.labels();
+		std::set<cl_ulong> references = assembly.label_references();
+		// Later loops first, pipelining moves the addresses after a loop.
+		std::sort(pipelined.begin(), pipelined.end(), [&](std::string const& a, std::string const& b) {
+			return assembly.label(a) > assembly.label(b);
+		});
+		for(auto const& label: pipelined) {
+			pipeline_result pipeline = pipeline_loop(proc, prog, labels, references, assembly.label(label));
+			if(pipeline.skipped != "") {
+				std::cerr << "pipelining " << label << " skipped: " << pipeline.skipped << std::endl;
+			} else {
+				std::cerr << "pipelining " << label << ": " << pipeline.ahead.size() << " moves run one iteration ahead, estimated cycles per iteration: "
+				                    << pipeline.cycles_before << " -> " << pipeline.cycles_after << std::endl;
+			}
+			prog = pipeline.program;
+			labels = pipeline.labels;
+			references = pipeline.references;
+		}
+		if(optimize) {
+			elimination_result dead = eliminate_dead_copies(proc, prog, labels, references);
+			prog = schedule_moves(proc, dead.program, dead.labels).program;
+		}
+		
+		// Same default memory size as 'run'.
+		std::vector<scad_data> input;
+		if(memory_filename != "") {
+			input = memory_file_read(memory_filename);
+		}
+		simulator sim(proc, std::max<size_t>(256, input.size()));
+		if(proc.units.count("lsu")) {
+			std::copy(input.begin(), input.end(), sim.memory("lsu").begin());
+		}
+		
+		simulator_statistics stats = sim.run(prog);
+		
+		std::cout << "cycles: " << stats.cycles << std::endl
+		          << "moves: " << stats.moves << std::endl
+		          << "control stalls: " << stats.control_stalls << std::endl
+		          << "packets: " << stats.packets << std::endl
+		          << "loads: " << stats.loads << ", stores: " << stats.stores << std::endl;
+		for(auto const& unit: stats.operations) {
+			std::cout << "  " << unit.first << ": " << unit.second << " operations" << std::endl;
+		}
+		
+		// Same numbers as a single JSON line for scripts.
+		std::cout << "{\"cycles\": " << stats.cycles
+		          << ", \"moves\": " << stats.moves
+		          << ", \"control_stalls\": " << stats.control_stalls
+		          << ", \"packets\": " << stats.packets
+		          << ", \"loads\": " << stats.loads
+		          << ", \"stores\": " << stats.stores
+		          << ", \"operations\": {";
+		bool first = true;
+		for(auto const& unit: stats.operations) {
+			std::cout << (first ? "" : ", ") << "\"" << unit.first << "\": " << unit.second;
+			first = false;
+		}
+		std::cout << "}}" << std::endl;
+		
+		if(output_filename != "" && proc.units.count("lsu")) {
+			std::ofstream output(output_filename);
+			memory_file_write(output, sim.memory("lsu"));
+		}
+	} catch(description_exception& e) {
+		std::cerr << e.what() << '\n'; exit(2);
+	} catch(assembly_exception& e) {
+		std::cerr << e.what() << '\n'; exit(3);
+	} catch(memory_file_exception& e) {
+		std::cerr << e.what() << '\n'; exit(4);
+	} catch(simulator_exception& e) {
+		std::cerr << e.what() << '\n'; exit(5);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,66 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+
+#include "description.hpp"
+#include "trace.hpp"
+
+#include "common/instructions.h"
+
+using namespace scad;
+
+int main (int argc, char *argv[]) {
+	std::vector<std::string> args(argv+1, argv+argc);
+	
+	std::string description_filename = "", trace_filename = "", json_filename = "";
+	switch(args.size()) {
+		case 3:
+			json_filename = args[2];
+			// fall through
+		case 2:
+			description_filename = args[0];
+			trace_filename = args[1];
+			break;
+		default:
+			std::cerr << "usage: trace2json <processor_description> <trace file> [<json file>]" << std::endl
+			          << std::endl
+			          << "Converts a trace written by 'run' to the Chrome trace-event format." << std::endl
+			          << "Writes to stdout if no json file is given." << std::endl;
+			exit(1);
+	}
+	
+	try {
+		processor_description proc(description_filename);
+		auto events = trace_read(trace_filename);
+		
+		if(json_filename == "") {
+			trace_write_json(std::cout, events, proc);
+		} else {
+			std::ofstream json(json_filename);
+			trace_write_json(json, events, proc);
+		}
+	} catch(description_exception& e) {
+		std::cerr << e.what() << '\n'; exit(2);
+	} catch(trace_exception& e) {
+		std::cerr << e.what() << '\n'; exit(3);
+	}
+	
+	return 0;
+}
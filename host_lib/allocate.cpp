@@ -0,0 +1,340 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <set>
+#include <deque>
+#include <algorithm>
+
+#include "allocate.hpp"
+#include "assembly.hpp"
+
+namespace scad {
+
+// Virtual unit numbers that are not assigned yet, one per virtual unit
+// counting down. Unit numbers are never negative.
+static int const unassigned_host = -1;
+
+static bool address_is_reserved(struct scad_buffer_address address) {
+	return address.unit == SCAD_ADDRESS_NULL && address.buffer == SCAD_ADDRESS_NULL;
+}
+
+static std::string logical_type(processor_description const& proc, std::string const& name) {
+	size_t dot = name.find('.');
+	if(dot != std::string::npos) {
+		return name.substr(0, dot);
+	}
+	return proc.units.at(name)->type;
+}
+
+// Unit names (virtual or physical) of the moves, "" where there is none.
+struct logical_program {
+	std::vector<std::string> from;
+	std::vector<std::string> to;
+	// Branch target and condition moves, virtual units have no number yet.
+	std::vector<bool> target;
+	std::vector<bool> branch;
+};
+
+static logical_program logical_names(processor_description const& proc,
+                                     std::vector<struct scad_instruction> const& program,
+                                     virtual_references const& references) {
+	std::map<int, std::string> names;
+	for(auto const& unit: proc.units) {
+		names[unit.second->number] = unit.first;
+	}
+	
+	logical_program logical;
+	logical.from.resize(program.size());
+	logical.to.resize(program.size());
+	logical.target.resize(program.size());
+	logical.branch.resize(program.size());
+	for(cl_ulong pc = 0; pc < program.size(); pc++) {
+		struct scad_instruction const& instr = program[pc];
+		if(references.from.count(pc)) {
+			logical.from[pc] = references.from.at(pc);
+		} else if(instr.op == SCAD_MOVE) {
+			logical.from[pc] = names[instr.from.unit];
+		}
+		if(references.to.count(pc)) {
+			logical.to[pc] = references.to.at(pc);
+		} else if(instr.op != SCAD_MOVE_PC && !address_is_reserved(instr.to)) {
+			logical.to[pc] = names[instr.to.unit];
+			logical.target[pc] = instr.to.unit == 0 && instr.to.buffer == 1;
+			logical.branch[pc] = instr.op == SCAD_MOVE && instr.to.unit == 0 && instr.to.buffer == 0;
+		}
+	}
+	return logical;
+}
+
+// Entries of a unit that hosts more than one logical unit, tagged with the
+// logical unit they belong to.
+struct shared_unit {
+	std::string type;
+	std::vector<std::deque<std::string>> inputs;
+	std::deque<scad_data> opcodes;
+	std::deque<std::string> copies;
+	std::deque<std::string> waiting;
+};
+
+struct sharing_state {
+	cl_ulong pc = 0;
+	bool target_valid = false;
+	cl_ulong target = 0;
+	std::map<int, shared_unit> units;
+};
+
+static std::string sharing_key(sharing_state const& state) {
+	std::string key = std::to_string(state.pc) + ":"
+		+ (state.target_valid ? std::to_string(state.target) : "-");
+	auto append = [&](std::deque<std::string> const& tags) {
+		key += "|";
+		for(auto const& tag: tags) {
+			key += tag + ",";
+		}
+	};
+	for(auto const& unit: state.units) {
+		for(auto const& input: unit.second.inputs) {
+			append(input);
+		}
+		append(unit.second.copies);
+		append(unit.second.waiting);
+	}
+	return key;
+}
+
+// Run operations whose operands are registered. False if an operation would
+// take operands of different logical units or a result goes to the wrong one.
+static bool sharing_step(shared_unit &unit) {
+	if(unit.type == "rob") {
+		while(!unit.inputs[0].empty()) {
+			unit.copies.push_back(unit.inputs[0].front());
+			unit.inputs[0].pop_front();
+		}
+	} else {
+		while(!unit.inputs[2].empty() && !unit.inputs[0].empty() && !unit.inputs[1].empty()) {
+			std::string tag = unit.inputs[2].front();
+			if(unit.inputs[0].front() != tag || unit.inputs[1].front() != tag) {
+				return false;
+			}
+			for(cl_uint copy = 0; copy < unit.opcodes.front().op.count; copy++) {
+				unit.copies.push_back(tag);
+			}
+			unit.inputs[0].pop_front();
+			unit.inputs[1].pop_front();
+			unit.inputs[2].pop_front();
+			unit.opcodes.pop_front();
+		}
+	}
+	
+	while(!unit.copies.empty() && !unit.waiting.empty()) {
+		if(unit.copies.front() != unit.waiting.front()) {
+			return false;
+		}
+		unit.copies.pop_front();
+		unit.waiting.pop_front();
+	}
+	return unit.copies.size() < 4096;
+}
+
+// Follows every path of the program with the given logical to physical
+// mapping and checks all units that host more than one logical unit.
+static bool sharing_consistent(processor_description const& proc,
+                               std::vector<struct scad_instruction> const& program,
+                               logical_program const& logical,
+                               std::map<std::string, int> const& host) {
+	std::map<int, std::set<std::string>> hosted;
+	for(auto const& entry: host) {
+		hosted[entry.second].insert(entry.first);
+	}
+	
+	sharing_state initial;
+	for(auto const& unit: proc.units) {
+		int number = unit.second->number;
+		if(hosted[number].size() > 1) {
+			shared_unit shared;
+			shared.type = unit.second->type;
+			shared.inputs.resize(unit.second->input_buffers.size());
+			initial.units[number] = shared;
+		}
+	}
+	if(initial.units.empty()) {
+		return true;
+	}
+	
+	std::set<std::string> visited;
+	std::vector<sharing_state> worklist = {initial};
+	while(!worklist.empty()) {
+		sharing_state state = worklist.back();
+		worklist.pop_back();
+		
+		while(state.pc < program.size()) {
+			if(!visited.insert(sharing_key(state)).second) {
+				break;
+			}
+			if(visited.size() > 100000) {
+				return false;
+			}
+			
+			cl_ulong pc = state.pc;
+			struct scad_instruction const& instr = program[pc];
+			if(instr.op == SCAD_MOVE_PC) {
+				state.pc = instr.immediate.integer;
+				continue;
+			}
+			
+			if(logical.from[pc] != "" && state.units.count(host.at(logical.from[pc]))) {
+				shared_unit &unit = state.units[host.at(logical.from[pc])];
+				unit.waiting.push_back(logical.from[pc]);
+				if(!sharing_step(unit)) {
+					return false;
+				}
+			}
+			if(logical.to[pc] != "" && state.units.count(host.at(logical.to[pc]))) {
+				shared_unit &unit = state.units[host.at(logical.to[pc])];
+				unit.inputs.at(instr.to.buffer).push_back(logical.to[pc]);
+				if(unit.type == "pu" && instr.to.buffer == 2) {
+					// Copies of operations with an unknown count cannot be followed.
+					if(instr.op != SCAD_MOVE_IMMEDIATE) {
+						return false;
+					}
+					unit.opcodes.push_back(instr.immediate);
+				}
+				if(!sharing_step(unit)) {
+					return false;
+				}
+			}
+			
+			if(logical.target[pc] && instr.op == SCAD_MOVE_IMMEDIATE) {
+				state.target = instr.immediate.integer;
+				state.target_valid = true;
+			} else if(logical.target[pc]) {
+				return false;
+			}
+			if(logical.branch[pc]) {
+				if(!state.target_valid) {
+					return false;
+				}
+				sharing_state taken = state;
+				taken.pc = state.target;
+				taken.target_valid = false;
+				worklist.push_back(taken);
+				state.target_valid = false;
+			}
+			state.pc++;
+		}
+	}
+	return true;
+}
+
+std::map<std::string, int> allocate_units(processor_description const& proc,
+                                          std::vector<struct scad_instruction> const& program,
+                                          virtual_references const& references) {
+	logical_program logical = logical_names(proc, program, references);
+	
+	// Operations per logical unit and units that exchange data.
+	std::map<std::string, unsigned long> weight;
+	std::map<std::string, std::set<std::string>> neighbors;
+	std::set<std::string> virtual_units;
+	for(cl_ulong pc = 0; pc < program.size(); pc++) {
+		std::string const& from = logical.from[pc];
+		std::string const& to = logical.to[pc];
+		// Operations are counted by their opcodes, or inputs for rob.
+		if(to != "" && program[pc].to.buffer == (logical_type(proc, to) == "rob" ? 0 : 2)) {
+			weight[to]++;
+		}
+		if(from != "" && to != "") {
+			neighbors[from].insert(to);
+			neighbors[to].insert(from);
+		}
+		if(references.from.count(pc)) {
+			virtual_units.insert(from);
+		}
+		if(references.to.count(pc)) {
+			virtual_units.insert(to);
+		}
+	}
+	
+	// Physical units the program names keep their load.
+	std::map<std::string, int> host;
+	std::map<int, unsigned long> load;
+	int next_unassigned = unassigned_host;
+	for(cl_ulong pc = 0; pc < program.size(); pc++) {
+		for(std::string const& name: {logical.from[pc], logical.to[pc]}) {
+			if(name != "" && !virtual_units.count(name) && !host.count(name)) {
+				host[name] = proc.units.at(name)->number;
+				load[host[name]] += weight[name];
+			}
+		}
+	}
+	for(auto const& name: virtual_units) {
+		host[name] = next_unassigned--;
+	}
+	
+	std::vector<std::string> order(virtual_units.begin(), virtual_units.end());
+	std::stable_sort(order.begin(), order.end(), [&](std::string const& a, std::string const& b) {
+		return weight[a] > weight[b];
+	});
+	
+	std::map<std::string, int> allocation;
+	for(auto const& name: order) {
+		std::string type = logical_type(proc, name);
+		std::vector<int> candidates;
+		for(auto const& unit: proc.units) {
+			if(unit.second->type == type) {
+				candidates.push_back(unit.second->number);
+			}
+		}
+		if(candidates.empty()) {
+			throw assembly_exception("No unit of type '" + type + "' for virtual unit: " + name);
+		}
+		
+		// Units that exchange data with this one, where sharing costs little.
+		std::set<int> related;
+		for(auto const& neighbor: neighbors[name]) {
+			related.insert(host[neighbor]);
+		}
+		auto load_of = [&](int unit) {
+			return load.count(unit) ? load.at(unit) : 0;
+		};
+		std::stable_sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+			bool a_free = !load.count(a), b_free = !load.count(b);
+			if(a_free != b_free) {
+				return a_free;
+			}
+			if(related.count(a) != related.count(b)) {
+				return related.count(a) > related.count(b);
+			}
+			return load_of(a) < load_of(b);
+		});
+		
+		bool allocated = false;
+		for(int candidate: candidates) {
+			bool free = !load.count(candidate);
+			host[name] = candidate;
+			if(free || sharing_consistent(proc, program, logical, host)) {
+				load[candidate] += weight[name];
+				allocation[name] = candidate;
+				allocated = true;
+				break;
+			}
+		}
+		if(!allocated) {
+			throw assembly_exception("Virtual unit '" + name + "' cannot share any '" + type
+			                         + "' unit without changing the program.");
+		}
+	}
+	return allocation;
+}
+
+} // namespace scad
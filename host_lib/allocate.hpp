@@ -0,0 +1,48 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_ALLOCATE_HPP
+#define SCAD_ALLOCATE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "common/instructions.h"
+#include "description.hpp"
+
+namespace scad {
+
+// Unit names of the moves that use virtual units ("pu.a"), by address.
+class virtual_references {
+	public:
+		std::map<cl_ulong, std::string> from;
+		std::map<cl_ulong, std::string> to;
+};
+
+// Physical unit number for every virtual unit, the type is the part of the
+// name before the dot.
+// Every virtual unit gets a unit of its type that the program does not use
+// by name, heavier units (more operations) first. If there are not enough,
+// virtual units share a unit, preferably with units they exchange data with
+// since those wait for each other anyway, then with the least loaded one.
+// Sharing is only done where operands and results still pair up the same
+// way on every path of the program. Throws assembly_exception otherwise.
+std::map<std::string, int> allocate_units(processor_description const& proc,
+                                          std::vector<struct scad_instruction> const& program,
+                                          virtual_references const& references);
+
+} // namespace scad
+
+#endif /* SCAD_ALLOCATE_HPP */
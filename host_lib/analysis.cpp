@@ -0,0 +1,545 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <deque>
+#include <set>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
+
+#include "analysis.hpp"
+#include "simulator.hpp"
+
+namespace scad {
+
+// Buffers cannot be deeper, see buffer.h.
+static int const analysis_max_depth = 255;
+// Instructions executed per analysis before giving up.
+static unsigned long const analysis_max_steps = 1000000;
+
+// Ends the current path of the exploration.
+class analysis_path_end : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+class analysis_deadlock : public analysis_path_end {
+	public: using analysis_path_end::analysis_path_end;
+};
+
+struct analysis_token {
+	bool known;
+	// Value was moved as an immediate, kept when generalizing loops.
+	bool immediate;
+	scad_data value;
+};
+
+struct analysis_slot {
+	struct scad_buffer_address from;
+	bool set;
+	struct analysis_token data;
+};
+
+struct analysis_unit {
+	std::string name;
+	std::string type;
+	std::vector<std::deque<analysis_slot>> inputs;
+	std::vector<std::deque<struct scad_buffer_address>> output_to;
+	std::vector<std::deque<analysis_token>> output_data;
+	struct analysis_token pending_data;
+	cl_uint pending_copies = 0;
+};
+
+typedef std::map<int, analysis_unit> analysis_machine;
+
+struct analysis_path {
+	cl_ulong pc;
+	analysis_machine machine;
+};
+
+struct analysis_context {
+	processor_description const& proc;
+	std::vector<struct scad_instruction> const& program;
+	// Units run as far as possible after every move, otherwise only at
+	// branches and at the end of the program.
+	bool eager;
+	// Buffer depth, moves beyond it deadlock in eager runs.
+	size_t depth;
+	
+	std::vector<std::string> deadlocks;
+	std::vector<std::string> warnings;
+	bool complete = true;
+	
+	std::map<std::string, int> peak;
+	std::set<std::string> unbounded;
+	std::set<std::string> reported;
+	// Machine state (without values) per pc, true once values were dropped.
+	std::map<std::string, bool> visited;
+	unsigned long steps = 0;
+	bool reaches_end = false;
+	// Pcs at which a path came around to a state explored before.
+	std::set<cl_ulong> repeats;
+	// A path ended without reaching the end or a deadlock.
+	bool cut = false;
+	
+	analysis_context(processor_description const& proc,
+	                 std::vector<struct scad_instruction> const& program,
+	                 bool eager, size_t depth)
+	 : proc(proc), program(program), eager(eager), depth(depth) {}
+};
+
+static bool address_is_reserved(struct scad_buffer_address address) {
+	return address.unit == SCAD_ADDRESS_NULL && address.buffer == SCAD_ADDRESS_NULL;
+}
+
+static std::string describe(analysis_context &ctx, cl_ulong pc) {
+	struct scad_instruction instr = ctx.program[pc];
+	std::string from = (instr.op == SCAD_MOVE)
+		? ctx.proc.buffer_name(instr.from, false) : "$" + std::to_string(instr.immediate.integer);
+	std::string to = (instr.op == SCAD_MOVE_PC) ? "pc" : ctx.proc.buffer_name(instr.to, true);
+	return "pc " + std::to_string(pc) + " (" + from + " -> " + to + ")";
+}
+
+static void report(analysis_context &ctx, std::vector<std::string> &list, std::string message) {
+	if(ctx.reported.insert(message).second) {
+		list.push_back(message);
+	}
+}
+
+static analysis_machine machine_init(processor_description const& proc) {
+	analysis_machine machine;
+	for(auto const& unit_entry: proc.units) {
+		auto description = unit_entry.second;
+		analysis_unit unit;
+		unit.name = description->name;
+		unit.type = description->type;
+		unit.inputs.resize(description->input_buffers.size());
+		unit.output_to.resize(description->output_buffers.size());
+		unit.output_data.resize(description->output_buffers.size());
+		machine[description->number] = unit;
+	}
+	return machine;
+}
+
+static analysis_unit &unit_at(analysis_machine &machine, struct scad_buffer_address address) {
+	if(machine.count(address.unit) == 0) {
+		throw analysis_path_end("No unit with number " + std::to_string(address.unit) + ".");
+	}
+	return machine.at(address.unit);
+}
+
+static bool has_data(std::deque<analysis_slot> const& input) {
+	return !input.empty() && input.front().set;
+}
+
+static analysis_token pop(std::deque<analysis_slot> &input) {
+	analysis_token data = input.front().data;
+	input.pop_front();
+	return data;
+}
+
+// Update peak occupancy of all buffers. A buffer beyond what the device
+// supports is taken as growing without bound, which deadlocks any depth.
+static void record(analysis_context &ctx, analysis_machine &machine) {
+	for(auto const& unit_entry: machine) {
+		auto const& unit = unit_entry.second;
+		for(size_t i = 0; i < unit.inputs.size(); i++) {
+			std::string name = ctx.proc.buffer_name({(scad_address_part) unit_entry.first, (scad_address_part) i}, true);
+			int occupancy = unit.inputs[i].size();
+			ctx.peak[name] = std::max(ctx.peak[name], occupancy);
+			if(occupancy > analysis_max_depth) {
+				ctx.unbounded.insert(name);
+				throw analysis_deadlock(name + " grows without bound.");
+			}
+		}
+		for(size_t i = 0; i < unit.output_to.size(); i++) {
+			std::string name = ctx.proc.buffer_name({(scad_address_part) unit_entry.first, (scad_address_part) i}, false);
+			// Results wait in their unit when the eager run limits output data.
+			int occupancy = ctx.eager ? unit.output_to[i].size()
+			                          : std::max(unit.output_to[i].size(), unit.output_data[i].size());
+			ctx.peak[name] = std::max(ctx.peak[name], occupancy);
+			if(occupancy > analysis_max_depth) {
+				ctx.unbounded.insert(name);
+				throw analysis_deadlock(name + " grows without bound.");
+			}
+		}
+	}
+}
+
+static analysis_token derived(analysis_token const& a, analysis_token const& b, cl_uint opcode) {
+	if(!a.known || !b.known) {
+		return {false, false, {.integer = 0}};
+	}
+	return {true, false, pu_eval(a.value, b.value, opcode)};
+}
+
+// Execute at most one operation of a unit. Returns true on progress.
+// Output data is limited to depth entries, units wait for space like on the
+// device.
+static bool fire(analysis_unit &unit, size_t depth) {
+	bool progress = false;
+	
+	if(unit.type == "pu" || unit.type == "lsu") {
+		if(unit.pending_copies == 0 && has_data(unit.inputs[2]) && has_data(unit.inputs[0])) {
+			analysis_token opc = unit.inputs[2].front().data;
+			if(!opc.known) {
+				throw analysis_path_end("Opcode for " + unit.name + " is not known statically.");
+			}
+			bool needs_value = !(unit.type == "lsu" && opc.value.op.opcode == SCAD_LSU_LOAD_ADDRESS);
+			if(!needs_value || has_data(unit.inputs[1])) {
+				pop(unit.inputs[2]);
+				analysis_token left = pop(unit.inputs[0]);
+				analysis_token right = needs_value ? pop(unit.inputs[1]) : analysis_token {true, false, {.integer = 0}};
+				if(unit.type == "pu") {
+					unit.pending_data = derived(left, right, opc.value.op.opcode);
+					unit.pending_copies = opc.value.op.count;
+				} else if(opc.value.op.opcode != SCAD_LSU_STORE) {
+					// Memory contents are not tracked.
+					unit.pending_data = {false, false, {.integer = 0}};
+					unit.pending_copies = opc.value.op.count;
+				}
+				progress = true;
+			}
+		}
+		while(unit.pending_copies > 0 && unit.output_data[0].size() < depth) {
+			unit.output_data[0].push_back(unit.pending_data);
+			unit.pending_copies--;
+			progress = true;
+		}
+	
+	} else if(unit.type == "rob") {
+		for(size_t i = 0; i < unit.inputs.size(); i++) {
+			if(has_data(unit.inputs[i]) && unit.output_data[i].size() < depth) {
+				analysis_token token = pop(unit.inputs[i]);
+				token.immediate = false;
+				unit.output_data[i].push_back(token);
+				progress = true;
+			}
+		}
+	
+	} else if(unit.type == "memory_stream_in") {
+		// Streams as much as is moved away.
+		if(unit.output_data[0].size() < unit.output_to[0].size()) {
+			unit.output_data[0].push_back({false, false, {.integer = 0}});
+			progress = true;
+		}
+	
+	} else if(unit.type == "memory_stream_out") {
+		if(has_data(unit.inputs[0])) {
+			pop(unit.inputs[0]);
+			progress = true;
+		}
+	}
+	
+	return progress;
+}
+
+// Run all units until none can make progress.
+static void drain(analysis_context &ctx, analysis_machine &machine) {
+	size_t depth = ctx.depth;
+	bool progress = true;
+	while(progress) {
+		progress = false;
+		for(auto &unit_entry: machine) {
+			auto &unit = unit_entry.second;
+			progress |= fire(unit, depth);
+			
+			for(size_t i = 0; i < unit.output_data.size(); i++) {
+				while(!unit.output_data[i].empty() && !unit.output_to[i].empty()) {
+					struct scad_buffer_address to = unit.output_to[i].front();
+					analysis_token token = unit.output_data[i].front();
+					unit.output_to[i].pop_front();
+					unit.output_data[i].pop_front();
+					progress = true;
+					if(address_is_reserved(to)) {
+						continue;
+					}
+					for(auto &slot: unit_at(machine, to).inputs.at(to.buffer)) {
+						if(!slot.set && slot.from.unit == unit_entry.first && slot.from.buffer == i) {
+							slot.set = true;
+							slot.data = token;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+	record(ctx, machine);
+}
+
+// Machine state without values.
+static std::string state_key(cl_ulong pc, analysis_machine const& machine) {
+	std::string key = std::to_string(pc) + ":";
+	for(auto const& unit_entry: machine) {
+		auto const& unit = unit_entry.second;
+		for(auto const& input: unit.inputs) {
+			key += "i";
+			for(auto const& slot: input) {
+				key += {(char) slot.from.unit, (char) slot.from.buffer, slot.set ? 's' : '-'};
+			}
+		}
+		for(size_t i = 0; i < unit.output_to.size(); i++) {
+			key += "o";
+			for(auto const& to: unit.output_to[i]) {
+				key += {(char) to.unit, (char) to.buffer};
+			}
+			key += std::to_string(unit.output_data[i].size());
+		}
+	}
+	return key;
+}
+
+// Values that are not immediates are dropped when a loop comes around with
+// the same occupancy, so loops over known counters end.
+static void generalize(analysis_machine &machine) {
+	auto forget = [](analysis_token &token) {
+		if(!token.immediate) {
+			token.known = false;
+		}
+	};
+	for(auto &unit_entry: machine) {
+		for(auto &input: unit_entry.second.inputs) {
+			for(auto &slot: input) {
+				forget(slot.data);
+			}
+		}
+		for(auto &output: unit_entry.second.output_data) {
+			for(auto &token: output) {
+				forget(token);
+			}
+		}
+		forget(unit_entry.second.pending_data);
+	}
+}
+
+// False if this state was explored already.
+static bool visit(analysis_context &ctx, analysis_path &path) {
+	std::string key = state_key(path.pc, path.machine);
+	if(ctx.visited.count(key) == 0) {
+		ctx.visited[key] = false;
+		return true;
+	}
+	if(!ctx.visited[key]) {
+		ctx.visited[key] = true;
+		generalize(path.machine);
+		return true;
+	}
+	ctx.repeats.insert(path.pc);
+	return false;
+}
+
+static void end_of_program(analysis_context &ctx, analysis_machine &machine) {
+	drain(ctx, machine);
+	ctx.reaches_end = true;
+	for(auto const& unit_entry: machine) {
+		auto const& unit = unit_entry.second;
+		for(size_t i = 0; i < unit.inputs.size(); i++) {
+			if(!unit.inputs[i].empty()) {
+				report(ctx, ctx.warnings,
+				       ctx.proc.buffer_name({(scad_address_part) unit_entry.first, (scad_address_part) i}, true)
+				       + " has " + std::to_string(unit.inputs[i].size())
+				       + " entries left at the end of the program.");
+			}
+		}
+		for(size_t i = 0; i < unit.output_data.size(); i++) {
+			if(!unit.output_data[i].empty() && unit.type != "memory_stream_in") {
+				report(ctx, ctx.warnings,
+				       ctx.proc.buffer_name({(scad_address_part) unit_entry.first, (scad_address_part) i}, false)
+				       + " has " + std::to_string(unit.output_data[i].size())
+				       + " values left at the end of the program.");
+			}
+		}
+	}
+}
+
+static void run_path(analysis_context &ctx, analysis_path &path, std::vector<analysis_path> &worklist) {
+	if(!visit(ctx, path)) {
+		return;
+	}
+	size_t depth = ctx.depth;
+	
+	while(true) {
+		if(++ctx.steps > analysis_max_steps) {
+			ctx.complete = false;
+			throw analysis_path_end("Analysis stopped after " + std::to_string(analysis_max_steps) + " instructions.");
+		}
+		if(path.pc >= ctx.program.size()) {
+			end_of_program(ctx, path.machine);
+			return;
+		}
+		
+		cl_ulong pc = path.pc;
+		struct scad_instruction instr = ctx.program[pc];
+		switch(instr.op) {
+			case SCAD_MOVE_PC:
+				path.pc = instr.immediate.integer;
+				if(!visit(ctx, path)) {
+					return;
+				}
+				continue;
+			
+			case SCAD_MOVE:
+			case SCAD_MOVE_IMMEDIATE:
+				break;
+			
+			default:
+				throw analysis_path_end("Invalid instruction at pc " + std::to_string(pc) + ".");
+		}
+		
+		// Register the move with destination and source.
+		struct scad_buffer_address from = (instr.op == SCAD_MOVE)
+			? instr.from : (struct scad_buffer_address) {0, 0};
+		if(!address_is_reserved(instr.to)) {
+			analysis_unit &to = unit_at(path.machine, instr.to);
+			analysis_token immediate = {instr.op == SCAD_MOVE_IMMEDIATE, true, instr.immediate};
+			to.inputs.at(instr.to.buffer).push_back({from, instr.op == SCAD_MOVE_IMMEDIATE, immediate});
+			if(ctx.eager && to.inputs[instr.to.buffer].size() > depth) {
+				throw analysis_deadlock(describe(ctx, pc) + ": "
+				                        + ctx.proc.buffer_name(instr.to, true) + " is full.");
+			}
+		}
+		if(instr.op == SCAD_MOVE) {
+			analysis_unit &source = unit_at(path.machine, instr.from);
+			source.output_to.at(instr.from.buffer).push_back(instr.to);
+			if(ctx.eager && source.output_to[instr.from.buffer].size() > depth) {
+				throw analysis_deadlock(describe(ctx, pc) + ": "
+				                        + ctx.proc.buffer_name(instr.from, false) + " is full.");
+			}
+		}
+		record(ctx, path.machine);
+		if(ctx.eager) {
+			drain(ctx, path.machine);
+		}
+		
+		if(!(instr.op == SCAD_MOVE && instr.to.unit == 0 && instr.to.buffer == 0)) {
+			path.pc++;
+			continue;
+		}
+		
+		// Branch: wait for condition and target.
+		drain(ctx, path.machine);
+		analysis_unit &control = path.machine.at(0);
+		if(!has_data(control.inputs[0]) || !has_data(control.inputs[1])) {
+			throw analysis_deadlock(describe(ctx, pc) + ": branch "
+				+ (has_data(control.inputs[0]) ? "target" : "condition") + " never arrives.");
+		}
+		analysis_token condition = pop(control.inputs[0]);
+		analysis_token target = pop(control.inputs[1]);
+		if(!target.known) {
+			throw analysis_path_end(describe(ctx, pc) + ": branch target not known statically.");
+		}
+		
+		if(condition.known) {
+			path.pc = condition.value.integer ? target.value.integer : pc + 1;
+		} else {
+			worklist.push_back({pc + 1, path.machine});
+			path.pc = target.value.integer;
+		}
+		if(!visit(ctx, path)) {
+			return;
+		}
+	}
+}
+
+static void explore(analysis_context &ctx) {
+	std::vector<analysis_path> worklist = {{0, machine_init(ctx.proc)}};
+	while(!worklist.empty() && ctx.complete) {
+		analysis_path path = worklist.back();
+		worklist.pop_back();
+		try {
+			run_path(ctx, path, worklist);
+		} catch(analysis_deadlock &e) {
+			report(ctx, ctx.deadlocks, e.what());
+		} catch(analysis_path_end &e) {
+			report(ctx, ctx.warnings, e.what());
+			ctx.cut = true;
+		} catch(simulator_exception &e) {
+			report(ctx, ctx.warnings, e.what());
+			ctx.cut = true;
+		}
+	}
+	if(!ctx.reaches_end && ctx.complete && ctx.deadlocks.empty()) {
+		if(ctx.cut || ctx.repeats.empty()) {
+			report(ctx, ctx.warnings, "No path reaches the end of the program.");
+			return;
+		}
+		// Every path comes back to a state it was in: the program hangs.
+		std::string buffers;
+		for(auto const& peak: ctx.peak) {
+			if(peak.second > 0) {
+				buffers += (buffers == "" ? "" : ", ") + peak.first;
+			}
+		}
+		report(ctx, ctx.deadlocks, "No path reaches the end of the program, the loop at pc "
+		       + std::to_string(*ctx.repeats.begin()) + " repeats forever on " + buffers + ".");
+	}
+}
+
+analysis_result analyze(processor_description const& proc,
+                        std::vector<struct scad_instruction> const& program) {
+	analysis_result result;
+	
+	analysis_context configured(proc, program, true, proc.buffer_size);
+	explore(configured);
+	result.deadlocks = configured.deadlocks;
+	result.warnings = configured.warnings;
+	result.complete = configured.complete;
+	
+	// Larger buffers never deadlock where smaller ones do not, search for
+	// the smallest depth without deadlock.
+	std::unique_ptr<analysis_context> minimal(new analysis_context(proc, program, true, analysis_max_depth));
+	explore(*minimal);
+	if(minimal->deadlocks.empty()) {
+		size_t low = 1, high = analysis_max_depth;
+		while(low < high) {
+			size_t depth = (low + high) / 2;
+			std::unique_ptr<analysis_context> run;
+			if(depth == (size_t) proc.buffer_size) {
+				run.reset(new analysis_context(configured));
+			} else {
+				run.reset(new analysis_context(proc, program, true, depth));
+				explore(*run);
+			}
+			if(run->deadlocks.empty()) {
+				high = depth;
+				minimal = std::move(run);
+			} else {
+				low = depth + 1;
+			}
+		}
+		result.minimal_depth = high;
+	}
+	
+	analysis_context lazy(proc, program, false, (size_t) -1);
+	explore(lazy);
+	result.complete = result.complete && minimal->complete && lazy.complete;
+	
+	for(auto const& peak: minimal->peak) {
+		result.buffers[peak.first].minimal = peak.second;
+	}
+	for(auto const& peak: lazy.peak) {
+		result.buffers[peak.first].no_stall = std::max(peak.second, result.buffers[peak.first].minimal);
+		result.no_stall_depth = std::max(result.no_stall_depth, result.buffers[peak.first].no_stall);
+	}
+	for(auto const& name: minimal->unbounded) {
+		result.buffers[name].unbounded = true;
+	}
+	for(auto const& name: lazy.unbounded) {
+		result.buffers[name].unbounded = true;
+	}
+	
+	return result;
+}
+
+} // namespace scad
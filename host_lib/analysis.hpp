@@ -0,0 +1,66 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_ANALYSIS_HPP
+#define SCAD_ANALYSIS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "common/instructions.h"
+#include "description.hpp"
+
+namespace scad {
+
+class buffer_occupancy {
+	public:
+		// Most moves waiting on the buffer with the smallest depth that does
+		// not deadlock, if units keep up with the control unit.
+		int minimal = 0;
+		// Most entries the buffer holds if units only catch up at branches:
+		// depth at which the control unit does not wait for this buffer.
+		int no_stall = 0;
+		// Occupancy grows with every loop iteration.
+		bool unbounded = false;
+};
+
+class analysis_result {
+	public:
+		// Per buffer, named like in assembly: "pu0@in1", "lsu@out".
+		std::map<std::string, buffer_occupancy> buffers;
+
+		// Deadlocks on every execution with the configured depth.
+		std::vector<std::string> deadlocks;
+		std::vector<std::string> warnings;
+
+		// Smallest BUFFER_DEPTH without deadlock, 0 if no depth avoids it,
+		// and without control stalls.
+		int minimal_depth = 0;
+		int no_stall_depth = 0;
+
+		// False if exploration stopped before covering all paths.
+		bool complete = true;
+};
+
+// Executes the program on tokens instead of values against the buffers of
+// the processor description. Values are only tracked as far as they follow
+// from immediates, branches on unknown values follow both directions.
+// Loops are followed until their buffer occupancy repeats.
+analysis_result analyze(processor_description const& proc,
+                        std::vector<struct scad_instruction> const& program);
+
+} // namespace scad
+
+#endif /* SCAD_ANALYSIS_HPP */
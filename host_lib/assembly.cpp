@@ -13,6 +13,7 @@
 //   limitations under the License.
 
 #include "assembly.hpp"
+#include "compiled_description.hpp"
 
 namespace scad {
 
@@ -26,7 +27,7 @@ void assembly::push_label(std::string label) {
 
 std::pair<bool, scad_data> assembly::parse_immediate(std::string immediate_string) {
 	
-	std::regex integer_pattern("\\$([0-9]+)");
+	static std::regex const integer_pattern("\\$([0-9]+)");
 	std::smatch integer_match;
 	if(std::regex_match(immediate_string, integer_match, integer_pattern)) {
 		scad_data result = {.integer =  std::stoul(integer_match[1])};
@@ -40,7 +41,7 @@ std::pair<bool, scad_data> assembly::parse_immediate(std::string immediate_strin
 		//return std::make_pair(true, lsu_op_strings["st"]);
 	}
 	
-	std::regex tuple_pattern("\\(\\s*([^\\s\\,]+)\\s*\\,\\s*([0-9]+)\\s*\\)");
+	static std::regex const tuple_pattern("\\(\\s*([^\\s\\,]+)\\s*\\,\\s*([0-9]+)\\s*\\)");
 	std::smatch tuple_match;
 	if(std::regex_match(immediate_string, tuple_match, tuple_pattern)) {
 		unsigned long count = std::stoul(tuple_match[2]);
@@ -63,7 +64,7 @@ std::pair<bool, scad_data> assembly::parse_immediate(std::string immediate_strin
 }
 
 std::pair<bool, std::string> assembly::parse_label_from(std::string label_str) {
-	std::regex label_pattern("^[a-zA-Z_][a-zA-Z_0-9]*$");
+	static std::regex const label_pattern("^[a-zA-Z_][a-zA-Z_0-9]*$");
 	std::smatch label_match;
 	if(std::regex_match(label_str, label_match, label_pattern)) {
 		return {true, label_str};
@@ -73,7 +74,7 @@ std::pair<bool, std::string> assembly::parse_label_from(std::string label_str) {
 }
 
 std::pair<bool, std::pair<std::string, std::string>> split_buffer_address(std::string buffer_str) {
-	std::regex buffer_pattern("^([a-zA-Z_0-9]+)@([a-zA-Z_0-9]+)$");
+	static std::regex const buffer_pattern("^([a-zA-Z_0-9]+(?:\\.[a-zA-Z_0-9]+)?)@([a-zA-Z_0-9]+)$");
 	std::smatch buffer_match;
 	if(std::regex_match(buffer_str, buffer_match, buffer_pattern)) {
 		return std::make_pair(true, std::make_pair(buffer_match[1], buffer_match[2]));
@@ -81,9 +82,36 @@ std::pair<bool, std::pair<std::string, std::string>> split_buffer_address(std::s
 	return std::make_pair(false, std::make_pair("", ""));
 }
 
+// Virtual units are named <type>.<name> and get a physical unit in build().
+std::pair<bool, struct scad_buffer_address> assembly::parse_virtual_address(std::string unit, std::string buffer,
+                                                                            bool input, std::string addr_str) {
+	std::string type = unit.substr(0, unit.find('.'));
+	if(type != "pu" && type != "rob") {
+		throw assembly_exception("Only pu and rob units can be virtual: " + addr_str);
+	}
+	auto const& buffers = input ? unit_type_buffers.at(type).first : unit_type_buffers.at(type).second;
+	if(buffers.count(buffer) == 0) {
+		throw assembly_exception((input ? "Destination" : "Source") + std::string(" buffer '")
+		                         + buffer + "' not found in: " + addr_str);
+	}
+	if(input) {
+		virtual_units.to[result.size()] = unit;
+	} else {
+		virtual_units.from[result.size()] = unit;
+	}
+	return std::make_pair(true, (struct scad_buffer_address) {.unit = 0, .buffer = (scad_address_part) buffers.at(buffer)});
+}
+
 std::pair<bool, struct scad_buffer_address> assembly::parse_address_from(std::string addr_str) {
+	struct scad_buffer_address address;
+	if(proc.compiled && proc.compiled->find(addr_str.data(), addr_str.size(), false, address)) {
+		return std::make_pair(true, address);
+	}
+	
 	std::pair<bool, std::pair<std::string, std::string>> split_addr = split_buffer_address(addr_str);
-	if(split_addr.first) {
+	if(split_addr.first && split_addr.second.first.find('.') != std::string::npos) {
+		return parse_virtual_address(split_addr.second.first, split_addr.second.second, false, addr_str);
+	} else if(split_addr.first) {
 		if(proc.units.count(split_addr.second.first) == 0) {
 			throw assembly_exception("Source unit '" + split_addr.second.first + "' not found in: " + addr_str);
 		}
@@ -99,8 +127,15 @@ std::pair<bool, struct scad_buffer_address> assembly::parse_address_from(std::st
 }
 
 std::pair<bool, struct scad_buffer_address> assembly::parse_address_to(std::string addr_str) {
+	struct scad_buffer_address address;
+	if(proc.compiled && proc.compiled->find(addr_str.data(), addr_str.size(), true, address)) {
+		return std::make_pair(true, address);
+	}
+	
 	std::pair<bool, std::pair<std::string, std::string>> split_addr = split_buffer_address(addr_str);
-	if(split_addr.first) {
+	if(split_addr.first && split_addr.second.first.find('.') != std::string::npos) {
+		return parse_virtual_address(split_addr.second.first, split_addr.second.second, true, addr_str);
+	} else if(split_addr.first) {
 		if(proc.units.count(split_addr.second.first) == 0) {
 			throw assembly_exception("Destination unit '" + split_addr.second.first + "' not found in: " + addr_str);
 		}
@@ -113,7 +148,7 @@ std::pair<bool, struct scad_buffer_address> assembly::parse_address_to(std::stri
 	} else {
 		// Destroying move.
 		if(addr_str == "null") {
-			return std::make_pair(true, (struct scad_buffer_address) {.unit = (cl_uchar) -1, .buffer = (cl_uchar) -1});
+			return std::make_pair(true, (struct scad_buffer_address) {.unit = SCAD_ADDRESS_NULL, .buffer = SCAD_ADDRESS_NULL});
 		}
 		return std::make_pair(false, (struct scad_buffer_address) {});
 	}
@@ -179,37 +214,90 @@ std::vector<struct scad_instruction> assembly::build() {
 		}
 	}
 	
+	if(!virtual_units.from.empty() || !virtual_units.to.empty()) {
+		allocated = allocate_units(proc, result, virtual_units);
+		for(auto const& it: virtual_units.from) {
+			result[it.first].from.unit = (scad_address_part) allocated.at(it.second);
+		}
+		for(auto const& it: virtual_units.to) {
+			result[it.first].to.unit = (scad_address_part) allocated.at(it.second);
+		}
+	}
+	
 	return result;
 }
 
+std::set<cl_ulong> assembly::labels() const {
+	std::set<cl_ulong> positions;
+	for(auto const& it: symbol) {
+		positions.insert(it.second);
+	}
+	return positions;
+}
+
+cl_ulong assembly::label(std::string const& name) const {
+	auto it = symbol.find(name);
+	if(it == symbol.end()) {
+		throw assembly_exception("Unknown label: " + name);
+	}
+	return it->second;
+}
+
+std::map<std::string, int> const& assembly::allocation() const {
+	return allocated;
+}
+
+std::set<cl_ulong> assembly::label_references() const {
+	std::set<cl_ulong> references;
+	for(auto const& it: unlinked) {
+		references.insert(it.first);
+	}
+	return references;
+}
+
 void assembly::parse(std::string program_str) {
 	// patterns (descending priority):
 	// comment: //.*
 	// label: [\\w]+:
 	// a->b, a.x -> c.i, $ias -> a.b: [\\w.$]+\\s*->\\s*[\\w.]+)
 	// (askdj, asd) -> a.b: \\(\\s*[\\w.]+\\s*,\\s*[\\w.]+\\s*\\)\\s*->\\s*[\\w.]+
-	std::regex pattern("(//.*)"
+	static std::regex const pattern("(//.*)"
 	                   "|([\\w]+)[\\s]*:"
 	                   "|(([\\w.$@]+)\\s*->\\s*([\\w.@]+))"
 	                   "|((\\(\\s*[\\w.]+\\s*,\\s*[\\w.]+\\s*\\))\\s*->\\s*([\\w.@]+))");
 	
-	std::sregex_iterator it(program_str.begin(), program_str.end(), pattern);
-	std::sregex_iterator end;
-	for(; it != end; ++it) {
-		std::smatch match = *it;
-		//std::cout << match[0] << std::endl;
-		if(match.length(1) > 0) {
-			// comment
-			// std::cout << match[1] << std::endl;
-		} else if(match.length(2) > 0) {
-			push_label(match[2]);
-		} else if(match.length(3) > 0) {
-			push_move(match[4], match[5]);
-		} else if(match.length(6) > 0) {
-			push_move(match[7], match[8]);
+	// Each line is parsed as soon as the preprocessor expands it.
+	auto parse_line = [&](std::string const& line) {
+		std::sregex_iterator it(line.begin(), line.end(), pattern);
+		std::sregex_iterator end;
+		for(; it != end; ++it) {
+			std::smatch match = *it;
+			//std::cout << match[0] << std::endl;
+			if(match.length(1) > 0) {
+				// comment
+				// std::cout << match[1] << std::endl;
+			} else if(match.length(2) > 0) {
+				push_label(match[2]);
+			} else if(match.length(3) > 0) {
+				push_move(match[4], match[5]);
+			} else if(match.length(6) > 0) {
+				push_move(match[7], match[8]);
+			}
 		}
+	};
+	try {
+		source.run(program_str, parse_line);
+	} catch(preprocessor_exception &e) {
+		throw assembly_exception(e.what());
 	}
+}
 
+void assembly::define(std::string const& definition) {
+	try {
+		source.define(definition);
+	} catch(preprocessor_exception &e) {
+		throw assembly_exception(e.what());
+	}
 }
 
 } // namespace scad
@@ -22,6 +22,7 @@
 #include <iterator>
 #include <regex>
 #include <map>
+#include <set>
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #define __CL_ENABLE_EXCEPTIONS
@@ -30,6 +31,8 @@
 #include "common/instructions.h"
 #include "unit_types.hpp"
 #include "description.hpp"
+#include "allocate.hpp"
+#include "preprocess.hpp"
 
 namespace scad {
 
@@ -44,7 +47,7 @@ class assembly {
 	std::map <std::string, struct scad_buffer_address> ouput_buffers = {};
 	
 	std::map<std::string, enum scad_lsu_opcode> lsu_op_strings = {
-		{"st", SCAD_LSU_STORE}, {"ld", SCAD_LSU_LOAD},
+		{"st", SCAD_LSU_STORE}, {"ld", SCAD_LSU_LOAD}, {"lda", SCAD_LSU_LOAD_ADDRESS},
 	};
 	
 	std::map<std::string, enum scad_pu_opcode> pu_op_strings = {
@@ -63,6 +66,14 @@ class assembly {
 	std::map<std::string, int> symbol;
 	// instructions that still require the localion of their symbols
 	std::map<int, std::string> unlinked;
+	// instructions that still require physical units for virtual ones
+	virtual_references virtual_units;
+	std::map<std::string, int> allocated;
+	// Macros and symbols, kept over multiple parse() calls.
+	preprocessor source;
+	
+	std::pair<bool, struct scad_buffer_address> parse_virtual_address(std::string unit, std::string buffer,
+	                                                                  bool input, std::string addr_str);
 	
 	void push_label(std::string label);
 	std::pair<bool, scad_data> parse_immediate(std::string immediate_string);
@@ -76,6 +87,18 @@ class assembly {
 		
 		std::vector<struct scad_instruction> build();
 		
+		// Instruction addresses of all labels, where basic blocks start.
+		std::set<cl_ulong> labels() const;
+		// Instruction address of a label, throws assembly_exception if unknown.
+		cl_ulong label(std::string const& name) const;
+		// Instructions that move a label as immediate value.
+		std::set<cl_ulong> label_references() const;
+		// Physical unit number of every virtual unit, after build().
+		std::map<std::string, int> const& allocation() const;
+		
+		// Symbol for $NAME and expressions, see preprocessor::define.
+		void define(std::string const& definition);
+		
 		void parse(std::string program_str);
 };
 
@@ -0,0 +1,333 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+#include "util.hpp"
+#include "unit_types.hpp"
+#include "description.hpp"
+#include "compiled_description.hpp"
+
+namespace scad {
+
+// "SCADC", then the version of the layout.
+static char const magic[8] = {'S', 'C', 'A', 'D', 'C', '\0', '\0', '\3'};
+static uint32_t const empty_slot = 0xffffffff;
+// Displacements tried per bucket before giving up.
+static uint32_t const max_displacement = 1 << 20;
+
+static uint64_t name_hash(char const *name, size_t length, bool input, uint32_t seed) {
+	uint64_t hash = 0xcbf29ce484222325ull ^ (seed * 0x9e3779b97f4a7c15ull) ^ input;
+	for(size_t i = 0; i < length; i++) {
+		hash = (hash ^ (unsigned char) name[i]) * 0x100000001b3ull;
+	}
+	// FNV-1a leaves the high bits poorly mixed for short names.
+	hash ^= hash >> 29;
+	hash *= 0xbf58476d1ce4e5b9ull;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+// Unit buffers come from unit_types.hpp, not the file, so tools built with
+// other tables must not use it.
+static std::string tables_hash() {
+	std::string tables;
+	for(auto const& type: unit_type_buffers) {
+		tables += type.first + ":";
+		for(auto const& buffers: {type.second.first, type.second.second}) {
+			for(auto const& buffer: buffers) {
+				tables += buffer.first + "=" + std::to_string(buffer.second) + ",";
+			}
+			tables += ";";
+		}
+	}
+	return content_hash(tables);
+}
+
+std::string compiled_description::path(std::string const& description_filename) {
+	std::string base = description_filename;
+	if(base.size() >= 4 && base.compare(base.size() - 4, 4, ".xml") == 0) {
+		base.erase(base.size() - 4);
+	}
+	return base + ".scadc";
+}
+
+void compiled_description::stamp(std::string const& filename, uint64_t &size, int64_t &mtime) {
+	struct stat info;
+	if(stat(filename.c_str(), &info)) {
+		size = 0;
+		mtime = 0;
+		return;
+	}
+	size = info.st_size;
+	mtime = (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+std::string compiled_description::serialize(processor_description const& proc) {
+	std::string strings;
+	std::map<std::string, uint32_t> string_offsets;
+	auto intern = [&](std::string const& str) {
+		auto it = string_offsets.find(str);
+		if(it != string_offsets.end()) {
+			return it->second;
+		}
+		uint32_t offset = strings.size();
+		uint32_t length = str.size();
+		strings.append((char const*) &length, sizeof(length));
+		strings.append(str);
+		// Terminated and padded to keep lengths aligned.
+		strings.append(4 - str.size() % 4, '\0');
+		string_offsets[str] = offset;
+		return offset;
+	};
+	
+	header head;
+	std::memset(&head, 0, sizeof(head));
+	std::memcpy(head.magic, magic, sizeof(magic));
+	std::memcpy(head.xml_hash, proc.xml_hash.data(), std::min(proc.xml_hash.size(), sizeof(head.xml_hash)));
+	std::string tables = tables_hash();
+	std::memcpy(head.tables_hash, tables.data(), std::min(tables.size(), sizeof(head.tables_hash)));
+	head.xml_size = proc.xml_size;
+	head.xml_mtime = proc.xml_mtime;
+	head.name = intern(proc.name);
+	head.buffer_size = proc.buffer_size;
+	head.trace_sample = proc.trace_sample;
+	head.address_width = proc.address_width;
+	head.interconnect_name = intern(proc.interconnect->name);
+	head.interconnect_implementation = intern(proc.interconnect->implementation);
+	head.interconnect_size = proc.interconnect->size;
+	
+	// proc.units and the parameters are maps, so both come out sorted.
+	std::vector<unit> units;
+	std::vector<parameter> parameters;
+	std::vector<std::pair<std::pair<std::string, bool>, buffer>> named_buffers;
+	for(auto const& entry: proc.units) {
+		auto const& description = entry.second;
+		unit record = {intern(description->name), intern(description->type), intern(description->implementation),
+		               description->number, (uint32_t) parameters.size(), (uint32_t) description->parameters.size()};
+		units.push_back(record);
+		for(auto const& param: description->parameters) {
+			parameters.push_back({intern(param.first), intern(param.second)});
+		}
+		for(bool input: {true, false}) {
+			for(auto const& named: input ? description->input_buffers : description->output_buffers) {
+				std::string name = description->name + "@" + named.first;
+				named_buffers.push_back({{name, input}, {intern(name), named.second.unit, named.second.buffer, input, {0, 0, 0}}});
+			}
+		}
+	}
+	std::sort(named_buffers.begin(), named_buffers.end(),
+	          [](std::pair<std::pair<std::string, bool>, buffer> const& a,
+	             std::pair<std::pair<std::string, bool>, buffer> const& b) {
+		return a.first < b.first;
+	});
+	
+	// Hash and displace: keys go to buckets, the largest bucket first
+	// looks for a displacement that puts all its keys in free slots.
+	uint32_t count = named_buffers.size();
+	uint32_t bucket_count = std::max(1u, count);
+	uint32_t slot_count = std::max(1u, count + count / 4);
+	std::vector<std::vector<uint32_t>> bucket_keys(bucket_count);
+	for(uint32_t i = 0; i < count; i++) {
+		auto const& key = named_buffers[i].first;
+		bucket_keys[name_hash(key.first.data(), key.first.size(), key.second, 0) % bucket_count].push_back(i);
+	}
+	std::vector<uint32_t> order(bucket_count);
+	for(uint32_t i = 0; i < bucket_count; i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return bucket_keys[a].size() > bucket_keys[b].size();
+	});
+	std::vector<uint32_t> buckets(bucket_count, 0);
+	std::vector<uint32_t> slots(slot_count, empty_slot);
+	for(uint32_t bucket: order) {
+		if(bucket_keys[bucket].empty()) {
+			break;
+		}
+		for(uint32_t displacement = 0;; displacement++) {
+			if(displacement == max_displacement) {
+				throw description_exception("No perfect hash for the buffers of processor " + proc.name);
+			}
+			std::vector<uint32_t> taken;
+			for(uint32_t i: bucket_keys[bucket]) {
+				auto const& key = named_buffers[i].first;
+				uint32_t slot = name_hash(key.first.data(), key.first.size(), key.second, displacement + 1) % slot_count;
+				if(slots[slot] != empty_slot || std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+					break;
+				}
+				taken.push_back(slot);
+			}
+			if(taken.size() == bucket_keys[bucket].size()) {
+				for(size_t i = 0; i < taken.size(); i++) {
+					slots[taken[i]] = bucket_keys[bucket][i];
+				}
+				buckets[bucket] = displacement;
+				break;
+			}
+		}
+	}
+	
+	uint32_t offset = sizeof(header);
+	auto place = [&](uint32_t &at, uint32_t &count_field, size_t entries, size_t entry_size) {
+		at = offset;
+		count_field = entries;
+		offset += entries * entry_size;
+	};
+	place(head.units, head.unit_count, units.size(), sizeof(unit));
+	place(head.parameters, head.parameter_count, parameters.size(), sizeof(parameter));
+	place(head.buffers, head.buffer_count, named_buffers.size(), sizeof(buffer));
+	place(head.buckets, head.bucket_count, buckets.size(), sizeof(uint32_t));
+	place(head.slots, head.slot_count, slots.size(), sizeof(uint32_t));
+	place(head.strings, head.strings_size, strings.size(), 1);
+	
+	std::string content((char const*) &head, sizeof(head));
+	content.append((char const*) units.data(), units.size() * sizeof(unit));
+	content.append((char const*) parameters.data(), parameters.size() * sizeof(parameter));
+	for(auto const& named: named_buffers) {
+		content.append((char const*) &named.second, sizeof(buffer));
+	}
+	content.append((char const*) buckets.data(), buckets.size() * sizeof(uint32_t));
+	content.append((char const*) slots.data(), slots.size() * sizeof(uint32_t));
+	content.append(strings);
+	return content;
+}
+
+compiled_description::compiled_description(std::string const& filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		throw description_exception("Could not open '" + filename + "': " + std::strerror(errno));
+	}
+	struct stat info;
+	if(fstat(fd, &info) || info.st_size < (off_t) sizeof(header)) {
+		close(fd);
+		throw description_exception("Compiled description '" + filename + "' is truncated");
+	}
+	size = info.st_size;
+	data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		data = nullptr;
+		throw description_exception("Could not map '" + filename + "': " + std::strerror(errno));
+	}
+	
+	// Checked once here, so lookups need no bounds checks.
+	header const& h = head();
+	auto fits = [&](uint32_t at, uint64_t entries, size_t entry_size) {
+		return at >= sizeof(header) && at % 4 == 0 && at + entries * entry_size <= size;
+	};
+	bool valid = std::memcmp(h.magic, magic, sizeof(magic)) == 0
+	             && fits(h.units, h.unit_count, sizeof(unit))
+	             && fits(h.parameters, h.parameter_count, sizeof(parameter))
+	             && fits(h.buffers, h.buffer_count, sizeof(buffer))
+	             && fits(h.buckets, h.bucket_count, sizeof(uint32_t))
+	             && fits(h.slots, h.slot_count, sizeof(uint32_t))
+	             && fits(h.strings, h.strings_size, 1)
+	             && h.bucket_count > 0 && h.slot_count > 0;
+	for(uint32_t i = 0; valid && i < h.slot_count; i++) {
+		uint32_t slot = table<uint32_t>(h.slots)[i];
+		valid = slot == empty_slot || slot < h.buffer_count;
+	}
+	for(uint32_t i = 0; valid && i < h.unit_count; i++) {
+		unit const& u = unit_at(i);
+		valid = (uint64_t) u.first_parameter + u.parameter_count <= h.parameter_count;
+	}
+	// Every string offset is checked when the string is read.
+	if(!valid) {
+		munmap((void*) data, size);
+		data = nullptr;
+		throw description_exception("'" + filename + "' is no compiled description of this version");
+	}
+}
+
+compiled_description::~compiled_description() {
+	if(data) {
+		munmap((void*) data, size);
+	}
+}
+
+compiled_description::header const& compiled_description::head() const {
+	return *static_cast<header const*>(data);
+}
+
+template<typename T> T const* compiled_description::table(uint32_t offset) const {
+	return reinterpret_cast<T const*>(static_cast<char const*>(data) + offset);
+}
+
+std::string compiled_description::xml_hash() const {
+	return std::string(head().xml_hash, sizeof(head().xml_hash));
+}
+
+bool compiled_description::current(uint64_t xml_size, int64_t xml_mtime) const {
+	std::string tables = tables_hash();
+	return xml_mtime != 0 && head().xml_size == xml_size && head().xml_mtime == xml_mtime
+	       && std::string(head().tables_hash, sizeof(head().tables_hash)) == tables;
+}
+
+std::string compiled_description::string(uint32_t offset) const {
+	header const& h = head();
+	if(offset % 4 != 0 || (uint64_t) offset + sizeof(uint32_t) > h.strings_size) {
+		throw description_exception("Compiled description has a broken string table");
+	}
+	uint32_t length = *table<uint32_t>(h.strings + offset);
+	if((uint64_t) offset + sizeof(uint32_t) + length > h.strings_size) {
+		throw description_exception("Compiled description has a broken string table");
+	}
+	return std::string(table<char>(h.strings + offset + sizeof(uint32_t)), length);
+}
+
+uint32_t compiled_description::unit_count() const {
+	return head().unit_count;
+}
+
+compiled_description::unit const& compiled_description::unit_at(uint32_t index) const {
+	return table<unit>(head().units)[index];
+}
+
+compiled_description::parameter const& compiled_description::parameter_at(uint32_t index) const {
+	return table<parameter>(head().parameters)[index];
+}
+
+bool compiled_description::find(char const *name, size_t length, bool input, struct scad_buffer_address &address) const {
+	header const& h = head();
+	uint32_t bucket = name_hash(name, length, input, 0) % h.bucket_count;
+	uint32_t displacement = table<uint32_t>(h.buckets)[bucket];
+	uint32_t slot = table<uint32_t>(h.slots)[name_hash(name, length, input, displacement + 1) % h.slot_count];
+	if(slot == empty_slot) {
+		return false;
+	}
+	
+	// Names not in the table hash to some slot too.
+	buffer const& found = table<buffer>(h.buffers)[slot];
+	if(found.input != input || found.name % 4 != 0 || (uint64_t) found.name + sizeof(uint32_t) + length > h.strings_size
+	   || *table<uint32_t>(h.strings + found.name) != length
+	   || std::memcmp(table<char>(h.strings + found.name + sizeof(uint32_t)), name, length) != 0) {
+		return false;
+	}
+	address.unit = found.unit;
+	address.buffer = found.buffer;
+	return true;
+}
+
+} // namespace scad
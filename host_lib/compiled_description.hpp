@@ -0,0 +1,129 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_COMPILED_DESCRIPTION_HPP
+#define SCAD_COMPILED_DESCRIPTION_HPP
+
+#include <cstdint>
+#include <string>
+#include <map>
+
+#include "common/instructions.h"
+
+namespace scad {
+
+class processor_description;
+
+// Processor description in a flat binary file (.scadc next to the .xml),
+// mapped into memory instead of parsed. It holds the size and modification
+// time of the XML it was compiled from and a hash of the unit types' buffer
+// tables, tools use it without reading the XML only while both match.
+//
+// Layout, native byte order, offsets in bytes from the start of the file:
+//   header
+//   units       sorted by name
+//   parameters  per unit, sorted by key
+//   buffers     "unit@buffer" names sorted, with direction and address
+//   index       perfect hash of (name, direction) to a buffer: per bucket a
+//               displacement, per slot a buffer or empty
+//   strings     length (uint32_t), characters, '\0'
+class compiled_description {
+	public:
+		struct header {
+			char magic[8];
+			char xml_hash[16];
+			char tables_hash[16];
+			uint64_t xml_size;
+			int64_t xml_mtime;
+			uint32_t name;
+			int32_t buffer_size;
+			int32_t trace_sample;
+			int32_t address_width;
+			uint32_t interconnect_name;
+			uint32_t interconnect_implementation;
+			int32_t interconnect_size;
+			uint32_t unit_count, units;
+			uint32_t parameter_count, parameters;
+			uint32_t buffer_count, buffers;
+			uint32_t bucket_count, buckets;
+			uint32_t slot_count, slots;
+			uint32_t strings, strings_size;
+		};
+		
+		struct unit {
+			uint32_t name;
+			uint32_t type;
+			uint32_t implementation;
+			int32_t number;
+			uint32_t first_parameter;
+			uint32_t parameter_count;
+		};
+		
+		struct parameter {
+			uint32_t key;
+			uint32_t value;
+		};
+		
+		struct buffer {
+			uint32_t name;
+			uint16_t unit;
+			uint16_t buffer;
+			uint8_t input;
+			uint8_t reserved[3];
+		};
+	
+	private:
+		void const *data = nullptr;
+		size_t size = 0;
+		
+		template<typename T> T const* table(uint32_t offset) const;
+	
+	public:
+		// basic.xml -> basic.scadc
+		static std::string path(std::string const& description_filename);
+		
+		// Size and modification time in nanoseconds of a file, 0 if it is missing.
+		static void stamp(std::string const& filename, uint64_t &size, int64_t &mtime);
+		
+		// File content for proc, with the hash and stamp of its XML.
+		static std::string serialize(processor_description const& proc);
+		
+		// Maps the file. Throws description_exception if it cannot be read or
+		// is no compiled description of this version.
+		explicit compiled_description(std::string const& filename);
+		~compiled_description();
+		compiled_description(compiled_description const&) = delete;
+		compiled_description& operator=(compiled_description const&) = delete;
+		
+		header const& head() const;
+		std::string xml_hash() const;
+		
+		// Compiled from an XML of this size and time, with these unit types.
+		bool current(uint64_t xml_size, int64_t xml_mtime) const;
+		
+		// String of the string table.
+		std::string string(uint32_t offset) const;
+		
+		uint32_t unit_count() const;
+		unit const& unit_at(uint32_t index) const;
+		parameter const& parameter_at(uint32_t index) const;
+		
+		// Address of "unit@buffer" with length characters at name, constant
+		// time and without allocation. False if there is no such buffer.
+		bool find(char const *name, size_t length, bool input, struct scad_buffer_address &address) const;
+};
+
+} // namespace scad
+
+#endif /* SCAD_COMPILED_DESCRIPTION_HPP */
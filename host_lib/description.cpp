@@ -22,12 +22,15 @@
 #include <iterator>
 #include <regex>
 #include <map>
+#include <cstdint>
 
 #include "pugixml.hpp"
 
 #include "common/instructions.h"
+#include "util.hpp"
 #include "unit_types.hpp"
 #include "description.hpp"
+#include "compiled_description.hpp"
 
 
 namespace scad {
@@ -46,24 +49,65 @@ unit_description::unit_description(std::string name, std::string type,
 	auto outputs = unit_buffers.second;
 	
 	for(std::pair<std::string, int> it: inputs) {
-		input_buffers[it.first] = (struct scad_buffer_address) {.unit = (cl_uchar) number, .buffer = (cl_uchar) it.second};
+		input_buffers[it.first] = (struct scad_buffer_address) {.unit = (scad_address_part) number, .buffer = (scad_address_part) it.second};
 	}
 	
 	for(std::pair<std::string, int> it: outputs) {
-		output_buffers[it.first] = (struct scad_buffer_address) {.unit = (cl_uchar) number, .buffer = (cl_uchar) it.second};
+		output_buffers[it.first] = (struct scad_buffer_address) {.unit = (scad_address_part) number, .buffer = (scad_address_part) it.second};
 	}
 }
 
 processor_description::processor_description(std::string filename) {
-	pugi::xml_document doc;
+	// Taken before reading, a change while reading makes the stamp outdated.
+	compiled_description::stamp(filename, xml_size, xml_mtime);
+	
+	// A missing or outdated compiled description is not an error, the XML
+	// is parsed instead.
+	try {
+		auto mapped = std::make_shared<compiled_description const>(compiled_description::path(filename));
+		if(mapped->current(xml_size, xml_mtime)) {
+			auto const& head = mapped->head();
+			xml_hash = mapped->xml_hash();
+			name = mapped->string(head.name);
+			buffer_size = head.buffer_size;
+			trace_sample = head.trace_sample;
+			address_width = head.address_width;
+			interconnect = std::make_shared<interconnect_description>(mapped->string(head.interconnect_name),
+			                                                          mapped->string(head.interconnect_implementation),
+			                                                          head.interconnect_size);
+			for(uint32_t i = 0; i < mapped->unit_count(); i++) {
+				auto const& unit = mapped->unit_at(i);
+				std::map<std::string, std::string> parameters;
+				for(uint32_t p = unit.first_parameter; p < unit.first_parameter + unit.parameter_count; p++) {
+					parameters[mapped->string(mapped->parameter_at(p).key)] = mapped->string(mapped->parameter_at(p).value);
+				}
+				std::string unit_name = mapped->string(unit.name);
+				units[unit_name] = std::make_shared<unit_description>(unit_name, mapped->string(unit.type),
+				                                                      mapped->string(unit.implementation),
+				                                                      unit.number, parameters);
+			}
+			compiled = mapped;
+			validate(filename);
+			return;
+		}
+	} catch(description_exception& e) {
+		units.clear();
+	}
 	
 	std::ifstream stream(filename);
-	pugi::xml_parse_result result = doc.load(stream);
+	std::string content((std::istreambuf_iterator<char>(stream)),
+	                    std::istreambuf_iterator<char>());
+	xml_hash = content_hash(content);
+	
+	pugi::xml_document doc;
+	pugi::xml_parse_result result = doc.load_string(content.c_str());
 	
 	pugi::xml_node processor_node = doc.child("processor");
 	
 	name = processor_node.attribute("name").value();
 	buffer_size = processor_node.attribute("buffersize").as_int();
+	trace_sample = processor_node.attribute("trace").as_int(0);
+	address_width = processor_node.attribute("addresswidth").as_int(0);
 	//std::cout << std::endl;
 	//std::cout << "processor '" << name << "' with buffer size: " << buffer_size << std::endl;
 	
@@ -106,6 +150,118 @@ processor_description::processor_description(std::string filename) {
 	if(!interconnect_found) {
 		throw description_exception("No interconnect given in file: " + filename);
 	}
+	
+	validate(filename);
+}
+
+void processor_description::validate(std::string const& filename) {
+	std::map<int, std::string> numbers;
+	for(auto const& unit: units) {
+		int number = unit.second->number;
+		// The highest number is the unit of the null address.
+		if(number < 0 || number >= 65535) {
+			throw description_exception("Unit '" + unit.first + "' has number " + std::to_string(number)
+			                            + ", valid are 0 to 65534 in file: " + filename);
+		}
+		if(numbers.count(number)) {
+			throw description_exception("Units '" + numbers[number] + "' and '" + unit.first
+			                            + "' both have number " + std::to_string(number) + " in file: " + filename);
+		}
+		if(unit.second->type == "cu" && number != 0) {
+			throw description_exception("Control unit '" + unit.first + "' needs number 0 in file: " + filename);
+		}
+		numbers[number] = unit.first;
+	}
+	if(!numbers.count(0) || units.at(numbers[0])->type != "cu") {
+		throw description_exception("No control unit (type cu) with number 0 in file: " + filename);
+	}
+	
+	// Banyan networks have a power of two ports, at least 2.
+	int needed = numbers.rbegin()->first + 1;
+	bool banyan = interconnect->implementation.compare(0, 19, "interconnect_banyan") == 0;
+	auto power_of_two = [](int size) {
+		int ports = 2;
+		while(ports < size) {
+			ports *= 2;
+		}
+		return ports;
+	};
+	if(banyan) {
+		needed = power_of_two(needed);
+	}
+	
+	if(interconnect->size <= 0) {
+		interconnect->size = needed;
+	} else if(interconnect->size < needed) {
+		throw description_exception("Interconnect size " + std::to_string(interconnect->size) + " is too small for unit '"
+		                            + numbers.rbegin()->second + "' with number "
+		                            + std::to_string(numbers.rbegin()->first) + ", it needs "
+		                            + std::to_string(needed) + " in file: " + filename);
+	} else if(banyan && power_of_two(interconnect->size) != interconnect->size) {
+		warnings.push_back("interconnect size " + std::to_string(interconnect->size) + " is no power of two, using "
+		                   + std::to_string(power_of_two(interconnect->size)));
+		interconnect->size = power_of_two(interconnect->size);
+	}
+	
+	// Ports are numbered below the null unit, 8 bit addresses are the default
+	// as long as they are enough.
+	if(address_width == 0) {
+		address_width = interconnect->size <= 255 ? 8 : 16;
+	}
+	if(address_width != 8 && address_width != 16) {
+		throw description_exception("Address width " + std::to_string(address_width)
+		                            + " is not supported, valid are 8 and 16 in file: " + filename);
+	}
+	int ports = (1 << address_width) - 1;
+	if(interconnect->size > ports) {
+		throw description_exception("Interconnect size " + std::to_string(interconnect->size) + " needs more than "
+		                            + std::to_string(address_width) + " bit addresses (at most "
+		                            + std::to_string(ports) + " ports) in file: " + filename);
+	}
+	
+	// Packed instructions have a bit less for buffers, all ones is null.
+	int buffers = (1 << SCAD_PACKED_BUFFER_BITS(address_width)) - 1;
+	for(auto const& unit: units) {
+		for(bool input: {true, false}) {
+			for(auto const& buffer: input ? unit.second->input_buffers : unit.second->output_buffers) {
+				if(buffer.second.buffer >= buffers) {
+					throw description_exception("Buffer '" + unit.first + "@" + buffer.first + "' has number "
+					                            + std::to_string(buffer.second.buffer) + ", " + std::to_string(address_width)
+					                            + " bit addresses allow 0 to " + std::to_string(buffers - 1)
+					                            + " in file: " + filename);
+				}
+			}
+		}
+	}
+	
+	if(interconnect->size > needed) {
+		warnings.push_back("interconnect has " + std::to_string(interconnect->size) + " ports, "
+		                   + std::to_string(needed) + " are enough");
+	}
+	
+	std::string unused;
+	for(int number = 0; number < numbers.rbegin()->first; number++) {
+		if(!numbers.count(number)) {
+			unused += (unused == "" ? "" : ", ") + std::to_string(number);
+		}
+	}
+	if(unused != "") {
+		warnings.push_back("no unit has number " + unused + ", the interconnect ports are unused");
+	}
+}
+
+std::string processor_description::buffer_name(struct scad_buffer_address address, bool input) const {
+	if(address.unit == SCAD_ADDRESS_NULL && address.buffer == SCAD_ADDRESS_NULL) {
+		return "null";
+	}
+	for(auto const& unit: units) {
+		for(auto const& buffer: input ? unit.second->input_buffers : unit.second->output_buffers) {
+			if(buffer.second.unit == address.unit && buffer.second.buffer == address.buffer) {
+				return unit.second->name + "@" + buffer.first;
+			}
+		}
+	}
+	return std::to_string(address.unit) + "@" + std::to_string(address.buffer);
 }
 
 
@@ -19,6 +19,7 @@
 #include <string>
 #include <list>
 #include <map>
+#include <memory>
 
 #include "pugixml.hpp"
 
@@ -27,6 +28,8 @@
 
 namespace scad {
 
+class compiled_description;
+
 class description_exception : public std::runtime_error {
 	public: using runtime_error::runtime_error;
 };
@@ -62,11 +65,38 @@ class processor_description {
 		
 		int buffer_size;
 		
+		// Every TRACE_SAMPLE-th event is traced, 0 disables tracing.
+		int trace_sample;
+		
+		// Bits of unit and buffer numbers on the device, 8 or 16. Chosen by
+		// validate() unless the description sets addresswidth.
+		int address_width;
+		
 		std::shared_ptr<interconnect_description> interconnect;
 		
 		std::map <std::string, std::shared_ptr<unit_description>> units;
 		
+		// content_hash, size and modification time (ns) of the XML.
+		std::string xml_hash;
+		uint64_t xml_size = 0;
+		int64_t xml_mtime = 0;
+		// Mapped .scadc if it was compiled from this XML, nullptr otherwise.
+		std::shared_ptr<compiled_description const> compiled;
+		
+		// Valid, but wasteful parts of the description.
+		std::vector<std::string> warnings;
+		
+		// Loads the compiled description next to the XML instead of reading
+		// the XML if it is up to date.
 		processor_description(std::string filename);
+		
+		// Name of a buffer like in assembly: "pu0@in1", "null".
+		std::string buffer_name(struct scad_buffer_address address, bool input) const;
+		
+	private:
+		// Checks unit numbers against the interconnect and the address width,
+		// sets the size and the width if the description gives none.
+		void validate(std::string const& filename);
 };
 
 
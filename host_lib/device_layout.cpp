@@ -0,0 +1,139 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <cstring>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "device_layout.hpp"
+
+namespace scad {
+
+// Fields in declaration order, native byte order, like the packed structs.
+static unsigned char *put(unsigned char *out, void const *value, size_t size) {
+	std::memcpy(out, value, size);
+	return out + size;
+}
+
+static unsigned char const *get(unsigned char const *in, void *value, size_t size) {
+	std::memcpy(value, in, size);
+	return in + size;
+}
+
+static unsigned char const *get_address(unsigned char const *in, struct scad_buffer_address &address, int address_width) {
+	if(address_width == 8) {
+		cl_uchar unit, buffer;
+		in = get(in, &unit, sizeof(unit));
+		in = get(in, &buffer, sizeof(buffer));
+		// The null address keeps its meaning.
+		address.unit = unit == (cl_uchar) -1 ? SCAD_ADDRESS_NULL : unit;
+		address.buffer = buffer == (cl_uchar) -1 ? SCAD_ADDRESS_NULL : buffer;
+		return in;
+	}
+	in = get(in, &address.unit, sizeof(address.unit));
+	return get(in, &address.buffer, sizeof(address.buffer));
+}
+
+size_t device_instruction_size(int address_width) {
+	// op, union of from and immediate, to
+	return sizeof(enum scad_opcodes) + sizeof(scad_data) + 2 * (address_width / 8);
+}
+
+size_t device_trace_event_size(int address_width) {
+	// cycle, value, from, to, kind
+	return sizeof(cl_ulong) + sizeof(scad_data) + 4 * (address_width / 8) + sizeof(cl_uchar);
+}
+
+static uint64_t pack_buffer(scad_address_part buffer, int address_width) {
+	uint64_t mask = (1ull << SCAD_PACKED_BUFFER_BITS(address_width)) - 1;
+	if(buffer == SCAD_ADDRESS_NULL) {
+		return mask;
+	}
+	if(buffer >= mask) {
+		throw layout_exception("Buffer " + std::to_string(buffer) + " does not fit the "
+		                       + std::to_string(SCAD_PACKED_BUFFER_BITS(address_width)) + " bits of packed instructions");
+	}
+	return buffer;
+}
+
+static uint64_t pack_unit(scad_address_part unit, int address_width) {
+	return unit == SCAD_ADDRESS_NULL ? (1ull << address_width) - 1 : unit;
+}
+
+std::vector<unsigned char> device_program(std::vector<struct scad_instruction> const& program, int address_width) {
+	size_t word_size = address_width / 2;
+	size_t pool_offset = SCAD_PACKED_POOL_OFFSET(address_width, program.size());
+	uint64_t long_index = SCAD_PACKED_IMMEDIATE_LONG(address_width);
+	
+	// Equal immediates, like the targets of a loop's branches, share an entry.
+	// Once the pool is full, further ones are stored after it by address.
+	std::vector<scad_data> pool;
+	std::map<cl_ulong, uint64_t> pool_index;
+	
+	// Ends with an invalid instruction, which is all zeros.
+	std::vector<unsigned char> result(pool_offset, 0);
+	for(size_t i = 0; i < program.size(); i++) {
+		struct scad_instruction const& instr = program[i];
+		// Moves to pc leave the target unset.
+		struct scad_buffer_address to = instr.op == SCAD_MOVE_PC
+		                                ? (struct scad_buffer_address) {SCAD_ADDRESS_NULL, SCAD_ADDRESS_NULL} : instr.to;
+		uint64_t word = (uint64_t) instr.op
+		                | pack_buffer(to.buffer, address_width) << SCAD_PACKED_TO_BUFFER(address_width)
+		                | pack_unit(to.unit, address_width) << SCAD_PACKED_TO_UNIT(address_width);
+		if(instr.op == SCAD_MOVE) {
+			word |= pack_buffer(instr.from.buffer, address_width) << SCAD_PACKED_FROM_BUFFER(address_width)
+			        | pack_unit(instr.from.unit, address_width) << SCAD_PACKED_FROM_UNIT(address_width);
+		} else if(instr.op == SCAD_MOVE_IMMEDIATE || instr.op == SCAD_MOVE_PC) {
+			auto it = pool_index.find(instr.immediate.integer);
+			uint64_t index = long_index;
+			if(it != pool_index.end()) {
+				index = it->second;
+			} else if(pool.size() < long_index) {
+				index = pool.size();
+				pool_index[instr.immediate.integer] = index;
+				pool.push_back(instr.immediate);
+			} else {
+				pool.resize(long_index + i + 1);
+				pool[long_index + i] = instr.immediate;
+			}
+			word |= index << SCAD_PACKED_IMMEDIATE(address_width);
+		}
+		if(address_width == 8) {
+			cl_uint packed = word;
+			put(&result[i * word_size], &packed, sizeof(packed));
+		} else {
+			put(&result[i * word_size], &word, sizeof(word));
+		}
+	}
+	result.insert(result.end(), (unsigned char const*) pool.data(),
+	              (unsigned char const*) (pool.data() + pool.size()));
+	return result;
+}
+
+std::vector<scad_trace_event> host_trace_events(unsigned char const *events, size_t count, int address_width) {
+	std::vector<scad_trace_event> result(count);
+	size_t size = device_trace_event_size(address_width);
+	for(size_t i = 0; i < count; i++) {
+		scad_trace_event &event = result[i];
+		unsigned char const *in = get(events + i * size, &event.cycle, sizeof(event.cycle));
+		in = get(in, &event.value, sizeof(event.value));
+		in = get_address(in, event.from, address_width);
+		in = get_address(in, event.to, address_width);
+		get(in, &event.kind, sizeof(event.kind));
+	}
+	return result;
+}
+
+} // namespace scad
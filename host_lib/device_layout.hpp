@@ -0,0 +1,48 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_DEVICE_LAYOUT_HPP
+#define SCAD_DEVICE_LAYOUT_HPP
+
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+#include "common/instructions.h"
+
+namespace scad {
+
+class layout_exception : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+// The host tools use 16 bit unit and buffer numbers, a device those of its
+// description (processor_description::address_width). Structures that cross
+// to the device are packed in its layout.
+
+// Size of struct scad_instruction, to compare packed programs with.
+size_t device_instruction_size(int address_width);
+size_t device_trace_event_size(int address_width);
+
+// Program as the control unit of the device reads it, packed words and the
+// pool of immediates described in instructions.h. Throws layout_exception
+// for buffer numbers the words have no room for.
+std::vector<unsigned char> device_program(std::vector<struct scad_instruction> const& program, int address_width);
+
+// Trace events written by the trace unit of the device, count of them.
+std::vector<scad_trace_event> host_trace_events(unsigned char const *events, size_t count, int address_width);
+
+} // namespace scad
+
+#endif /* SCAD_DEVICE_LAYOUT_HPP */
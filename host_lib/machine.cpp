@@ -12,6 +12,8 @@
 //   See the License for the specific language governing permissions and
 //   limitations under the License.
 
+#include <algorithm>
+
 #include "machine.hpp"
 
 #include "util.hpp"
@@ -65,6 +67,29 @@ cl::Buffer machine::buffer(cl_mem_flags flags, size_t size) {
 
 cl::Buffer machine::buffer(size_t size) { return buffer(CL_MEM_READ_WRITE, size); }
 
+size_t machine::stream_padded_length(size_t length) {
+	// At least one burst, memory stream units always access one.
+	length = std::max(length, (size_t) 1);
+	return (length + SCAD_STREAM_BURST_WORDS - 1)
+	       / SCAD_STREAM_BURST_WORDS * SCAD_STREAM_BURST_WORDS;
+}
+
+std::vector<scad_unit_counters> machine::counters(size_t unit_count, cl_uint timeout) {
+	if(!has_component("scad_counters")) {
+		return {};
+	}
+	
+	std::vector<scad_unit_counters, AlignedAllocator<scad_unit_counters>>
+		snapshot(2 * unit_count + 1, scad_unit_counters());
+	auto snapshot_buff = buffer_for(CL_MEM_WRITE_ONLY, snapshot);
+	auto collector = get_component("scad_counters");
+	collector->start(snapshot_buff, timeout);
+	collector->wait();
+	collector->read_buffer(snapshot_buff, snapshot);
+	
+	return std::vector<scad_unit_counters>(snapshot.begin(), snapshot.end());
+}
+
 
 cl::size_t<3> machine::component::workgroup_dims() {
 	//kernel.getWorkGroupInfo(machine.device, CL_KERNEL_COMPILE_WORK_GROUP_SIZE, sizeof(size_t[3]	), result.data());
@@ -79,7 +104,7 @@ cl::size_t<3> machine::component::workgroup_dims() {
 
 machine::component::component(scad::machine &machine, std::string name, cl::Kernel kernel)
 	:machine(machine), kernel_name(name), kernel(kernel),
-	 cmd_queue{machine.context, machine.device, 0, NULL}
+	 cmd_queue{machine.context, machine.device, CL_QUEUE_PROFILING_ENABLE, NULL}
 {
 }
 
@@ -87,10 +112,23 @@ std::string machine::component::name() {
 	return kernel_name;
 }
 
+void machine::component::start_stream(cl::Buffer buff, size_t length) {
+	start(buff, (cl_uint) length);
+}
+
 void machine::component::wait() {
 	cmd_queue.flush();
 	cmd_queue.finish();
 }
 
+double machine::component::runtime() {
+	if(!started) {
+		return 0;
+	}
+	cl_ulong start = last_run.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+	cl_ulong end = last_run.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+	return (end - start) * 1e-9;
+}
+
 
 } // namespace
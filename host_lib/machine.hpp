@@ -28,6 +28,8 @@
 
 #include "aligned_mem.hpp"
 
+#include "common/instructions.h"
+
 namespace scad {
 
 class machine {
@@ -46,6 +48,9 @@ class machine {
 			std::string kernel_name;
 			cl::Kernel kernel;
 			cl::CommandQueue cmd_queue;
+			// Profiling event of the last start().
+			cl::Event last_run;
+			bool started = false;
 			
 			component(scad::machine &machine, std::string name, cl::Kernel kernel);
 			
@@ -90,10 +95,12 @@ class machine {
 						cmd_queue.enqueueNDRangeKernel(kernel,
 						                               cl::NullRange,
 						                               cl::NDRange(work_items),
-						                               cl::NDRange(work_items));
+						                               cl::NDRange(work_items),
+						                               NULL, &last_run);
 					} else {
-						cmd_queue.enqueueTask(kernel, NULL, NULL);
+						cmd_queue.enqueueTask(kernel, NULL, &last_run);
 					}
+					started = true;
 				}
 				
 				template<typename vect_T>
@@ -125,7 +132,15 @@ class machine {
 				}
 				
 				
+				// Start a memory stream unit on the first length words of buff.
+				// buff needs to be created by stream_buffer_for.
+				void start_stream(cl::Buffer buff, size_t length);
+				
 				void wait();
+				
+				// Device runtime of the last start() in seconds, taken from its
+				// profiling event. Only valid after wait(), 0 if never started.
+				double runtime();
 		};
 	
 	private:
@@ -166,6 +181,22 @@ class machine {
 			return buffer_for(CL_MEM_READ_WRITE, param);
 		}
 		
+		// Memory stream units access whole bursts of SCAD_STREAM_BURST_WORDS.
+		static size_t stream_padded_length(size_t length);
+		
+		// Snapshot of the performance counters of all units, see counters.cl.
+		// Entry 2*unit is the input side, 2*unit+1 the output side of unit,
+		// the last entry is the interconnect. Sides that did not answer
+		// within timeout polls have valid == 0.
+		// Empty if the machine was configured without counters.
+		std::vector<scad_unit_counters> counters(size_t unit_count, cl_uint timeout = 1024);
+		
+		// Buffer for param, padded for use by a memory stream unit.
+		template<typename vect_T>
+		cl::Buffer stream_buffer_for(cl_mem_flags flags, std::vector<vect_T, AlignedAllocator<vect_T>> const& param) {
+			return buffer(flags, sizeof(vect_T) * stream_padded_length(param.size()));
+		}
+		
 };
 
 
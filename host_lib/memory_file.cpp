@@ -0,0 +1,58 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <fstream>
+#include <sstream>
+
+#include "memory_file.hpp"
+
+namespace scad {
+
+std::vector<scad_data> memory_file_read(std::string filename) {
+	std::ifstream file(filename);
+	if(file.fail()) {
+		throw memory_file_exception("Could not open '" + filename + "'.");
+	}
+	
+	std::vector<scad_data> memory;
+	std::string line;
+	for(int line_number = 1; std::getline(file, line); line_number++) {
+		if(line.size() > 0 && line[0] == '#') {
+			continue;
+		}
+		std::istringstream words(line);
+		std::string word;
+		while(words >> word) {
+			size_t end = 0;
+			try {
+				memory.push_back((scad_data) {.integer = std::stoull(word, &end, 0)});
+			} catch(std::logic_error &e) {
+				end = 0;
+			}
+			if(end != word.size()) {
+				throw memory_file_exception(filename + ":" + std::to_string(line_number)
+				                            + ": not a number: " + word);
+			}
+		}
+	}
+	return memory;
+}
+
+void memory_file_write(std::ostream &out, std::vector<scad_data> const& memory) {
+	for(auto const& word: memory) {
+		out << word.integer << '\n';
+	}
+}
+
+} // namespace scad
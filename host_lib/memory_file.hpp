@@ -0,0 +1,40 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_MEMORY_FILE_HPP
+#define SCAD_MEMORY_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+
+#include "common/instructions.h"
+
+namespace scad {
+
+class memory_file_exception : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+// Text file with one word per whitespace-separated number, decimal or 0x hex.
+// Lines starting with # are comments.
+std::vector<scad_data> memory_file_read(std::string filename);
+
+// One word per line in decimal.
+void memory_file_write(std::ostream &out, std::vector<scad_data> const& memory);
+
+} // namespace scad
+
+#endif /* SCAD_MEMORY_FILE_HPP */
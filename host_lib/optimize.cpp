@@ -0,0 +1,1232 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include "optimize.hpp"
+#include "analysis.hpp"
+
+namespace scad {
+
+// Cycles from a move to its data arriving at the destination unit.
+static unsigned long const network_latency = 2;
+
+static bool address_is_reserved(struct scad_buffer_address address) {
+	return address.unit == SCAD_ADDRESS_NULL && address.buffer == SCAD_ADDRESS_NULL;
+}
+
+static bool has_destination(struct scad_instruction const& instr) {
+	return (instr.op == SCAD_MOVE || instr.op == SCAD_MOVE_IMMEDIATE) && !address_is_reserved(instr.to);
+}
+
+static bool is_branch(struct scad_instruction const& instr) {
+	return instr.op == SCAD_MOVE && instr.to.unit == 0 && instr.to.buffer == 0;
+}
+
+// Cycles from the last operand of an operation to its result.
+static unsigned long unit_latency(processor_description const& proc, scad_address_part number) {
+	for(auto const& unit: proc.units) {
+		if(unit.second->number != number) {
+			continue;
+		}
+		std::string const& type = unit.second->type;
+		if(type == "lsu") {
+			return 20;
+		} else if(type == "memory_stream_in" || type == "memory_stream_out") {
+			return 4;
+		} else if(type == "pu") {
+			return 2;
+		}
+		return 1;
+	}
+	return 1;
+}
+
+// Pairs of first and one past last address.
+static std::vector<std::pair<cl_ulong, cl_ulong>> basic_blocks(std::vector<struct scad_instruction> const& program,
+                                                               std::set<cl_ulong> const& labels) {
+	std::set<cl_ulong> starts = labels;
+	starts.insert(0);
+	for(cl_ulong pc = 0; pc < program.size(); pc++) {
+		if(is_branch(program[pc]) || program[pc].op == SCAD_MOVE_PC) {
+			starts.insert(pc + 1);
+		}
+	}
+	
+	std::vector<std::pair<cl_ulong, cl_ulong>> blocks;
+	for(auto it = starts.begin(); it != starts.end() && *it < program.size(); it++) {
+		auto next = std::next(it);
+		cl_ulong end = (next == starts.end()) ? program.size() : std::min<cl_ulong>(*next, program.size());
+		blocks.push_back({*it, end});
+	}
+	return blocks;
+}
+
+// Why move i has to stay before move j, empty if they are independent.
+static std::string dependency_reason(struct scad_instruction const& i, struct scad_instruction const& j) {
+	if(has_destination(i) && has_destination(j)
+	   && i.to.unit == j.to.unit && i.to.buffer == j.to.buffer) {
+		return "to";
+	}
+	if(i.op == SCAD_MOVE && j.op == SCAD_MOVE
+	   && i.from.unit == j.from.unit && i.from.buffer == j.from.buffer) {
+		return "from";
+	}
+	if(has_destination(i) && j.op == SCAD_MOVE && i.to.unit == j.from.unit) {
+		return "data";
+	}
+	// Every packet to the control unit is taken as branch condition.
+	if(has_destination(i) && has_destination(j) && i.to.unit == 0 && j.to.unit == 0) {
+		return "control";
+	}
+	return "";
+}
+
+unsigned long estimate_cycles(processor_description const& proc,
+                              std::vector<struct scad_instruction> const& program,
+                              std::set<cl_ulong> const& labels) {
+	unsigned long cycles = 0;
+	for(auto const& block: basic_blocks(program, labels)) {
+		unsigned long t = 0;
+		int last_unit = -1;
+		// Time the last operation of a unit issued in this block finishes.
+		std::map<scad_address_part, unsigned long> unit_ready;
+		
+		for(cl_ulong pc = block.first; pc < block.second; pc++) {
+			struct scad_instruction const& instr = program[pc];
+			t++;
+			if(!has_destination(instr)) {
+				continue;
+			}
+			// The input buffer handles one move at a time.
+			if(instr.to.unit == last_unit) {
+				t++;
+			}
+			last_unit = instr.to.unit;
+			
+			unsigned long arrival = t + network_latency;
+			if(instr.op == SCAD_MOVE) {
+				arrival = std::max(t, unit_ready[instr.from.unit]) + network_latency;
+			}
+			if(is_branch(instr)) {
+				t = std::max(t, arrival);
+			} else {
+				unit_ready[instr.to.unit] = std::max(unit_ready[instr.to.unit],
+				                                     arrival + unit_latency(proc, instr.to.unit));
+			}
+		}
+		cycles += t;
+	}
+	return cycles;
+}
+
+// List scheduling of one block into result.program.
+static void schedule_block(processor_description const& proc,
+                           std::vector<struct scad_instruction> const& program,
+                           std::pair<cl_ulong, cl_ulong> block,
+                           schedule_result &result) {
+	cl_ulong first = block.first;
+	size_t size = block.second - block.first;
+	
+	std::vector<std::vector<std::pair<size_t, unsigned long>>> successors(size);
+	std::vector<size_t> predecessors(size, 0);
+	auto add_dependency = [&](size_t i, size_t j, std::string reason) {
+		unsigned long weight = 1;
+		if(reason == "data") {
+			weight = network_latency + unit_latency(proc, program[first + i].to.unit);
+		}
+		successors[i].push_back({j, weight});
+		predecessors[j]++;
+		result.dependencies.push_back({first + i, first + j, reason});
+	};
+	
+	for(size_t j = 0; j < size; j++) {
+		struct scad_instruction const& instr = program[first + j];
+		// Branches and jumps end their block.
+		if(is_branch(instr) || instr.op == SCAD_MOVE_PC) {
+			for(size_t i = 0; i < j; i++) {
+				std::string reason = dependency_reason(program[first + i], instr);
+				if(reason != "" || successors[i].empty()) {
+					add_dependency(i, j, reason != "" ? reason : "control");
+				}
+			}
+			continue;
+		}
+		for(size_t i = 0; i < j; i++) {
+			std::string reason = dependency_reason(program[first + i], instr);
+			if(reason != "") {
+				add_dependency(i, j, reason);
+			}
+		}
+	}
+	
+	// Longest latency path to the end of the block.
+	std::vector<unsigned long> height(size, 1);
+	for(size_t i = size; i-- > 0;) {
+		for(auto const& successor: successors[i]) {
+			height[i] = std::max(height[i], height[successor.first] + successor.second);
+		}
+	}
+	
+	std::vector<bool> done(size, false);
+	int last_unit = -1;
+	for(size_t issued = 0; issued < size; issued++) {
+		size_t best = size;
+		for(size_t i = 0; i < size; i++) {
+			if(done[i] || predecessors[i] > 0) {
+				continue;
+			}
+			if(best == size || height[i] > height[best]) {
+				best = i;
+			} else if(height[i] == height[best]
+			          && program[first + best].to.unit == last_unit
+			          && program[first + i].to.unit != last_unit) {
+				// Interleave units, moves to the same unit wait for its ACK.
+				best = i;
+			}
+		}
+		
+		done[best] = true;
+		last_unit = has_destination(program[first + best]) ? program[first + best].to.unit : -1;
+		for(auto const& successor: successors[best]) {
+			predecessors[successor.first]--;
+		}
+		result.position[first + best] = result.program.size();
+		result.program.push_back(program[first + best]);
+	}
+}
+
+schedule_result schedule_moves(processor_description const& proc,
+                               std::vector<struct scad_instruction> const& program,
+                               std::set<cl_ulong> const& labels) {
+	schedule_result result;
+	result.position.resize(program.size());
+	
+	for(auto const& block: basic_blocks(program, labels)) {
+		result.blocks.insert(block.first);
+		schedule_block(proc, program, block, result);
+	}
+	
+	result.cycles_before = estimate_cycles(proc, program, labels);
+	result.cycles_after = estimate_cycles(proc, result.program, labels);
+	
+	// Other moves between two buffers can raise their occupancy.
+	if(!analyze(proc, result.program).deadlocks.empty() && analyze(proc, program).deadlocks.empty()) {
+		result.program = program;
+		for(cl_ulong pc = 0; pc < program.size(); pc++) {
+			result.position[pc] = pc;
+		}
+		result.cycles_after = result.cycles_before;
+		result.reverted = true;
+	}
+	
+	return result;
+}
+
+// Result copy: address of the producing (op, count) move or of the move into
+// a rob, and copy index.
+typedef std::pair<cl_ulong, cl_uint> copy_id;
+
+// Copies and moves waiting for them per output buffer (unit number).
+struct copy_state {
+	cl_ulong pc = 0;
+	std::map<scad_address_part, std::deque<copy_id>> copies;
+	std::map<scad_address_part, std::deque<cl_ulong>> waiting;
+	// Moves to in0, in1 and opc of pu units that have not formed an operation.
+	std::map<scad_address_part, std::vector<std::deque<cl_ulong>>> operands;
+	bool target_valid = false;
+	cl_ulong target = 0;
+	// Reached by the branch copy_flow::back.
+	bool back = false;
+};
+
+class elimination_skipped : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+struct copy_flow {
+	std::map<scad_address_part, std::string> tracked;
+	std::map<copy_id, std::set<cl_ulong>> consumers;
+	std::map<cl_ulong, std::set<copy_id>> consumed;
+	// Count of every (op, count) move of a pu or lsu.
+	std::map<cl_ulong, cl_uint> producers;
+	// Record which pu operations every operand move feeds.
+	bool operands = false;
+	std::map<cl_ulong, std::set<cl_ulong>> operand_ops;
+	// States that reach entry other than by the branch at back.
+	cl_ulong entry = (cl_ulong) -1;
+	cl_ulong back = (cl_ulong) -1;
+	std::vector<copy_state> entries;
+};
+
+static std::string copy_state_key(copy_state const& state) {
+	std::string key = std::to_string(state.pc) + ":"
+		+ (state.target_valid ? std::to_string(state.target) : "-");
+	for(auto const& unit: state.copies) {
+		key += "|c" + std::to_string(unit.first);
+		for(auto const& copy: unit.second) {
+			key += "," + std::to_string(copy.first) + "." + std::to_string(copy.second);
+		}
+	}
+	for(auto const& unit: state.waiting) {
+		key += "|w" + std::to_string(unit.first);
+		for(auto const& move: unit.second) {
+			key += "," + std::to_string(move);
+		}
+	}
+	for(auto const& unit: state.operands) {
+		key += "|o" + std::to_string(unit.first);
+		for(auto const& input: unit.second) {
+			key += ";";
+			for(auto const& move: input) {
+				key += "," + std::to_string(move);
+			}
+		}
+	}
+	return key;
+}
+
+static void copy_match(copy_flow &flow, copy_state &state, scad_address_part unit) {
+	auto &copies = state.copies[unit];
+	auto &waiting = state.waiting[unit];
+	while(!copies.empty() && !waiting.empty()) {
+		flow.consumers[copies.front()].insert(waiting.front());
+		flow.consumed[waiting.front()].insert(copies.front());
+		copies.pop_front();
+		waiting.pop_front();
+	}
+	if(copies.size() > 4096) {
+		throw elimination_skipped("copies of unit " + std::to_string(unit) + " grow without bound");
+	}
+}
+
+// Operations take the first move to in0, in1 and opc each.
+static void operand_match(copy_flow &flow, copy_state &state, scad_address_part unit) {
+	auto &inputs = state.operands[unit];
+	while(!inputs[0].empty() && !inputs[1].empty() && !inputs[2].empty()) {
+		cl_ulong opcode = inputs[2].front();
+		for(auto &input: inputs) {
+			flow.operand_ops[input.front()].insert(opcode);
+			input.pop_front();
+		}
+	}
+	for(auto const& input: inputs) {
+		if(input.size() > 4096) {
+			throw elimination_skipped("operands of unit " + std::to_string(unit) + " grow without bound");
+		}
+	}
+}
+
+// Follow every path of the program and record which move takes which copy.
+static void copy_flow_explore(copy_flow &flow, std::vector<struct scad_instruction> const& program) {
+	std::set<std::string> visited;
+	std::vector<copy_state> worklist = {copy_state()};
+	while(!worklist.empty()) {
+		copy_state state = worklist.back();
+		worklist.pop_back();
+		
+		while(state.pc < program.size()) {
+			if(state.pc == flow.entry && !state.back) {
+				flow.entries.push_back(state);
+			}
+			state.back = false;
+			if(!visited.insert(copy_state_key(state)).second) {
+				break;
+			}
+			if(visited.size() > 100000) {
+				throw elimination_skipped("too many program states");
+			}
+			
+			cl_ulong pc = state.pc;
+			struct scad_instruction const& instr = program[pc];
+			if(instr.op == SCAD_MOVE_PC) {
+				state.pc = instr.immediate.integer;
+				continue;
+			}
+			
+			if(instr.op == SCAD_MOVE && flow.tracked.count(instr.from.unit)) {
+				state.waiting[instr.from.unit].push_back(pc);
+				copy_match(flow, state, instr.from.unit);
+			}
+			
+			if(has_destination(instr) && instr.to.unit == 0 && instr.to.buffer == 1) {
+				if(instr.op != SCAD_MOVE_IMMEDIATE) {
+					throw elimination_skipped("branch target at " + std::to_string(pc) + " is not a label");
+				}
+				state.target = instr.immediate.integer;
+				state.target_valid = true;
+			} else if(has_destination(instr) && flow.tracked.count(instr.to.unit)) {
+				std::string const& type = flow.tracked.at(instr.to.unit);
+				if(type == "rob") {
+					state.copies[instr.to.unit].push_back({pc, 0});
+				} else if(instr.to.buffer == 2) {
+					if(instr.op != SCAD_MOVE_IMMEDIATE) {
+						throw elimination_skipped("opcode at " + std::to_string(pc) + " is not an immediate");
+					}
+					cl_uint count = instr.immediate.op.count;
+					if(type == "lsu" && instr.immediate.op.opcode == SCAD_LSU_STORE) {
+						count = 0;
+					}
+					flow.producers[pc] = count;
+					for(cl_uint copy = 0; copy < count; copy++) {
+						state.copies[instr.to.unit].push_back({pc, copy});
+					}
+				}
+				if(flow.operands && type == "pu") {
+					state.operands[instr.to.unit].resize(3);
+					state.operands[instr.to.unit].at(instr.to.buffer).push_back(pc);
+					operand_match(flow, state, instr.to.unit);
+				}
+				copy_match(flow, state, instr.to.unit);
+			}
+			
+			if(is_branch(instr)) {
+				if(!state.target_valid) {
+					throw elimination_skipped("branch at " + std::to_string(pc) + " has no target");
+				}
+				copy_state taken = state;
+				taken.pc = state.target;
+				taken.target_valid = false;
+				taken.back = (pc == flow.back);
+				worklist.push_back(taken);
+				state.target_valid = false;
+			}
+			state.pc++;
+		}
+	}
+}
+
+elimination_result eliminate_dead_copies(processor_description const& proc,
+                                         std::vector<struct scad_instruction> const& program,
+                                         std::set<cl_ulong> const& labels,
+                                         std::set<cl_ulong> const& references) {
+	elimination_result result;
+	result.program = program;
+	result.labels = labels;
+	result.references = references;
+	
+	copy_flow flow;
+	for(auto const& unit: proc.units) {
+		std::string const& type = unit.second->type;
+		if(type == "pu" || type == "lsu" || type == "rob") {
+			flow.tracked[unit.second->number] = type;
+		}
+	}
+	try {
+		copy_flow_explore(flow, program);
+	} catch(elimination_skipped &e) {
+		result.skipped = e.what();
+		return result;
+	}
+	
+	auto is_null_move = [&](cl_ulong pc) {
+		return program[pc].op == SCAD_MOVE && address_is_reserved(program[pc].to)
+		       && flow.tracked.count(program[pc].from.unit);
+	};
+	
+	// First removed copy per producer: the last copies that only go to null,
+	// at least one copy is kept.
+	std::map<cl_ulong, cl_uint> keep;
+	for(auto const& producer: flow.producers) {
+		cl_uint count = producer.second;
+		while(count > 1) {
+			auto const& consumers = flow.consumers[{producer.first, count - 1}];
+			if(consumers.empty() || !std::all_of(consumers.begin(), consumers.end(), is_null_move)) {
+				break;
+			}
+			count--;
+		}
+		keep[producer.first] = count;
+	}
+	
+	// Moves to null can go if all copies they take on any path go. Copies
+	// can go if all moves that take them go.
+	auto removed = [&](copy_id const& copy) {
+		return keep.count(copy.first) && copy.second >= keep[copy.first];
+	};
+	std::set<cl_ulong> deleted;
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		deleted.clear();
+		for(cl_ulong pc = 0; pc < program.size(); pc++) {
+			auto const& consumed = flow.consumed[pc];
+			if(is_null_move(pc) && std::all_of(consumed.begin(), consumed.end(), removed)) {
+				deleted.insert(pc);
+			}
+		}
+		for(auto &producer: keep) {
+			for(cl_uint copy = producer.second; copy < flow.producers[producer.first]; copy++) {
+				auto const& consumers = flow.consumers[{producer.first, copy}];
+				if(!std::all_of(consumers.begin(), consumers.end(),
+				                [&](cl_ulong pc) { return deleted.count(pc) > 0; })) {
+					producer.second = copy + 1;
+					changed = true;
+				}
+			}
+		}
+	}
+	
+	// Rewrite with code addresses moved up by the deleted moves before them.
+	auto address = [&](cl_ulong old) {
+		return old - std::distance(deleted.begin(), deleted.lower_bound(old));
+	};
+	result.program.clear();
+	result.labels.clear();
+	result.references.clear();
+	for(cl_ulong pc = 0; pc < program.size(); pc++) {
+		if(deleted.count(pc)) {
+			result.removed_moves++;
+			continue;
+		}
+		struct scad_instruction instr = program[pc];
+		if(flow.producers.count(pc) && keep[pc] < flow.producers[pc]) {
+			result.removed_copies += flow.producers[pc] - keep[pc];
+			instr.immediate.op.count -= flow.producers[pc] - keep[pc];
+		}
+		bool is_target = has_destination(instr) && instr.to.unit == 0 && instr.to.buffer == 1;
+		if(references.count(pc) || instr.op == SCAD_MOVE_PC || is_target) {
+			instr.immediate.integer = address(instr.immediate.integer);
+		}
+		if(references.count(pc)) {
+			result.references.insert(result.program.size());
+		}
+		result.program.push_back(instr);
+	}
+	for(cl_ulong label: labels) {
+		result.labels.insert(address(label));
+	}
+	
+	return result;
+}
+
+// Move or operation of an unrolled loop: address in the original program and
+// iteration. Values that were in the buffers before the loop have negative
+// iterations.
+typedef std::pair<cl_ulong, long> loop_instance;
+
+// Moves of an unrolled loop in issue order with their instructions.
+typedef std::vector<std::pair<loop_instance, struct scad_instruction>> loop_moves;
+
+// Where the values of an unrolled loop go.
+struct loop_trace {
+	// Operation, rob move or stream value that every move takes.
+	std::map<loop_instance, loop_instance> source;
+	// Moves every operation takes its operands from.
+	std::map<loop_instance, std::vector<loop_instance>> operands;
+	// Loads and stores of all lsus in order.
+	std::vector<loop_instance> memory;
+	// Moves to units whose values are not followed, in order.
+	std::map<scad_address_part, std::vector<loop_instance>> sinks;
+	// Values, moves and operands left in the buffers.
+	std::map<std::string, std::vector<loop_instance>> left;
+};
+
+// Follows values from unit to unit for moves in order, starting with the
+// buffers at the loop entry. Only the order of values counts, not when they
+// arrive, so copies of one result are all the same value.
+static loop_trace loop_trace_run(copy_flow const& flow, copy_state const& entry, loop_moves const& moves) {
+	loop_trace trace;
+	std::map<scad_address_part, std::deque<loop_instance>> values;
+	std::map<scad_address_part, std::deque<loop_instance>> waiting;
+	std::map<std::pair<scad_address_part, scad_address_part>, std::deque<loop_instance>> inputs;
+	std::map<loop_instance, scad_data> opcodes;
+	std::map<scad_address_part, long> streamed;
+	
+	// Copies of one result before the loop are one value.
+	for(auto const& unit: entry.copies) {
+		long ordinal = 0;
+		for(size_t i = 0; i < unit.second.size(); i++) {
+			copy_id const& copy = unit.second[i];
+			if(i > 0 && (copy.second == 0 || copy.first != unit.second[i - 1].first)) {
+				ordinal++;
+			}
+			values[unit.first].push_back({copy.first, -1 - ordinal});
+		}
+	}
+	
+	auto match = [&](scad_address_part unit) {
+		while(!values[unit].empty() && !waiting[unit].empty()) {
+			trace.source[waiting[unit].front()] = values[unit].front();
+			values[unit].pop_front();
+			waiting[unit].pop_front();
+		}
+	};
+	// Operations take their operands in order, see simulator::step_unit.
+	auto fire = [&](scad_address_part unit, std::string const& type) {
+		auto &in0 = inputs[{unit, 0}];
+		auto &in1 = inputs[{unit, 1}];
+		auto &opc = inputs[{unit, 2}];
+		while(!opc.empty() && !in0.empty()) {
+			loop_instance op = opc.front();
+			scad_data immediate = opcodes[op];
+			bool address_only = type == "lsu" && immediate.op.opcode == SCAD_LSU_LOAD_ADDRESS;
+			if(!address_only && in1.empty()) {
+				break;
+			}
+			trace.operands[op] = {in0.front()};
+			in0.pop_front();
+			if(!address_only) {
+				trace.operands[op].push_back(in1.front());
+				in1.pop_front();
+			}
+			opc.pop_front();
+			
+			cl_uint count = immediate.op.count;
+			if(type == "lsu") {
+				trace.memory.push_back(op);
+				if(immediate.op.opcode == SCAD_LSU_STORE) {
+					count = 0;
+				}
+			}
+			for(cl_uint copy = 0; copy < count; copy++) {
+				values[unit].push_back(op);
+			}
+			match(unit);
+		}
+	};
+	
+	for(auto const& issued: moves) {
+		loop_instance const& move = issued.first;
+		struct scad_instruction const& instr = issued.second;
+		if(instr.op == SCAD_MOVE) {
+			if(flow.tracked.count(instr.from.unit)) {
+				waiting[instr.from.unit].push_back(move);
+				match(instr.from.unit);
+			} else {
+				// Stream values by unit, above every address.
+				trace.source[move] = {(cl_ulong) -1 - instr.from.unit, streamed[instr.from.unit]++};
+			}
+		}
+		if(!has_destination(instr)) {
+			continue;
+		}
+		if(!flow.tracked.count(instr.to.unit)) {
+			trace.sinks[instr.to.unit].push_back(move);
+			continue;
+		}
+		std::string const& type = flow.tracked.at(instr.to.unit);
+		if(type == "rob") {
+			values[instr.to.unit].push_back(move);
+			match(instr.to.unit);
+		} else {
+			if(instr.to.buffer == 2) {
+				opcodes[move] = instr.immediate;
+			}
+			inputs[{instr.to.unit, instr.to.buffer}].push_back(move);
+			fire(instr.to.unit, type);
+		}
+	}
+	
+	auto leave = [&](std::string const& name, std::deque<loop_instance> const& left) {
+		if(!left.empty()) {
+			trace.left[name].assign(left.begin(), left.end());
+		}
+	};
+	for(auto const& unit: values) {
+		leave("values " + std::to_string(unit.first), unit.second);
+	}
+	for(auto const& unit: waiting) {
+		leave("waiting " + std::to_string(unit.first), unit.second);
+	}
+	for(auto const& input: inputs) {
+		leave("input " + std::to_string(input.first.first) + "@" + std::to_string(input.first.second), input.second);
+	}
+	return trace;
+}
+
+pipeline_result pipeline_loop(processor_description const& proc,
+                              std::vector<struct scad_instruction> const& program,
+                              std::set<cl_ulong> const& labels,
+                              std::set<cl_ulong> const& references,
+                              cl_ulong loop) {
+	pipeline_result result;
+	result.program = program;
+	result.labels = labels;
+	result.references = references;
+	
+	// The loop ends with the first branch back to its label.
+	cl_ulong end = program.size();
+	bool target_valid = false;
+	cl_ulong target = 0;
+	cl_ulong target_move = 0;
+	for(cl_ulong pc = loop; pc < program.size(); pc++) {
+		struct scad_instruction const& instr = program[pc];
+		if(instr.op == SCAD_MOVE_IMMEDIATE && instr.to.unit == 0 && instr.to.buffer == 1) {
+			target = instr.immediate.integer;
+			target_valid = true;
+			target_move = pc;
+		}
+		if(is_branch(instr)) {
+			if(target_valid && target == loop) {
+				end = pc;
+				break;
+			}
+			target_valid = false;
+		}
+	}
+	if(end == program.size()) {
+		result.skipped = "no branch back to " + std::to_string(loop);
+		return result;
+	}
+	
+	// Only the branch leaves the loop and nothing jumps into it.
+	for(cl_ulong pc = loop; pc < end; pc++) {
+		struct scad_instruction const& instr = program[pc];
+		if(instr.op == SCAD_MOVE_PC || (has_destination(instr) && instr.to.unit == 0 && pc != target_move)) {
+			result.skipped = "the loop is no single block, see instruction " + std::to_string(pc);
+			return result;
+		}
+	}
+	for(cl_ulong pc = 0; pc < program.size(); pc++) {
+		struct scad_instruction const& instr = program[pc];
+		bool address = instr.op == SCAD_MOVE_PC || references.count(pc)
+		               || (instr.op == SCAD_MOVE_IMMEDIATE && instr.to.unit == 0 && instr.to.buffer == 1);
+		if(address && instr.immediate.integer > loop && instr.immediate.integer <= end) {
+			result.skipped = "instruction " + std::to_string(pc) + " jumps into the loop";
+			return result;
+		}
+	}
+	
+	copy_flow flow;
+	flow.operands = true;
+	flow.entry = loop;
+	flow.back = end;
+	for(auto const& unit: proc.units) {
+		std::string const& type = unit.second->type;
+		if(type == "pu" || type == "lsu" || type == "rob") {
+			flow.tracked[unit.second->number] = type;
+		}
+	}
+	try {
+		copy_flow_explore(flow, program);
+	} catch(elimination_skipped &e) {
+		result.skipped = e.what();
+		return result;
+	}
+	
+	// Every way into the loop leaves the same results in the buffers.
+	auto contents = [](copy_state state) {
+		state.pc = 0;
+		state.target_valid = false;
+		state.target = 0;
+		for(auto it = state.copies.begin(); it != state.copies.end();) {
+			it = it->second.empty() ? state.copies.erase(it) : std::next(it);
+		}
+		return copy_state_key(state);
+	};
+	if(flow.entries.empty()) {
+		result.skipped = "the loop is never entered";
+		return result;
+	}
+	for(auto const& state: flow.entries) {
+		bool pending = false;
+		for(auto const& unit: state.waiting) {
+			pending = pending || !unit.second.empty();
+		}
+		for(auto const& unit: state.operands) {
+			for(auto const& input: unit.second) {
+				pending = pending || !input.empty();
+			}
+		}
+		if(pending) {
+			result.skipped = "moves before the loop wait for operations in it";
+			return result;
+		}
+		if(contents(state) != contents(flow.entries.front())) {
+			result.skipped = "the loop is entered with different buffer contents";
+			return result;
+		}
+		// A later run would find the values of the extra condition instead.
+		for(auto const& unit: state.copies) {
+			for(copy_id const& copy: unit.second) {
+				if(copy.first >= loop && copy.first <= end) {
+					result.skipped = "values of an earlier run of the loop are still in the buffers";
+					return result;
+				}
+			}
+		}
+	}
+	copy_state entry = flow.entries.front();
+	entry.operands.clear();
+	
+	auto sequential = [&](long iterations) {
+		loop_moves moves;
+		for(long k = 0; k < iterations; k++) {
+			for(cl_ulong pc = loop; pc <= end; pc++) {
+				moves.push_back({{pc, k}, program[pc]});
+			}
+		}
+		return moves;
+	};
+	
+	// Moves the branch condition depends on, followed back over three iterations.
+	loop_trace original = loop_trace_run(flow, entry, sequential(3));
+	std::set<cl_ulong> condition;
+	std::set<loop_instance> seen;
+	std::vector<loop_instance> worklist = {{end, 2}};
+	while(!worklist.empty()) {
+		loop_instance instance = worklist.back();
+		worklist.pop_back();
+		if(instance.second < 0 || instance.first >= program.size() || !seen.insert(instance).second) {
+			continue;
+		}
+		condition.insert(instance.first);
+		if(original.source.count(instance)) {
+			worklist.push_back(original.source[instance]);
+		}
+		for(loop_instance const& operand: original.operands[instance]) {
+			worklist.push_back(operand);
+		}
+	}
+	
+	std::vector<cl_ulong> slice, rest;
+	for(cl_ulong pc = loop; pc < end; pc++) {
+		if(pc != target_move) {
+			(condition.count(pc) ? slice : rest).push_back(pc);
+		}
+	}
+	if(slice.empty()) {
+		result.skipped = "the branch condition is not computed in the loop";
+		return result;
+	}
+	if(rest.empty()) {
+		result.skipped = "every move of the loop computes the branch condition";
+		return result;
+	}
+	
+	// Operations of the condition on a pu that the rest uses as well move to
+	// free pus of the same implementation, with their operand and result
+	// moves. Otherwise the next condition queues behind values of the rest.
+	std::map<cl_ulong, std::set<cl_ulong>> sources, fed;
+	std::set<cl_ulong> left;
+	for(auto const& move: original.source) {
+		sources[move.first.first].insert(move.second.second < 0 ? program.size() : move.second.first);
+	}
+	for(auto const& op: original.operands) {
+		for(loop_instance const& operand: op.second) {
+			fed[operand.first].insert(op.first.first);
+		}
+	}
+	for(auto const& buffer: original.left) {
+		for(loop_instance const& value: buffer.second) {
+			left.insert(value.first);
+		}
+	}
+	std::set<scad_address_part> used;
+	for(auto const& instr: program) {
+		if(instr.op == SCAD_MOVE) {
+			used.insert(instr.from.unit);
+		}
+		if(has_destination(instr)) {
+			used.insert(instr.to.unit);
+		}
+	}
+	auto description = [&](scad_address_part number) {
+		for(auto const& unit: proc.units) {
+			if(unit.second->number == number) {
+				return unit.second;
+			}
+		}
+		return std::shared_ptr<unit_description>();
+	};
+	std::vector<struct scad_instruction> renamed = program;
+	std::map<cl_ulong, scad_address_part> moved;
+	for(cl_ulong op: slice) {
+		struct scad_instruction const& instr = program[op];
+		if(!has_destination(instr) || instr.to.buffer != 2 || description(instr.to.unit)->type != "pu"
+		   || left.count(op)) {
+			continue;
+		}
+		scad_address_part unit = instr.to.unit;
+		bool shared = std::any_of(rest.begin(), rest.end(), [&](cl_ulong pc) {
+			return (program[pc].op == SCAD_MOVE && program[pc].from.unit == unit)
+			       || (has_destination(program[pc]) && program[pc].to.unit == unit);
+		});
+		// Operand and result moves that only serve this operation.
+		std::set<cl_ulong> operands, results;
+		bool own = true;
+		for(auto const& move: fed) {
+			if(move.second.count(op)) {
+				operands.insert(move.first);
+				own = own && move.second.size() == 1;
+			}
+		}
+		for(auto const& move: sources) {
+			if(move.second.count(op)) {
+				results.insert(move.first);
+				own = own && move.second.size() == 1;
+			}
+		}
+		if(!shared || !own) {
+			continue;
+		}
+		for(auto const& candidate: proc.units) {
+			scad_address_part number = candidate.second->number;
+			if(candidate.second->type != "pu" || used.count(number)
+			   || candidate.second->implementation != description(unit)->implementation) {
+				continue;
+			}
+			used.insert(number);
+			moved[op] = number;
+			renamed[op].to.unit = number;
+			for(cl_ulong pc: operands) {
+				renamed[pc].to.unit = number;
+			}
+			for(cl_ulong pc: results) {
+				renamed[pc].from.unit = number;
+			}
+			break;
+		}
+	}
+	
+	// Buffers a move takes from or goes to, all lsus share their memory.
+	auto buffers = [&](struct scad_instruction const& instr) {
+		std::set<cl_ulong> keys;
+		if(instr.op == SCAD_MOVE) {
+			keys.insert((1ul << 32) | (instr.from.unit << 16) | instr.from.buffer);
+		}
+		if(has_destination(instr)) {
+			keys.insert((2ul << 32) | (instr.to.unit << 16) | instr.to.buffer);
+			if(flow.tracked.count(instr.to.unit) && flow.tracked.at(instr.to.unit) == "lsu") {
+				keys.insert(3ul << 32);
+			}
+		}
+		return keys;
+	};
+	// Running a move for an iteration that never comes is harmless if it only
+	// touches pus and robs.
+	auto pure = [&](struct scad_instruction const& instr) {
+		auto local = [&](scad_address_part unit) {
+			return flow.tracked.count(unit) && flow.tracked.at(unit) != "lsu";
+		};
+		return (instr.op != SCAD_MOVE || local(instr.from.unit)) && (!has_destination(instr) || local(instr.to.unit));
+	};
+	
+	// One pipelined loop: the prologue computes the first condition, every
+	// pass of the kernel the rest of an iteration and the condition of the
+	// next one, and the drain discards what the extra condition computed.
+	typedef std::vector<std::pair<cl_ulong, long>> stage;
+	struct schedule {
+		std::vector<struct scad_instruction> const* code;
+		std::vector<cl_ulong> ahead;
+		stage kernel;
+		std::vector<struct scad_instruction> drain;
+		unsigned long cycles;
+	};
+	auto kernel_code = [&](schedule const& candidate) {
+		std::vector<struct scad_instruction> kernel;
+		for(auto const& move: candidate.kernel) {
+			kernel.push_back((*candidate.code)[move.first]);
+		}
+		return kernel;
+	};
+	auto unrolled = [&](schedule const& candidate, long iterations) {
+		loop_moves moves;
+		for(cl_ulong pc: candidate.ahead) {
+			moves.push_back({{pc, 0}, (*candidate.code)[pc]});
+		}
+		for(long k = 0; k < iterations; k++) {
+			for(auto const& move: candidate.kernel) {
+				moves.push_back({{move.first, k + move.second}, (*candidate.code)[move.first]});
+			}
+		}
+		for(size_t i = 0; i < candidate.drain.size(); i++) {
+			moves.push_back({{program.size() + i, iterations}, candidate.drain[i]});
+		}
+		return moves;
+	};
+	
+	// Results that a move after the loop takes, other than to null.
+	std::set<cl_ulong> kept;
+	for(auto const& copy: flow.consumers) {
+		for(cl_ulong pc: copy.second) {
+			if((pc < loop || pc > end) && !address_is_reserved(program[pc].to)) {
+				kept.insert(copy.first.first);
+			}
+		}
+	}
+	
+	// Moves of the iterations that run take the same values as in the loop.
+	// Of the values left behind, those only discarded later just count.
+	auto valid = [&](schedule const& candidate) {
+		auto shape = [&](std::map<std::string, std::vector<loop_instance>> buffers) {
+			for(auto &buffer: buffers) {
+				for(loop_instance &value: buffer.second) {
+					if(buffer.first.compare(0, 7, "values ") == 0 && !kept.count(value.first)) {
+						value = {program.size(), 0};
+					}
+				}
+			}
+			return buffers;
+		};
+		for(long iterations = 1; iterations <= 4; iterations++) {
+			loop_trace expected = loop_trace_run(flow, entry, sequential(iterations));
+			loop_trace pipelined = loop_trace_run(flow, entry, unrolled(candidate, iterations));
+			for(auto it = pipelined.source.begin(); it != pipelined.source.end();) {
+				it = it->first.second >= iterations ? pipelined.source.erase(it) : std::next(it);
+			}
+			for(auto it = pipelined.operands.begin(); it != pipelined.operands.end();) {
+				it = it->first.second >= iterations ? pipelined.operands.erase(it) : std::next(it);
+			}
+			if(expected.source != pipelined.source || expected.operands != pipelined.operands
+			   || expected.memory != pipelined.memory || expected.sinks != pipelined.sinks
+			   || shape(expected.left) != shape(pipelined.left)) {
+				return false;
+			}
+		}
+		return true;
+	};
+	
+	std::vector<std::vector<struct scad_instruction> const*> codes = {&program};
+	if(!moved.empty()) {
+		codes.push_back(&renamed);
+	}
+	bool found = false;
+	schedule best;
+	for(auto code: codes) {
+		// Moves of the condition that run with the rest of their own
+		// iteration: none, those taking from the buffer of the branch
+		// condition, and those that touch memory or streams as well.
+		std::vector<std::set<cl_ulong>> lates(3);
+		struct scad_instruction const& branch = (*code)[end];
+		for(cl_ulong pc: slice) {
+			struct scad_instruction const& instr = (*code)[pc];
+			bool branch_buffer = instr.op == SCAD_MOVE && instr.from.unit == branch.from.unit
+			                     && instr.from.buffer == branch.from.buffer;
+			if(branch_buffer) {
+				lates[1].insert(pc);
+			}
+			if(branch_buffer || !pure(instr)) {
+				lates[2].insert(pc);
+			}
+		}
+		for(size_t variant = 0; variant < 2 * lates.size(); variant++) {
+			std::set<cl_ulong> const& late = lates[variant / 2];
+			bool forward = variant % 2;
+			schedule candidate;
+			candidate.code = code;
+			std::vector<cl_ulong> now;
+			for(cl_ulong pc = loop; pc < end; pc++) {
+				if(pc == target_move) {
+					continue;
+				}
+				if(condition.count(pc) && !late.count(pc)) {
+					candidate.ahead.push_back(pc);
+				} else {
+					now.push_back(pc);
+				}
+			}
+			if(candidate.ahead.empty()
+			   || !std::all_of(candidate.ahead.begin(), candidate.ahead.end(),
+			                   [&](cl_ulong pc) { return pure((*code)[pc]); })) {
+				continue;
+			}
+			
+			// Moves of the next condition go as early as the buffers they
+			// share with the rest allow.
+			std::vector<std::vector<cl_ulong>> before(now.size() + 1);
+			size_t position = 0;
+			for(cl_ulong pc: candidate.ahead) {
+				std::set<cl_ulong> keys = buffers((*code)[pc]);
+				for(size_t i = now.size(); i > position; i--) {
+					std::set<cl_ulong> other = buffers((*code)[now[i - 1]]);
+					if(std::any_of(keys.begin(), keys.end(), [&](cl_ulong key) { return other.count(key) > 0; })) {
+						position = i;
+						break;
+					}
+				}
+				before[position].push_back(pc);
+			}
+			for(size_t i = 0; i <= now.size(); i++) {
+				for(cl_ulong pc: before[i]) {
+					candidate.kernel.push_back({pc, 1});
+				}
+				if(i < now.size()) {
+					candidate.kernel.push_back({now[i], 0});
+				}
+			}
+			candidate.kernel.push_back({target_move, 0});
+			candidate.kernel.push_back({end, 0});
+			
+			// Moves of the rest that take a value of the condition computed in
+			// their own iteration go to null. Or to a rob, if the extra
+			// condition took as many values from it.
+			std::set<cl_ulong> ahead(candidate.ahead.begin(), candidate.ahead.end());
+			now.push_back(end);
+			for(cl_ulong pc: now) {
+				auto source = original.source.find({pc, 1});
+				if(source != original.source.end() && source->second.second == 1 && ahead.count(source->second.first)) {
+					struct scad_instruction instr = (*code)[pc];
+					if(!forward || !flow.tracked.count(instr.to.unit) || flow.tracked.at(instr.to.unit) != "rob") {
+						instr.to = {SCAD_ADDRESS_NULL, SCAD_ADDRESS_NULL};
+					}
+					candidate.drain.push_back(instr);
+				}
+			}
+			// Results left over for the next iteration are discarded as well.
+			loop_trace expected = loop_trace_run(flow, entry, sequential(1));
+			loop_trace pipelined = loop_trace_run(flow, entry, unrolled(candidate, 1));
+			for(auto const& buffer: pipelined.left) {
+				if(buffer.first.compare(0, 7, "values ") != 0) {
+					continue;
+				}
+				scad_address_part unit = std::stoul(buffer.first.substr(7));
+				size_t had = expected.left.count(buffer.first) ? expected.left.at(buffer.first).size() : 0;
+				for(size_t i = had; i < buffer.second.size(); i++) {
+					struct scad_instruction discard;
+					discard.op = SCAD_MOVE;
+					discard.from = description(unit)->output_buffers.at("out");
+					discard.to = {SCAD_ADDRESS_NULL, SCAD_ADDRESS_NULL};
+					candidate.drain.push_back(discard);
+				}
+			}
+			
+			if(!valid(candidate)) {
+				continue;
+			}
+			candidate.cycles = estimate_cycles(proc, kernel_code(candidate), {});
+			if(!found || candidate.cycles < best.cycles) {
+				best = candidate;
+				found = true;
+			}
+		}
+	}
+	if(!found) {
+		result.skipped = "the branch condition cannot be computed an iteration ahead";
+		return result;
+	}
+	if(best.code == &renamed) {
+		result.moved = moved;
+	}
+	std::vector<struct scad_instruction> const& code = *best.code;
+	
+	// Prologue, kernel and drain replace the loop.
+	cl_ulong kernel_start = loop + best.ahead.size();
+	cl_ulong drain_start = kernel_start + best.kernel.size();
+	cl_ulong delta = drain_start + best.drain.size() - (end + 1);
+	auto relocate = [&](cl_ulong address) {
+		return address > end ? address + delta : address;
+	};
+	
+	// Original address of every new instruction, the index of the discarding
+	// moves.
+	std::vector<std::pair<cl_ulong, bool>> origin;
+	for(cl_ulong pc = 0; pc < loop; pc++) {
+		origin.push_back({pc, false});
+	}
+	for(cl_ulong pc: best.ahead) {
+		origin.push_back({pc, false});
+	}
+	for(auto const& move: best.kernel) {
+		origin.push_back({move.first, false});
+	}
+	for(size_t i = 0; i < best.drain.size(); i++) {
+		origin.push_back({i, true});
+	}
+	for(cl_ulong pc = end + 1; pc < program.size(); pc++) {
+		origin.push_back({pc, false});
+	}
+	
+	result.program.clear();
+	result.references.clear();
+	for(auto const& old: origin) {
+		if(old.second) {
+			result.program.push_back(best.drain[old.first]);
+			continue;
+		}
+		struct scad_instruction instr = code[old.first];
+		bool is_target = instr.op == SCAD_MOVE_IMMEDIATE && instr.to.unit == 0 && instr.to.buffer == 1;
+		if(old.first == target_move) {
+			instr.immediate.integer = kernel_start;
+		} else if(references.count(old.first) || instr.op == SCAD_MOVE_PC || is_target) {
+			instr.immediate.integer = relocate(instr.immediate.integer);
+		}
+		if(references.count(old.first)) {
+			result.references.insert(result.program.size());
+		}
+		result.program.push_back(instr);
+	}
+	result.labels.clear();
+	for(cl_ulong label: labels) {
+		if(label <= loop || label > end) {
+			result.labels.insert(relocate(label));
+		}
+	}
+	result.labels.insert(kernel_start);
+	result.labels.insert(drain_start);
+	result.ahead.insert(best.ahead.begin(), best.ahead.end());
+	result.cycles_before = estimate_cycles(proc, std::vector<struct scad_instruction>(program.begin() + loop,
+	                                                                                   program.begin() + end + 1), {});
+	result.cycles_after = best.cycles;
+	
+	// Values of the next iteration raise the occupancy of the buffers.
+	if(!analyze(proc, result.program).deadlocks.empty() && analyze(proc, program).deadlocks.empty()) {
+		result.program = program;
+		result.labels = labels;
+		result.references = references;
+		result.ahead.clear();
+		result.moved.clear();
+		result.skipped = "the next iteration deadlocks with the configured buffer depth";
+	}
+	
+	return result;
+}
+
+static std::string instruction_text(processor_description const& proc, struct scad_instruction const& instr) {
+	switch(instr.op) {
+		case SCAD_MOVE:
+			return proc.buffer_name(instr.from, false) + " -> " + proc.buffer_name(instr.to, true);
+		case SCAD_MOVE_IMMEDIATE:
+			// Opcodes have a count, plain values fit the lower word.
+			if(instr.immediate.op.count != 0) {
+				return "(" + std::to_string(instr.immediate.op.opcode) + ", "
+				       + std::to_string(instr.immediate.op.count) + ") -> " + proc.buffer_name(instr.to, true);
+			}
+			return "$" + std::to_string(instr.immediate.integer) + " -> " + proc.buffer_name(instr.to, true);
+		case SCAD_MOVE_PC:
+			return "$" + std::to_string(instr.immediate.integer) + " -> pc";
+		default:
+			return "invalid";
+	}
+}
+
+void schedule_write_dot(std::ostream &out, processor_description const& proc,
+                        std::vector<struct scad_instruction> const& program,
+                        schedule_result const& schedule) {
+	out << "digraph schedule {" << std::endl
+	    << "\tnode [shape=box, fontname=\"monospace\"];" << std::endl;
+	
+	for(auto const& block: basic_blocks(program, schedule.blocks)) {
+		out << "\tsubgraph cluster_" << block.first << " {" << std::endl
+		    << "\t\tlabel=\"block " << block.first << "\";" << std::endl;
+		for(cl_ulong pc = block.first; pc < block.second; pc++) {
+			out << "\t\tn" << pc << " [label=\"" << pc << " => " << schedule.position[pc] << ": "
+			    << instruction_text(proc, program[pc]) << "\"];" << std::endl;
+		}
+		out << "\t}" << std::endl;
+	}
+	
+	for(auto const& dependency: schedule.dependencies) {
+		out << "\tn" << dependency.before << " -> n" << dependency.after
+		    << " [label=\"" << dependency.reason << "\"];" << std::endl;
+	}
+	out << "}" << std::endl;
+}
+
+} // namespace scad
@@ -0,0 +1,136 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_OPTIMIZE_HPP
+#define SCAD_OPTIMIZE_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <ostream>
+
+#include "common/instructions.h"
+#include "description.hpp"
+
+namespace scad {
+
+// Move i has to stay before move j, both addresses of the original program.
+class schedule_dependency {
+	public:
+		cl_ulong before;
+		cl_ulong after;
+		// "to": same input buffer, "from": same output buffer,
+		// "data": i feeds the unit j reads from, "control": branch order.
+		std::string reason;
+};
+
+class schedule_result {
+	public:
+		std::vector<struct scad_instruction> program;
+		// New address of every instruction of the original program.
+		std::vector<cl_ulong> position;
+		std::vector<schedule_dependency> dependencies;
+		// Start addresses of the basic blocks.
+		std::set<cl_ulong> blocks;
+		
+		unsigned long cycles_before = 0;
+		unsigned long cycles_after = 0;
+		
+		// Reordering made the program deadlock with the configured buffer
+		// depth, program is the original then.
+		bool reverted = false;
+};
+
+// Rough cycle count for one pass through every basic block: one cycle per
+// move and per ACK wait on the same unit, plus the time branches wait for
+// their condition.
+unsigned long estimate_cycles(processor_description const& proc,
+                              std::vector<struct scad_instruction> const& program,
+                              std::set<cl_ulong> const& labels);
+
+// Reorders moves inside basic blocks (split at labels and branches) so long
+// latency chains start first and consecutive moves go to different units.
+// Moves to and from the same buffer, moves that feed a unit and moves that
+// read from it, and moves to the control unit keep their order.
+schedule_result schedule_moves(processor_description const& proc,
+                               std::vector<struct scad_instruction> const& program,
+                               std::set<cl_ulong> const& labels);
+
+class elimination_result {
+	public:
+		std::vector<struct scad_instruction> program;
+		// Labels and label references at their new addresses.
+		std::set<cl_ulong> labels;
+		std::set<cl_ulong> references;
+		
+		unsigned long removed_moves = 0;
+		unsigned long removed_copies = 0;
+		// Empty if the pass ran, otherwise why the program is unchanged.
+		std::string skipped;
+};
+
+// Lowers the count of (op, count) immediates whose last copies are moved to
+// null on every path, and deletes these moves. Moves to null that never
+// receive data are deleted as well. Copies are followed through all paths
+// of the program, references are the instructions that move labels.
+elimination_result eliminate_dead_copies(processor_description const& proc,
+                                         std::vector<struct scad_instruction> const& program,
+                                         std::set<cl_ulong> const& labels,
+                                         std::set<cl_ulong> const& references);
+
+class pipeline_result {
+	public:
+		std::vector<struct scad_instruction> program;
+		// Labels and label references at their new addresses.
+		std::set<cl_ulong> labels;
+		std::set<cl_ulong> references;
+		// Moves of the loop that run one iteration ahead, original addresses.
+		std::set<cl_ulong> ahead;
+		// Operations of these moves that run on a free pu instead (address of
+		// their opcode move), with their operand and result moves.
+		std::map<cl_ulong, scad_address_part> moved;
+		// Estimated cycles of an iteration of the loop and of the kernel.
+		unsigned long cycles_before = 0;
+		unsigned long cycles_after = 0;
+		// Empty if the pass ran, otherwise why the program is unchanged.
+		std::string skipped;
+};
+
+// Software pipelining of the loop starting at address loop, a single block
+// that ends with the branch back to it. The moves the branch condition
+// depends on run one iteration ahead of the others: a prologue computes the
+// first condition, every pass of the kernel the rest of an iteration and the
+// condition of the next one, then branches on the condition of the pass
+// before. The control unit finds it ready instead of waiting for its chain.
+// These moves may only touch pus and robs, the last pass computes one
+// condition too many and a drain after the loop discards its values. The
+// change is dropped if a move would take another value than in the loop,
+// checked on a few unrolled iterations, or if it deadlocks with the buffer
+// depth.
+// Addresses after the loop move, so pipeline later loops first.
+pipeline_result pipeline_loop(processor_description const& proc,
+                              std::vector<struct scad_instruction> const& program,
+                              std::set<cl_ulong> const& labels,
+                              std::set<cl_ulong> const& references,
+                              cl_ulong loop);
+
+// Dependency graph of a schedule in graphviz format, one cluster per block.
+void schedule_write_dot(std::ostream &out, processor_description const& proc,
+                        std::vector<struct scad_instruction> const& program,
+                        schedule_result const& schedule);
+
+} // namespace scad
+
+#endif /* SCAD_OPTIMIZE_HPP */
@@ -0,0 +1,406 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <cctype>
+#include <algorithm>
+
+#include "preprocess.hpp"
+
+namespace scad {
+
+// Macros that expand themselves stop here.
+static int const max_depth = 64;
+
+static bool is_name_char(char c) {
+	return std::isalnum((unsigned char) c) || c == '_';
+}
+
+static std::string trim(std::string const& str) {
+	size_t first = str.find_first_not_of(" \t\r");
+	if(first == std::string::npos) {
+		return "";
+	}
+	size_t last = str.find_last_not_of(" \t\r");
+	return str.substr(first, last - first + 1);
+}
+
+static std::string strip_comment(std::string const& line) {
+	size_t comment = line.find("//");
+	return comment == std::string::npos ? line : line.substr(0, comment);
+}
+
+// Leading name of str, rest is set to what follows it.
+static std::string leading_name(std::string const& str, std::string &rest) {
+	size_t end = 0;
+	while(end < str.size() && is_name_char(str[end])) {
+		end++;
+	}
+	// str may be rest itself.
+	std::string name = str.substr(0, end);
+	rest = trim(str.substr(end));
+	return name;
+}
+
+// Comma separated list, commas inside parentheses do not split.
+static std::vector<std::string> split_arguments(std::string const& str) {
+	std::vector<std::string> arguments;
+	if(trim(str) == "") {
+		return arguments;
+	}
+	int parentheses = 0;
+	std::string current;
+	for(char c: str) {
+		if(c == ',' && parentheses == 0) {
+			arguments.push_back(trim(current));
+			current.clear();
+			continue;
+		}
+		parentheses += (c == '(') - (c == ')');
+		current += c;
+	}
+	arguments.push_back(trim(current));
+	return arguments;
+}
+
+// Recursive descent, one function per precedence level.
+class expression_parser {
+	std::string const& text;
+	std::map<std::string, cl_long> const& symbols;
+	size_t pos = 0;
+	
+	void skip_space() {
+		while(pos < text.size() && std::isspace((unsigned char) text[pos])) {
+			pos++;
+		}
+	}
+	
+	bool accept(std::string const& op) {
+		skip_space();
+		if(text.compare(pos, op.size(), op) != 0) {
+			return false;
+		}
+		pos += op.size();
+		return true;
+	}
+	
+	cl_long primary() {
+		skip_space();
+		if(accept("(")) {
+			cl_long value = bit_or();
+			if(!accept(")")) {
+				throw preprocessor_exception("missing ')' in expression: " + text);
+			}
+			return value;
+		}
+		if(accept("-")) {
+			return -primary();
+		}
+		if(accept("~")) {
+			return ~primary();
+		}
+		if(accept("+")) {
+			return primary();
+		}
+		if(pos < text.size() && std::isdigit((unsigned char) text[pos])) {
+			size_t length = 0;
+			cl_long value = 0;
+			try {
+				value = std::stoull(text.substr(pos), &length, 0);
+			} catch(std::exception &e) {
+				throw preprocessor_exception("invalid number in expression: " + text);
+			}
+			pos += length;
+			return value;
+		}
+		std::string rest;
+		std::string name = leading_name(text.substr(pos), rest);
+		if(name == "") {
+			throw preprocessor_exception("unexpected '" + text.substr(pos) + "' in expression: " + text);
+		}
+		if(!symbols.count(name)) {
+			throw preprocessor_exception("undefined symbol '" + name + "' in expression: " + text);
+		}
+		pos += name.size();
+		return symbols.at(name);
+	}
+	
+	cl_long multiplicative() {
+		cl_long value = primary();
+		while(true) {
+			if(accept("*")) {
+				value *= primary();
+			} else if(accept("/") || accept("%")) {
+				bool modulo = text[pos - 1] == '%';
+				cl_long divisor = primary();
+				if(divisor == 0) {
+					throw preprocessor_exception("division by zero in expression: " + text);
+				}
+				value = modulo ? value % divisor : value / divisor;
+			} else {
+				return value;
+			}
+		}
+	}
+	
+	cl_long additive() {
+		cl_long value = multiplicative();
+		while(true) {
+			if(accept("+")) {
+				value += multiplicative();
+			} else if(accept("-")) {
+				value -= multiplicative();
+			} else {
+				return value;
+			}
+		}
+	}
+	
+	cl_long shift() {
+		cl_long value = additive();
+		while(true) {
+			if(accept("<<")) {
+				value = (cl_long) ((cl_ulong) value << additive());
+			} else if(accept(">>")) {
+				value >>= additive();
+			} else {
+				return value;
+			}
+		}
+	}
+	
+	cl_long bit_and() {
+		cl_long value = shift();
+		while(accept("&")) {
+			value &= shift();
+		}
+		return value;
+	}
+	
+	cl_long bit_xor() {
+		cl_long value = bit_and();
+		while(accept("^")) {
+			value ^= bit_and();
+		}
+		return value;
+	}
+	
+	cl_long bit_or() {
+		cl_long value = bit_xor();
+		while(accept("|")) {
+			value |= bit_xor();
+		}
+		return value;
+	}
+	
+	public:
+		expression_parser(std::string const& text, std::map<std::string, cl_long> const& symbols)
+			: text(text), symbols(symbols) {}
+		
+		cl_long parse() {
+			cl_long value = bit_or();
+			skip_space();
+			if(pos != text.size()) {
+				throw preprocessor_exception("unexpected '" + text.substr(pos) + "' in expression: " + text);
+			}
+			return value;
+		}
+};
+
+void preprocessor::error(std::string const& message) const {
+	throw preprocessor_exception("line " + std::to_string(line_number) + ": " + message);
+}
+
+void preprocessor::define(std::string const& name, cl_long value) {
+	symbols[name] = value;
+}
+
+void preprocessor::define(std::string const& definition) {
+	size_t equals = definition.find('=');
+	std::string name = trim(definition.substr(0, equals));
+	std::string rest;
+	if(name == "" || leading_name(name, rest) != name) {
+		throw preprocessor_exception("invalid symbol name in definition: " + definition);
+	}
+	define(name, equals == std::string::npos ? 1 : evaluate(definition.substr(equals + 1)));
+}
+
+cl_long preprocessor::evaluate(std::string const& expression) const {
+	return expression_parser(expression, symbols).parse();
+}
+
+// Replaces $(<expr>) and $NAME by the decimal value.
+std::string preprocessor::substitute(std::string const& line) const {
+	std::string result;
+	size_t pos = 0;
+	while(true) {
+		size_t dollar = line.find('$', pos);
+		if(dollar == std::string::npos) {
+			return result + line.substr(pos);
+		}
+		result += line.substr(pos, dollar + 1 - pos);
+		pos = dollar + 1;
+		
+		if(pos < line.size() && line[pos] == '(') {
+			int parentheses = 1;
+			size_t end = pos + 1;
+			for(; end < line.size() && parentheses > 0; end++) {
+				parentheses += (line[end] == '(') - (line[end] == ')');
+			}
+			if(parentheses > 0) {
+				error("missing ')' in: " + line);
+			}
+			// Negative values wrap around like in C.
+			try {
+				result += std::to_string((cl_ulong) evaluate(line.substr(pos + 1, end - pos - 2)));
+			} catch(preprocessor_exception &e) {
+				error(e.what());
+			}
+			pos = end;
+		} else if(pos < line.size() && !std::isdigit((unsigned char) line[pos])) {
+			std::string rest;
+			std::string name = leading_name(line.substr(pos), rest);
+			if(name == "" || !symbols.count(name)) {
+				error("undefined symbol '" + name + "' in: " + line);
+			}
+			result += std::to_string((cl_ulong) symbols.at(name));
+			pos += name.size();
+		}
+	}
+}
+
+void preprocessor::feed(std::string const& line, int depth, std::function<void(std::string const&)> const& emit) {
+	std::string code = trim(strip_comment(line));
+	std::string rest;
+	std::string directive = code.size() > 1 && code[0] == '.' ? leading_name(code.substr(1), rest) : "";
+	
+	// Inside a body only nesting is tracked, directives run on expansion.
+	if(reading.nesting > 0) {
+		if(directive == "macro" || directive == "rept") {
+			reading.nesting++;
+		} else if(directive == "endm" || directive == "endr") {
+			reading.nesting--;
+		}
+		if(reading.nesting > 0) {
+			reading.body.push_back(line);
+			return;
+		}
+		if(directive != (reading.directive == "macro" ? "endm" : "endr")) {
+			error("." + directive + " closes ." + reading.directive);
+		}
+		
+		block done = std::move(reading);
+		reading = block();
+		if(done.directive == "macro") {
+			macros[done.name] = {done.params, std::move(done.body)};
+		} else {
+			for(cl_long i = 0; i < done.count; i++) {
+				for(auto const& body_line: done.body) {
+					feed(body_line, depth + 1, emit);
+				}
+			}
+		}
+		return;
+	}
+	
+	if(directive == "set") {
+		std::string name = leading_name(rest, rest);
+		if(name == "") {
+			error(".set needs a name");
+		}
+		if(rest.size() > 0 && rest[0] == ',') {
+			rest = trim(rest.substr(1));
+		}
+		try {
+			define(name, evaluate(rest));
+		} catch(preprocessor_exception &e) {
+			error(e.what());
+		}
+	} else if(directive == "macro") {
+		reading.directive = directive;
+		reading.name = leading_name(rest, rest);
+		if(reading.name == "") {
+			error(".macro needs a name");
+		}
+		reading.params = split_arguments(rest);
+		reading.nesting = 1;
+	} else if(directive == "rept") {
+		reading.directive = directive;
+		try {
+			reading.count = evaluate(rest);
+		} catch(preprocessor_exception &e) {
+			error(e.what());
+		}
+		reading.nesting = 1;
+	} else if(directive != "") {
+		error("unknown or unmatched directive: ." + directive);
+	} else if(macros.count(leading_name(code, rest)) && (rest == "" || code[code.size() - rest.size() - 1] == ' '
+	                                                     || code[code.size() - rest.size() - 1] == '\t')) {
+		std::string name = leading_name(code, rest);
+		if(depth >= max_depth) {
+			error("macro '" + name + "' nested deeper than " + std::to_string(max_depth));
+		}
+		macro const& expanded = macros.at(name);
+		std::vector<std::string> arguments = split_arguments(rest);
+		if(arguments.size() != expanded.params.size()) {
+			error("macro '" + name + "' takes " + std::to_string(expanded.params.size())
+			      + " arguments, got " + std::to_string(arguments.size()));
+		}
+		std::string unique = std::to_string(expansions++);
+		
+		// Copied, the macro can be redefined while it expands.
+		std::vector<std::string> body = expanded.body;
+		std::vector<std::string> params = expanded.params;
+		for(auto const& body_line: body) {
+			std::string replaced;
+			for(size_t pos = 0; pos < body_line.size(); pos++) {
+				if(body_line[pos] != '\\') {
+					replaced += body_line[pos];
+				} else if(pos + 1 < body_line.size() && body_line[pos + 1] == '@') {
+					replaced += unique;
+					pos++;
+				} else {
+					std::string param = leading_name(body_line.substr(pos + 1), rest);
+					auto it = std::find(params.begin(), params.end(), param);
+					if(it == params.end()) {
+						error("macro '" + name + "' has no parameter '" + param + "'");
+					}
+					replaced += arguments[it - params.begin()];
+					pos += param.size();
+				}
+			}
+			feed(replaced, depth + 1, emit);
+		}
+	} else if(code != "") {
+		emit(substitute(code));
+	}
+}
+
+void preprocessor::run(std::string const& source, std::function<void(std::string const&)> const& emit) {
+	line_number = 0;
+	size_t pos = 0;
+	while(pos < source.size()) {
+		size_t end = source.find('\n', pos);
+		if(end == std::string::npos) {
+			end = source.size();
+		}
+		line_number++;
+		feed(source.substr(pos, end - pos), 0, emit);
+		pos = end + 1;
+	}
+	if(reading.nesting > 0) {
+		error("." + reading.directive + " without ." + (reading.directive == "macro" ? "endm" : "endr"));
+	}
+}
+
+} // namespace scad
@@ -0,0 +1,83 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_PREPROCESS_HPP
+#define SCAD_PREPROCESS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <stdexcept>
+
+#include "common/instructions.h"
+
+namespace scad {
+
+class preprocessor_exception : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+// Expands directives of assembly source line by line:
+//   .set NAME <expr>             compile-time symbol
+//   .macro NAME [param, ...]     macro definition up to .endm,
+//                                \param is replaced by the argument and
+//                                \@ by a number unique per expansion
+//   NAME [arg, ...]              macro expansion
+//   .rept <expr>                 repeats the lines up to .endr
+// $(<expr>) and $NAME in moves become the decimal value. Expressions are
+// 64 bit integers with the operators of C (without comparisons), numbers
+// can be hexadecimal with 0x.
+// Only macro and .rept bodies are stored, every other line goes to the
+// output as soon as it is read.
+class preprocessor {
+	struct macro {
+		std::vector<std::string> params;
+		std::vector<std::string> body;
+	};
+	
+	// Body of the .macro or .rept read at the moment.
+	struct block {
+		std::string directive;
+		std::string name;
+		std::vector<std::string> params;
+		cl_long count = 0;
+		std::vector<std::string> body;
+		int nesting = 0;
+	};
+	
+	std::map<std::string, cl_long> symbols;
+	std::map<std::string, macro> macros;
+	block reading;
+	unsigned long expansions = 0;
+	unsigned long line_number = 0;
+	
+	[[noreturn]] void error(std::string const& message) const;
+	std::string substitute(std::string const& line) const;
+	void feed(std::string const& line, int depth, std::function<void(std::string const&)> const& emit);
+	
+	public:
+		void define(std::string const& name, cl_long value);
+		// NAME=<expr> or NAME (which is 1), as given with -D.
+		void define(std::string const& definition);
+		// Value of an expression with the symbols defined so far.
+		cl_long evaluate(std::string const& expression) const;
+		
+		// Passes every line of the expanded source to emit, in order.
+		void run(std::string const& source, std::function<void(std::string const&)> const& emit);
+};
+
+} // namespace scad
+
+#endif /* SCAD_PREPROCESS_HPP */
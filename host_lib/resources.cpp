@@ -0,0 +1,224 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+
+#include "resources.hpp"
+
+namespace scad {
+
+static double parse_number(std::string const& text, std::string const& line) {
+	try {
+		size_t length = 0;
+		double value = std::stod(text, &length);
+		if(length == text.size()) {
+			return value;
+		}
+	} catch(std::exception &e) {
+	}
+	throw resource_exception("Not a number '" + text + "' in: " + line);
+}
+
+static std::vector<std::string> parse_scale(std::string const& text) {
+	std::vector<std::string> factors;
+	std::istringstream stream(text);
+	std::string factor;
+	while(std::getline(stream, factor, '*')) {
+		factors.push_back(factor);
+	}
+	return factors;
+}
+
+static double scale_value(std::vector<std::string> const& scale, std::map<std::string, std::string> const& parameters,
+                          std::string const& implementation) {
+	double value = 1;
+	for(auto const& factor: scale) {
+		auto it = parameters.find(factor);
+		std::string text = it != parameters.end() ? it->second : factor;
+		try {
+			size_t length = 0;
+			double number = std::stod(text, &length);
+			if(length == text.size()) {
+				value *= number;
+				continue;
+			}
+		} catch(std::exception &e) {
+		}
+		throw resource_exception("Cost of " + implementation + " needs " + factor + ", which is "
+		                         + (it != parameters.end() ? "not a number: " + text : "not set"));
+	}
+	return value;
+}
+
+resource_model::resource_model(std::string const& filename) {
+	std::ifstream stream(filename);
+	if(!stream) {
+		throw resource_exception("Could not open cost table '" + filename + "'");
+	}
+	std::string line;
+	while(std::getline(stream, line)) {
+		std::istringstream fields(line.substr(0, line.find('#')));
+		std::vector<std::string> words((std::istream_iterator<std::string>(fields)),
+		                               std::istream_iterator<std::string>());
+		if(words.empty()) {
+			continue;
+		}
+		
+		if(words[0] == "board") {
+			if(words.size() != 7) {
+				throw resource_exception("Expected board <name> <ALMs> <registers> <M20Ks> <DSPs> <MHz>: " + line);
+			}
+			board_preset preset;
+			preset.name = words[1];
+			preset.available.alms = parse_number(words[2], line);
+			preset.available.registers = parse_number(words[3], line);
+			preset.available.m20ks = parse_number(words[4], line);
+			preset.available.dsps = parse_number(words[5], line);
+			preset.clock = parse_number(words[6], line);
+			boards[preset.name] = preset;
+		} else if(words.size() >= 3 && words[1] == "fmax") {
+			if(words.size() != 3 && words.size() != 5) {
+				throw resource_exception("Expected <implementation> fmax <MHz> [<scale> <MHz>]: " + line);
+			}
+			clock_limit limit = {parse_number(words[2], line), {}, 0};
+			if(words.size() == 5) {
+				limit.scale = parse_scale(words[3]);
+				limit.per_scale = parse_number(words[4], line);
+			}
+			limits[words[0]] = limit;
+		} else {
+			if(words.size() != 6) {
+				throw resource_exception("Expected <implementation> <scale> <ALMs> <registers> <M20Ks> <DSPs>: " + line);
+			}
+			cost entry;
+			entry.scale = parse_scale(words[1]);
+			entry.usage.alms = parse_number(words[2], line);
+			entry.usage.registers = parse_number(words[3], line);
+			entry.usage.m20ks = parse_number(words[4], line);
+			entry.usage.dsps = parse_number(words[5], line);
+			costs[words[0]].push_back(entry);
+		}
+	}
+}
+
+void resource_model::add(resource_usage &usage, std::string const& implementation,
+                         std::map<std::string, std::string> const& parameters) const {
+	auto found = costs.find(implementation);
+	if(found == costs.end()) {
+		if(std::find(usage.unknown.begin(), usage.unknown.end(), implementation) == usage.unknown.end()) {
+			usage.unknown.push_back(implementation);
+		}
+		return;
+	}
+	double m20ks = 0;
+	for(auto const& entry: found->second) {
+		double scale = scale_value(entry.scale, parameters, implementation);
+		usage.alms += scale * entry.usage.alms;
+		usage.registers += scale * entry.usage.registers;
+		m20ks += scale * entry.usage.m20ks;
+		usage.dsps += scale * entry.usage.dsps;
+	}
+	// Units do not share memory blocks.
+	usage.m20ks += std::ceil(m20ks);
+	
+	auto limit = limits.find(implementation);
+	if(limit != limits.end()) {
+		double fmax = limit->second.fmax;
+		if(!limit->second.scale.empty()) {
+			fmax -= limit->second.per_scale * scale_value(limit->second.scale, parameters, implementation);
+			// The linear model says nothing for machines far beyond the table.
+			fmax = std::max(fmax, 1.0);
+		}
+		usage.fmax = usage.fmax == 0 ? fmax : std::min(usage.fmax, fmax);
+	}
+}
+
+resource_usage resource_model::estimate(processor_description const& proc) const {
+	std::map<std::string, std::string> global = {
+		{"BUFFER_DEPTH", std::to_string(proc.buffer_size)},
+		{"UNIT_COUNT", std::to_string(proc.interconnect->size)},
+		{"UNIT_COUNT_LOG2", std::to_string((int) std::ceil(std::log2(std::max(2, proc.interconnect->size))))},
+		{"TRACE_SAMPLE", std::to_string(proc.trace_sample)},
+	};
+	
+	resource_usage usage;
+	add(usage, "processor", global);
+	add(usage, proc.interconnect->implementation, global);
+	if(proc.trace_sample > 0) {
+		add(usage, "trace", global);
+	}
+	for(auto const& unit: proc.units) {
+		std::map<std::string, std::string> parameters = unit.second->parameters;
+		parameters.insert(global.begin(), global.end());
+		parameters["BUFFERS"] = std::to_string(unit.second->input_buffers.size() + unit.second->output_buffers.size());
+		add(usage, unit.second->implementation, parameters);
+	}
+	
+	return usage;
+}
+
+board_preset const& resource_model::board(std::string const& name) const {
+	auto it = boards.find(name);
+	if(it == boards.end()) {
+		std::string known;
+		for(auto const& preset: boards) {
+			known += (known == "" ? "" : ", ") + preset.first;
+		}
+		throw resource_exception("Unknown board '" + name + "', known are: " + known);
+	}
+	return it->second;
+}
+
+std::vector<std::string> resource_model::check(resource_usage const& usage, board_preset const& board) const {
+	std::vector<std::string> problems;
+	auto fits = [&](double used, double available, std::string const& what) {
+		if(used > available) {
+			std::ostringstream problem;
+			problem << std::fixed;
+			problem.precision(0);
+			problem << used << " of " << available << " " << what;
+			problems.push_back(problem.str());
+		}
+	};
+	fits(usage.alms, board.available.alms, "ALMs");
+	fits(usage.registers, board.available.registers, "registers");
+	fits(usage.m20ks, board.available.m20ks, "M20Ks");
+	fits(usage.dsps, board.available.dsps, "DSPs");
+	if(usage.fmax != 0 && usage.fmax < board.clock) {
+		std::ostringstream problem;
+		problem << std::fixed;
+		problem.precision(0);
+		problem << usage.fmax << " MHz, needs " << board.clock << " MHz";
+		problems.push_back(problem.str());
+	}
+	return problems;
+}
+
+std::string format_usage(resource_usage const& usage) {
+	std::ostringstream text;
+	text << std::fixed;
+	text.precision(0);
+	text << usage.alms << " ALMs, " << usage.registers << " registers, "
+	     << usage.m20ks << " M20Ks, " << usage.dsps << " DSPs";
+	if(usage.fmax != 0) {
+		text << ", " << usage.fmax << " MHz";
+	}
+	return text.str();
+}
+
+} // namespace scad
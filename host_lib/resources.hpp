@@ -0,0 +1,92 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_RESOURCES_HPP
+#define SCAD_RESOURCES_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+#include "description.hpp"
+
+namespace scad {
+
+class resource_exception : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+class resource_usage {
+	public:
+		double alms = 0;
+		double registers = 0;
+		double m20ks = 0;
+		double dsps = 0;
+		// Estimated highest clock in MHz, 0 if no implementation limits it.
+		double fmax = 0;
+		// Implementations without costs in the table.
+		std::vector<std::string> unknown;
+};
+
+class board_preset {
+	public:
+		std::string name;
+		resource_usage available;
+		// Lowest acceptable kernel clock in MHz.
+		double clock = 0;
+};
+
+// Cost table of the implementations, the format is described in
+// device_implementations/resources.txt.
+class resource_model {
+	struct cost {
+		// Factors of the scale, numbers or names.
+		std::vector<std::string> scale;
+		resource_usage usage;
+	};
+	struct clock_limit {
+		double fmax;
+		std::vector<std::string> scale;
+		double per_scale;
+	};
+	
+	std::map<std::string, std::vector<cost>> costs;
+	std::map<std::string, clock_limit> limits;
+	std::map<std::string, board_preset> boards;
+	
+	void add(resource_usage &usage, std::string const& implementation,
+	         std::map<std::string, std::string> const& parameters) const;
+	
+	public:
+		// Throws resource_exception if the file cannot be read or parsed.
+		explicit resource_model(std::string const& filename);
+		
+		// Throws resource_exception if a scale names a parameter the unit
+		// does not have.
+		resource_usage estimate(processor_description const& proc) const;
+		
+		// Throws resource_exception for unknown boards.
+		board_preset const& board(std::string const& name) const;
+		
+		// What does not fit or is too slow, empty if usage fits the board.
+		std::vector<std::string> check(resource_usage const& usage, board_preset const& board) const;
+};
+
+// "14200 ALMs, 30100 registers, 12 M20Ks, 4 DSPs, 250 MHz"
+std::string format_usage(resource_usage const& usage);
+
+} // namespace scad
+
+#endif /* SCAD_RESOURCES_HPP */
@@ -0,0 +1,365 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include "simulator.hpp"
+
+namespace scad {
+
+static bool address_is_reserved(struct scad_buffer_address address) {
+	return address.unit == SCAD_ADDRESS_NULL && address.buffer == SCAD_ADDRESS_NULL;
+}
+
+static bool has_data(std::deque<simulator_slot> const& input) {
+	return !input.empty() && input.front().set;
+}
+
+static scad_data pop(std::deque<simulator_slot> &input) {
+	scad_data data = input.front().data;
+	input.pop_front();
+	return data;
+}
+
+scad_data pu_eval(scad_data left, scad_data right, cl_uint opcode) {
+	cl_ulong l = left.integer, r = right.integer;
+	cl_long ls = (cl_long) l, rs = (cl_long) r;
+	switch(opcode) {
+		case SCAD_PU_ADDN: return (scad_data) {.integer = l + r};
+		case SCAD_PU_SUBN: return (scad_data) {.integer = l - r};
+		case SCAD_PU_MULN: return (scad_data) {.integer = l * r};
+		case SCAD_PU_DIVN: if(r) return (scad_data) {.integer = l / r}; break;
+		case SCAD_PU_MODN: if(r) return (scad_data) {.integer = l % r}; break;
+		case SCAD_PU_LESN: return (scad_data) {.integer = l < r};
+		case SCAD_PU_LEQN: return (scad_data) {.integer = l <= r};
+		case SCAD_PU_EQQN: return (scad_data) {.integer = l == r};
+		case SCAD_PU_NEQN: return (scad_data) {.integer = l != r};
+		
+		case SCAD_PU_ADDZ: return (scad_data) {.integer = (cl_ulong) (ls + rs)};
+		case SCAD_PU_SUBZ: return (scad_data) {.integer = (cl_ulong) (ls - rs)};
+		case SCAD_PU_MULZ: return (scad_data) {.integer = (cl_ulong) (ls * rs)};
+		case SCAD_PU_DIVZ: if(rs) return (scad_data) {.integer = (cl_ulong) (ls / rs)}; break;
+		case SCAD_PU_MODZ: if(rs) return (scad_data) {.integer = (cl_ulong) (ls % rs)}; break;
+		case SCAD_PU_LESZ: return (scad_data) {.integer = ls < rs};
+		case SCAD_PU_LEQZ: return (scad_data) {.integer = ls <= rs};
+		case SCAD_PU_EQQZ: return (scad_data) {.integer = ls == rs};
+		case SCAD_PU_NEQZ: return (scad_data) {.integer = ls != rs};
+		
+		case SCAD_PU_ANDB: return (scad_data) {.integer = l & r};
+		case SCAD_PU_ORB:  return (scad_data) {.integer = l | r};
+		case SCAD_PU_EQQB: return (scad_data) {.integer = ~(l ^ r)};
+		case SCAD_PU_NEQB: return (scad_data) {.integer = l ^ r};
+		
+		default:
+			throw simulator_exception("Invalid processing unit opcode: " + std::to_string(opcode));
+	}
+	// Division by zero.
+	return (scad_data) {.integer = (cl_ulong) -1};
+}
+
+simulator_unit::simulator_unit(std::shared_ptr<unit_description> description, size_t memory_size)
+	:description(description),
+	 inputs(description->input_buffers.size()),
+	 output_to(description->output_buffers.size()),
+	 output_data(description->output_buffers.size()),
+	 memory(memory_size, (scad_data) {.integer = 0}) {
+
+}
+
+simulator::simulator(processor_description const& proc, size_t memory_size)
+	:proc(proc) {
+	for(auto const& unit_entry: proc.units) {
+		auto unit = unit_entry.second;
+		size_t unit_memory = 0;
+		if(unit->type == "lsu" || unit->type == "memory_stream_in" || unit->type == "memory_stream_out") {
+			unit_memory = unit->parameters.count("MEMORY_SIZE")
+				? std::stoul(unit->parameters.at("MEMORY_SIZE")) : memory_size;
+		} else if(unit->type != "cu" && unit->type != "pu" && unit->type != "rob") {
+			throw simulator_exception("Unit type '" + unit->type + "' of " + unit->name
+			                          + " is not supported by the simulator.");
+		}
+		units.emplace(unit->number, simulator_unit(unit, unit_memory));
+	}
+	
+	if(units.count(0) == 0 || units.at(0).description->type != "cu") {
+		throw simulator_exception("The control unit needs to be given number 0.");
+	}
+}
+
+std::vector<scad_data> &simulator::memory(std::string unit) {
+	if(proc.units.count(unit) == 0) {
+		throw simulator_exception("Unit '" + unit + "' not found.");
+	}
+	simulator_unit &u = units.at(proc.units.at(unit)->number);
+	if(u.memory.empty()) {
+		throw simulator_exception("Unit '" + unit + "' has no memory.");
+	}
+	return u.memory;
+}
+
+simulator_unit &simulator::unit_at(struct scad_buffer_address address) {
+	if(units.count(address.unit) == 0) {
+		throw simulator_exception("No unit with number " + std::to_string(address.unit) + ".");
+	}
+	return units.at(address.unit);
+}
+
+// Fill the oldest input slot waiting for data from the packet's source.
+// Returns false if the move for this packet has not been registered yet.
+bool simulator::deliver(struct scad_data_packet const& packet) {
+	simulator_unit &unit = unit_at(packet.to);
+	if(packet.to.buffer >= unit.inputs.size()) {
+		throw simulator_exception("Packet to invalid buffer " + std::to_string(packet.to.buffer)
+		                          + " of " + unit.description->name + ".");
+	}
+	for(auto &slot: unit.inputs[packet.to.buffer]) {
+		if(!slot.set && slot.from.unit == packet.from.unit && slot.from.buffer == packet.from.buffer) {
+			slot.data = packet.data;
+			slot.set = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Execute at most one operation of a unit. Returns true on progress.
+bool simulator::step_unit(simulator_unit &unit) {
+	std::string const& type = unit.description->type;
+	size_t depth = proc.buffer_size;
+	bool progress = false;
+	
+	if(type == "pu") {
+		if(unit.pending_copies == 0
+		   && has_data(unit.inputs[0]) && has_data(unit.inputs[1]) && has_data(unit.inputs[2])) {
+			scad_data left = pop(unit.inputs[0]);
+			scad_data right = pop(unit.inputs[1]);
+			scad_data opc = pop(unit.inputs[2]);
+			unit.pending_data = pu_eval(left, right, opc.op.opcode);
+			unit.pending_copies = opc.op.count;
+			unit.operations++;
+			progress = true;
+		}
+		if(unit.pending_copies > 0 && unit.output_data[0].size() < depth) {
+			unit.output_data[0].push_back(unit.pending_data);
+			unit.pending_copies--;
+			progress = true;
+		}
+	
+	} else if(type == "rob") {
+		for(size_t i = 0; i < unit.inputs.size(); i++) {
+			if(has_data(unit.inputs[i]) && unit.output_data[i].size() < depth) {
+				unit.output_data[i].push_back(pop(unit.inputs[i]));
+				unit.operations++;
+				progress = true;
+			}
+		}
+	
+	} else if(type == "lsu") {
+		if(unit.pending_copies == 0 && has_data(unit.inputs[2]) && has_data(unit.inputs[0])
+		   && (unit.inputs[2].front().data.op.opcode == SCAD_LSU_LOAD_ADDRESS
+		       || has_data(unit.inputs[1]))) {
+			scad_data opc = pop(unit.inputs[2]);
+			scad_data address = pop(unit.inputs[0]);
+			scad_data value = {.integer = 0};
+			if(opc.op.opcode != SCAD_LSU_LOAD_ADDRESS) {
+				value = pop(unit.inputs[1]);
+			}
+			if(address.integer >= unit.memory.size()) {
+				throw simulator_exception("Invalid address " + std::to_string(address.integer)
+				                          + " on " + unit.description->name + ".");
+			}
+			switch(opc.op.opcode) {
+				case SCAD_LSU_STORE:
+					unit.memory[address.integer] = value;
+					statistics.stores++;
+					break;
+				case SCAD_LSU_LOAD:
+				case SCAD_LSU_LOAD_ADDRESS:
+					unit.pending_data = unit.memory[address.integer];
+					unit.pending_copies = opc.op.count;
+					statistics.loads++;
+					break;
+				default:
+					throw simulator_exception("Invalid lsu opcode " + std::to_string(opc.op.opcode)
+					                          + " on " + unit.description->name + ".");
+			}
+			unit.operations++;
+			progress = true;
+		}
+		if(unit.pending_copies > 0 && unit.output_data[0].size() < depth) {
+			unit.output_data[0].push_back(unit.pending_data);
+			unit.pending_copies--;
+			progress = true;
+		}
+	
+	} else if(type == "memory_stream_in") {
+		if(unit.position < unit.memory.size() && unit.output_data[0].size() < depth) {
+			unit.output_data[0].push_back(unit.memory[unit.position++]);
+			unit.operations++;
+			statistics.loads++;
+			progress = true;
+		}
+	
+	} else if(type == "memory_stream_out") {
+		if(unit.position < unit.memory.size() && has_data(unit.inputs[0])) {
+			unit.memory[unit.position++] = pop(unit.inputs[0]);
+			unit.operations++;
+			statistics.stores++;
+			progress = true;
+		}
+	}
+	
+	return progress;
+}
+
+// Send one packet per output buffer that has both data and a destination.
+bool simulator::step_outputs(simulator_unit &unit, int number, std::vector<struct scad_data_packet> &sent) {
+	bool progress = false;
+	for(size_t i = 0; i < unit.output_data.size(); i++) {
+		if(!unit.output_data[i].empty() && !unit.output_to[i].empty()) {
+			struct scad_data_packet packet = {
+				.data = unit.output_data[i].front(),
+				.from = {(scad_address_part) number, (scad_address_part) i},
+				.to = unit.output_to[i].front()
+			};
+			unit.output_data[i].pop_front();
+			unit.output_to[i].pop_front();
+			// Moves to null delete data.
+			if(!address_is_reserved(packet.to)) {
+				sent.push_back(packet);
+				statistics.packets++;
+			}
+			progress = true;
+		}
+	}
+	return progress;
+}
+
+simulator_statistics simulator::run(std::vector<struct scad_instruction> const& program,
+                                    unsigned long max_cycles) {
+	simulator_unit &control = units.at(0);
+	size_t depth = proc.buffer_size;
+	
+	cl_ulong pc = 0;
+	bool done = false;
+	// Waiting for branch condition and target.
+	bool branch = false;
+	
+	while(true) {
+		if(statistics.cycles >= max_cycles) {
+			throw simulator_exception("Program did not finish within "
+			                          + std::to_string(max_cycles) + " cycles.");
+		}
+		bool progress = false;
+		
+		// Interconnect: deliver packets sent in the last cycle.
+		std::vector<struct scad_data_packet> sent;
+		for(auto const& packet: in_flight) {
+			if(deliver(packet)) {
+				progress = true;
+			} else {
+				sent.push_back(packet);
+			}
+		}
+		
+		for(auto &unit_entry: units) {
+			progress |= step_unit(unit_entry.second);
+			progress |= step_outputs(unit_entry.second, unit_entry.first, sent);
+		}
+		
+		// Control unit.
+		if(done) {
+			// Only units left to drain.
+		
+		} else if(branch) {
+			if(has_data(control.inputs[0]) && has_data(control.inputs[1])) {
+				scad_data condition = pop(control.inputs[0]);
+				scad_data target = pop(control.inputs[1]);
+				pc = condition.integer ? target.integer : pc + 1;
+				branch = false;
+				progress = true;
+			} else {
+				statistics.control_stalls++;
+			}
+		
+		} else if(pc >= program.size()) {
+			done = true;
+			progress = true;
+		
+		} else {
+			struct scad_instruction instr = program[pc];
+			bool to_null = address_is_reserved(instr.to);
+			
+			switch(instr.op) {
+				case SCAD_MOVE_PC:
+					pc = instr.immediate.integer;
+					statistics.moves++;
+					progress = true;
+					break;
+				
+				case SCAD_MOVE:
+				case SCAD_MOVE_IMMEDIATE: {
+					bool ready = to_null || unit_at(instr.to).inputs.at(instr.to.buffer).size() < depth;
+					if(instr.op == SCAD_MOVE) {
+						ready = ready && unit_at(instr.from).output_to.at(instr.from.buffer).size() < depth;
+					}
+					if(!ready) {
+						statistics.control_stalls++;
+						break;
+					}
+					
+					struct scad_buffer_address from = (instr.op == SCAD_MOVE)
+						? instr.from : (struct scad_buffer_address) {0, 0};
+					if(!to_null) {
+						unit_at(instr.to).inputs[instr.to.buffer].push_back({from, false, {.integer = 0}});
+					}
+					if(instr.op == SCAD_MOVE) {
+						unit_at(instr.from).output_to[instr.from.buffer].push_back(instr.to);
+					} else if(!to_null) {
+						sent.push_back({instr.immediate, from, instr.to});
+					}
+					
+					// Moves to cu@in0 branch, like on the device.
+					if(instr.op == SCAD_MOVE && instr.to.unit == 0 && instr.to.buffer == 0) {
+						branch = true;
+					} else {
+						pc++;
+					}
+					statistics.moves++;
+					progress = true;
+					break;
+				}
+				
+				default:
+					throw simulator_exception("Invalid instruction at " + std::to_string(pc) + ".");
+			}
+		}
+		
+		in_flight = sent;
+		
+		if(!progress) {
+			if(done && in_flight.empty()) {
+				break;
+			}
+			throw simulator_exception("Deadlock at pc " + std::to_string(pc)
+			                          + " after " + std::to_string(statistics.cycles) + " cycles.");
+		}
+		statistics.cycles++;
+	}
+	
+	for(auto const& unit_entry: units) {
+		statistics.operations[unit_entry.second.description->name] = unit_entry.second.operations;
+	}
+	return statistics;
+}
+
+} // namespace scad
@@ -0,0 +1,120 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_SIMULATOR_HPP
+#define SCAD_SIMULATOR_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include "common/instructions.h"
+#include "description.hpp"
+
+namespace scad {
+
+class simulator_exception : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+class simulator_statistics {
+	public:
+		unsigned long cycles = 0;
+		// Instructions executed by the control unit.
+		unsigned long moves = 0;
+		// Cycles the control unit waited for a buffer or a branch condition.
+		unsigned long control_stalls = 0;
+		unsigned long packets = 0;
+		// Words read and written by memory units.
+		unsigned long loads = 0;
+		unsigned long stores = 0;
+		// Operations per unit name.
+		std::map<std::string, unsigned long> operations;
+};
+
+// Result of a processing unit operation, same as processing_basic.
+// Throws simulator_exception on invalid opcodes.
+scad_data pu_eval(scad_data left, scad_data right, cl_uint opcode);
+
+// Input buffer entry: registered by a move, filled by a packet.
+struct simulator_slot {
+	struct scad_buffer_address from;
+	bool set;
+	scad_data data;
+};
+
+class simulator_unit {
+	public:
+		std::shared_ptr<unit_description> description;
+		
+		std::vector<std::deque<simulator_slot>> inputs;
+		std::vector<std::deque<struct scad_buffer_address>> output_to;
+		std::vector<std::deque<scad_data>> output_data;
+		
+		// Result copies that still need to be stored in the output buffer,
+		// one per step like the output buffer handling on the device.
+		scad_data pending_data;
+		cl_uint pending_copies = 0;
+		
+		// Memory of lsu and memory stream units, stream position.
+		std::vector<scad_data> memory;
+		size_t position = 0;
+		
+		unsigned long operations = 0;
+		
+		simulator_unit(std::shared_ptr<unit_description> description, size_t memory_size);
+};
+
+// Cycle-approximate model of a processor description, runs programs without
+// an FPGA or the emulator.
+// Every cycle the control unit issues at most one instruction, each unit
+// executes at most one operation and sends at most one packet per output
+// buffer, and the interconnect delivers packets in the following cycle.
+// Buffers hold buffer_size entries like on the device, a full buffer stalls
+// the control unit.
+// All lsu units have their own memory of memory_size words, or MEMORY_SIZE
+// if the unit has that parameter.
+class simulator {
+	private:
+		processor_description proc;
+		std::map<int, simulator_unit> units;
+		
+		// Packets delivered in the next cycle.
+		std::vector<struct scad_data_packet> in_flight;
+		
+		simulator_statistics statistics;
+		
+		simulator_unit &unit_at(struct scad_buffer_address address);
+		bool deliver(struct scad_data_packet const& packet);
+		bool step_unit(simulator_unit &unit);
+		bool step_outputs(simulator_unit &unit, int number, std::vector<struct scad_data_packet> &sent);
+	
+	public:
+		simulator(processor_description const& proc, size_t memory_size = 256);
+		
+		// Memory of a memory unit by name.
+		std::vector<scad_data> &memory(std::string unit);
+		
+		// Runs the program until the control unit is done and all units are
+		// idle. Throws simulator_exception on deadlock or after max_cycles.
+		simulator_statistics run(std::vector<struct scad_instruction> const& program,
+		                         unsigned long max_cycles = 1ul << 32);
+};
+
+} // namespace scad
+
+#endif /* SCAD_SIMULATOR_HPP */
@@ -0,0 +1,224 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <regex>
+
+#include "template.hpp"
+
+namespace scad {
+
+static bool is_blank(std::string const& text, size_t from, size_t to) {
+	for(size_t pos = from; pos < to; pos++) {
+		if(text[pos] != ' ' && text[pos] != '\t' && text[pos] != '\r') {
+			return false;
+		}
+	}
+	return true;
+}
+
+text_template::text_template(std::string const& text) {
+	static std::regex const key_pattern("([A-Za-z_][A-Za-z_0-9]*)([+-][0-9]+)?(:-([^}]*))?");
+	static std::regex const if_pattern("if\\s+(!?)\\s*([A-Za-z_][A-Za-z_0-9]*)\\s*");
+	static std::regex const for_pattern("for\\s+([A-Za-z_][A-Za-z_0-9]*)\\s+in\\s+"
+	                                    "([A-Za-z_0-9]+(?:[+-][A-Za-z_0-9]+)?)\\s*\\.\\.\\s*"
+	                                    "([A-Za-z_0-9]+(?:[+-][A-Za-z_0-9]+)?)\\s*"
+	                                    "(?:by\\s+([A-Za-z_0-9]+)\\s*)?");
+	
+	// Open blocks, the innermost last, and whether they are in ${else}.
+	std::vector<node> open;
+	std::vector<bool> in_else;
+	auto target = [&]() -> std::vector<node>& {
+		if(open.empty()) {
+			return nodes;
+		}
+		return in_else.back() ? open.back().otherwise : open.back().body;
+	};
+	unsigned long line = 1;
+	std::string pending;
+	auto flush = [&]() {
+		if(!pending.empty()) {
+			node text_node;
+			text_node.value = pending;
+			target().push_back(text_node);
+			pending.clear();
+		}
+	};
+	
+	size_t pos = 0;
+	while(pos < text.size()) {
+		size_t tag = text.find("${", pos);
+		if(tag == std::string::npos) {
+			tag = text.size();
+		}
+		for(size_t i = pos; i < tag; i++) {
+			line += text[i] == '\n';
+		}
+		pending.append(text, pos, tag - pos);
+		if(tag == text.size()) {
+			break;
+		}
+		
+		size_t close = text.find('}', tag);
+		if(close == std::string::npos) {
+			throw template_exception("line " + std::to_string(line) + ": unterminated ${");
+		}
+		std::string content = text.substr(tag + 2, close - tag - 2);
+		pos = close + 1;
+		
+		std::smatch match;
+		bool is_if = std::regex_match(content, match, if_pattern);
+		bool is_for = !is_if && std::regex_match(content, match, for_pattern);
+		bool is_block = is_if || is_for || content == "else" || content == "end";
+		if(!is_block) {
+			if(!std::regex_match(content, match, key_pattern)) {
+				throw template_exception("line " + std::to_string(line) + ": invalid tag ${" + content + "}");
+			}
+			flush();
+			node key_node;
+			key_node.kind = node::key;
+			key_node.value = match[1];
+			key_node.offset = match.length(2) > 0 ? std::stol(match[2]) : 0;
+			key_node.has_fallback = match.length(3) > 0;
+			key_node.fallback = match[4];
+			key_node.line = line;
+			target().push_back(key_node);
+			continue;
+		}
+		
+		// Block tags alone on their line take the whole line with them.
+		size_t line_start = text.rfind('\n', tag);
+		line_start = (line_start == std::string::npos) ? 0 : line_start + 1;
+		size_t line_end = text.find('\n', pos);
+		if(line_end == std::string::npos) {
+			line_end = text.size();
+		}
+		if(is_blank(text, line_start, tag) && is_blank(text, pos, line_end)) {
+			pending.erase(pending.size() - (tag - line_start));
+			pos = std::min(line_end + 1, text.size());
+		}
+		
+		flush();
+		if(is_if || is_for) {
+			node block;
+			block.line = line;
+			if(is_if) {
+				block.kind = node::condition;
+				block.negate = match.length(1) > 0;
+				block.value = match[2];
+			} else {
+				block.kind = node::loop;
+				block.value = match[1];
+				block.from = match[2];
+				block.to = match[3];
+				block.step = match.length(4) > 0 ? match[4].str() : "1";
+			}
+			open.push_back(block);
+			in_else.push_back(false);
+		} else if(content == "else") {
+			if(open.empty() || open.back().kind != node::condition || in_else.back()) {
+				throw template_exception("line " + std::to_string(line) + ": ${else} without ${if}");
+			}
+			in_else.back() = true;
+		} else {
+			// ${end}
+			if(open.empty()) {
+				throw template_exception("line " + std::to_string(line) + ": ${end} without ${if} or ${for}");
+			}
+			node block = open.back();
+			open.pop_back();
+			in_else.pop_back();
+			target().push_back(block);
+		}
+		
+		for(size_t i = tag; i < pos; i++) {
+			line += text[i] == '\n';
+		}
+	}
+	if(!open.empty()) {
+		throw template_exception("line " + std::to_string(open.back().line) + ": block without ${end}");
+	}
+	flush();
+}
+
+static long number(std::string const& value, std::string const& name, unsigned long line) {
+	try {
+		size_t length = 0;
+		long parsed = std::stol(value, &length);
+		if(length == value.size()) {
+			return parsed;
+		}
+	} catch(std::exception &e) {
+	}
+	throw template_exception("line " + std::to_string(line) + ": " + name + " is not a number: " + value);
+}
+
+void text_template::render(std::ostream &out, std::vector<node> const& nodes,
+                           std::map<std::string, std::string> const& parameters) const {
+	for(auto const& n: nodes) {
+		switch(n.kind) {
+			case node::text:
+				out << n.value;
+				break;
+			case node::key: {
+				auto it = parameters.find(n.value);
+				std::string value;
+				if(it != parameters.end()) {
+					value = it->second;
+				} else if(n.has_fallback) {
+					value = n.fallback;
+				} else {
+					throw template_exception("line " + std::to_string(n.line) + ": undefined parameter " + n.value);
+				}
+				out << (n.offset != 0 ? std::to_string(number(value, n.value, n.line) + n.offset) : value);
+				break;
+			}
+			case node::condition: {
+				auto it = parameters.find(n.value);
+				bool value = it != parameters.end() && it->second != "" && it->second != "0";
+				render(out, value != n.negate ? n.body : n.otherwise, parameters);
+				break;
+			}
+			case node::loop: {
+				auto value = [&](std::string const& name) {
+					auto it = parameters.find(name);
+					return number(it != parameters.end() ? it->second : name, name, n.line);
+				};
+				auto bound = [&](std::string const& text) {
+					size_t sign = text.find_first_of("+-");
+					if(sign == std::string::npos) {
+						return value(text);
+					}
+					long offset = value(text.substr(sign + 1));
+					return value(text.substr(0, sign)) + (text[sign] == '-' ? -offset : offset);
+				};
+				long from = bound(n.from), to = bound(n.to), step = bound(n.step);
+				if(step <= 0) {
+					throw template_exception("line " + std::to_string(n.line) + ": loop step " + n.step + " is not positive");
+				}
+				std::map<std::string, std::string> scope = parameters;
+				for(long i = from; i < to; i += step) {
+					scope[n.value] = std::to_string(i);
+					render(out, n.body, scope);
+				}
+				break;
+			}
+		}
+	}
+}
+
+void text_template::render(std::ostream &out, std::map<std::string, std::string> const& parameters) const {
+	render(out, nodes, parameters);
+}
+
+} // namespace scad
@@ -0,0 +1,77 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_TEMPLATE_HPP
+#define SCAD_TEMPLATE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+
+namespace scad {
+
+class template_exception : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+// Device implementation template, parsed once and written in one pass:
+//   ${KEY}                     value of a parameter, undefined ones are errors
+//   ${KEY:-default}            default for an undefined parameter
+//   ${KEY+N}, ${KEY-N}         numeric parameter plus or minus N
+//   ${if KEY} .. ${else} .. ${end}
+//                              KEY is true if defined and not "" or "0",
+//                              ${if !KEY} negates
+//   ${for I in FROM..TO} .. ${end}
+//                              repeats for I = FROM .. TO - 1, bounds are
+//                              numbers or parameters, plus or minus a
+//                              number or parameter
+//   ${for I in FROM..TO by STEP} .. ${end}
+//                              every STEP-th I, STEP a number or parameter
+// Lines holding only a block tag (if, else, for, end) are left out.
+class text_template {
+	struct node {
+		enum {text, key, condition, loop} kind = text;
+		// Text, key, condition or loop variable.
+		std::string value;
+		long offset = 0;
+		bool has_fallback = false;
+		std::string fallback;
+		bool negate = false;
+		std::string from;
+		std::string to;
+		std::string step;
+		std::vector<node> body;
+		std::vector<node> otherwise;
+		unsigned long line = 0;
+	};
+	
+	std::vector<node> nodes;
+	
+	void render(std::ostream &out, std::vector<node> const& nodes,
+	            std::map<std::string, std::string> const& parameters) const;
+	
+	public:
+		// Throws template_exception for unbalanced or unknown tags.
+		explicit text_template(std::string const& text);
+		
+		// Throws template_exception for undefined parameters and loop bounds
+		// that are no numbers.
+		void render(std::ostream &out, std::map<std::string, std::string> const& parameters) const;
+};
+
+} // namespace scad
+
+#endif /* SCAD_TEMPLATE_HPP */
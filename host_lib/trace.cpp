@@ -0,0 +1,148 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <fstream>
+#include <map>
+#include <cstring>
+
+#include "trace.hpp"
+
+namespace scad {
+
+static char const trace_magic[8] = {'S', 'C', 'A', 'D', 'T', 'R', 'C', '2'};
+
+std::vector<scad_trace_event> trace_unwrap(std::vector<scad_trace_event> const& ring, cl_ulong count) {
+	if(count <= ring.size()) {
+		return std::vector<scad_trace_event>(ring.begin(), ring.begin() + count);
+	}
+	
+	// Ring buffer wrapped around: oldest event follows the newest one.
+	size_t oldest = count % ring.size();
+	std::vector<scad_trace_event> events(ring.begin() + oldest, ring.end());
+	events.insert(events.end(), ring.begin(), ring.begin() + oldest);
+	return events;
+}
+
+void trace_write(std::string filename, std::vector<scad_trace_event> const& events) {
+	std::ofstream file(filename, std::ios::binary);
+	if(file.fail()) {
+		throw trace_exception("Could not open '" + filename + "' for writing.");
+	}
+	
+	cl_ulong count = events.size();
+	file.write(trace_magic, sizeof(trace_magic));
+	file.write(reinterpret_cast<char const*>(&count), sizeof(count));
+	file.write(reinterpret_cast<char const*>(events.data()), count * sizeof(scad_trace_event));
+}
+
+std::vector<scad_trace_event> trace_read(std::string filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if(file.fail()) {
+		throw trace_exception("Could not open '" + filename + "'.");
+	}
+	
+	char magic[sizeof(trace_magic)];
+	cl_ulong count = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if(file.fail() || std::memcmp(magic, trace_magic, sizeof(trace_magic))) {
+		throw trace_exception("'" + filename + "' is not a scad trace.");
+	}
+	
+	// The events need to fit into the rest of the file, checked before the
+	// allocation so a corrupt count does not ask for more memory than that.
+	std::streampos start = file.tellg();
+	file.seekg(0, std::ios::end);
+	cl_ulong remaining = file.tellg() - start;
+	file.seekg(start);
+	if(file.fail() || count > remaining / sizeof(scad_trace_event)) {
+		throw trace_exception("'" + filename + "' is truncated.");
+	}
+	
+	std::vector<scad_trace_event> events(count);
+	file.read(reinterpret_cast<char*>(events.data()), count * sizeof(scad_trace_event));
+	if(file.fail()) {
+		throw trace_exception("'" + filename + "' is truncated.");
+	}
+	return events;
+}
+
+// "unit.buffer" with names from the processor description.
+static std::string trace_address_name(processor_description const& proc,
+                                      struct scad_buffer_address addr, bool input) {
+	if(addr.unit == SCAD_ADDRESS_NULL && addr.buffer == SCAD_ADDRESS_NULL) {
+		return input ? "null" : "sync";
+	}
+	
+	for(auto const& unit_entry: proc.units) {
+		auto unit = unit_entry.second;
+		if(unit->number != addr.unit) {
+			continue;
+		}
+		for(auto const& buffer: input ? unit->input_buffers : unit->output_buffers) {
+			if(buffer.second.buffer == addr.buffer) {
+				return unit->name + "." + buffer.first;
+			}
+		}
+		return unit->name + "." + std::to_string(addr.buffer);
+	}
+	return std::to_string(addr.unit) + "." + std::to_string(addr.buffer);
+}
+
+void trace_write_json(std::ostream &out, std::vector<scad_trace_event> const& events,
+                      processor_description const& proc) {
+	out << "{\"traceEvents\": [" << std::endl;
+	
+	// Process and thread names.
+	out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << SCAD_TRACE_MOVE
+	    << ", \"args\": {\"name\": \"moves\"}}," << std::endl;
+	out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << SCAD_TRACE_PACKET
+	    << ", \"args\": {\"name\": \"packets\"}}";
+	for(auto const& unit_entry: proc.units) {
+		auto unit = unit_entry.second;
+		for(int pid: {SCAD_TRACE_MOVE, SCAD_TRACE_PACKET}) {
+			out << "," << std::endl
+			    << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid
+			    << ", \"tid\": " << unit->number
+			    << ", \"args\": {\"name\": \"" << unit->name << "\"}}";
+		}
+	}
+	
+	for(auto const& event: events) {
+		std::string from = trace_address_name(proc, event.from, false);
+		std::string to = trace_address_name(proc, event.to, true);
+		switch(event.kind) {
+			case SCAD_TRACE_MOVE:
+			case SCAD_TRACE_PACKET:
+				out << "," << std::endl
+				    << "{\"name\": \"" << from << " -> " << to << "\""
+				    << ", \"cat\": \"" << (event.kind == SCAD_TRACE_MOVE ? "move" : "packet") << "\""
+				    << ", \"ph\": \"X\", \"ts\": " << event.cycle << ", \"dur\": 1"
+				    << ", \"pid\": " << (int) event.kind << ", \"tid\": " << (int) event.to.unit
+				    << ", \"args\": {\"value\": " << event.value.integer << "}}";
+				break;
+			case SCAD_TRACE_END:
+				out << "," << std::endl
+				    << "{\"name\": \"end\", \"ph\": \"i\", \"s\": \"g\", \"ts\": " << event.cycle
+				    << ", \"pid\": " << SCAD_TRACE_MOVE << ", \"tid\": 0}";
+				break;
+			default:
+				break;
+		}
+	}
+	
+	out << std::endl << "]}" << std::endl;
+}
+
+} // namespace scad
@@ -0,0 +1,48 @@
+//   Copyright 2018 Julius Roob <julius@juliusroob.de>
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#ifndef SCAD_TRACE_HPP
+#define SCAD_TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+
+#include "common/instructions.h"
+#include "description.hpp"
+
+namespace scad {
+
+class trace_exception : public std::runtime_error {
+	public: using runtime_error::runtime_error;
+};
+
+// Events of the ring buffer written by the trace unit, oldest first.
+// count is the total number of events the trace unit recorded.
+std::vector<scad_trace_event> trace_unwrap(std::vector<scad_trace_event> const& ring, cl_ulong count);
+
+// Compact binary trace: magic, number of events, packed events.
+void trace_write(std::string filename, std::vector<scad_trace_event> const& events);
+std::vector<scad_trace_event> trace_read(std::string filename);
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Moves and packets are two processes with one thread per destination unit,
+// one cycle of the trace unit is shown as one microsecond.
+void trace_write_json(std::ostream &out, std::vector<scad_trace_event> const& events,
+                      processor_description const& proc);
+
+} // namespace scad
+
+#endif /* SCAD_TRACE_HPP */
@@ -41,13 +41,13 @@ std::map<std::string, std::pair<std::map<std::string, int>, std::map<std::string
 		  { /* Output */ {"out", 0} } }
 	},
 	{"memory_stream_in",
-		{ { /* Input */ {"in0", 0} },
-		  { /* Output */ } }
-	},
-	{"memory_stream_out",
 		{ { /* Input */ },
 		  { /* Output */ {"out", 0} } }
 	},
+	{"memory_stream_out",
+		{ { /* Input */ {"in0", 0} },
+		  { /* Output */ } }
+	},
 	{"rob",
 		{ { /* Input */ {"in0", 0} },
 		  { /* Output */ {"out", 0} } }
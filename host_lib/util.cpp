@@ -25,6 +25,10 @@
 #include <map>
 #include <set>
 #include <iterator>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <system_error>
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #define __CL_ENABLE_EXCEPTIONS
@@ -89,6 +93,51 @@ cl::Platform cl_find_platform(std::string name) {
 	}
 }
 
+std::string content_hash(std::string const& content) {
+	cl_ulong hash = 0xcbf29ce484222325ul;
+	for(unsigned char c: content) {
+		hash = (hash ^ c) * 0x100000001b3ul;
+	}
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hash);
+	return hex;
+}
+
+void parallel_for(size_t count, unsigned threads, std::function<void(size_t)> const& job) {
+	// Exceptions of the jobs, rethrown on this thread after all are done.
+	std::vector<std::exception_ptr> errors(count);
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for(size_t i = next++; i < count; i = next++) {
+			try {
+				job(i);
+			} catch(...) {
+				errors[i] = std::current_exception();
+			}
+		}
+	};
+	
+	std::vector<std::thread> pool;
+	for(size_t started = 1; started < std::min<size_t>(threads, count); started++) {
+		// Fewer threads if the system has none left.
+		try {
+			pool.emplace_back(worker);
+		} catch(std::system_error& e) {
+			break;
+		}
+	}
+	worker();
+	for(auto &thread: pool) {
+		thread.join();
+	}
+	
+	for(auto const& error: errors) {
+		if(error) {
+			std::rethrow_exception(error);
+		}
+	}
+}
+
 // Turns vector {"key0", "value0", "key1", "value1"} into map<string,string>
 std::map<std::string, std::string> parse_opts(std::vector<std::string> opts,
                                               std::set<std::string> expected) {
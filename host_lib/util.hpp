@@ -26,6 +26,7 @@
 #include <map>
 #include <set>
 #include <iterator>
+#include <functional>
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #define __CL_ENABLE_EXCEPTIONS
@@ -82,6 +83,14 @@ void readVectorFile(std::string filename, std::vector<T> dest) {
 
 cl::Platform cl_find_platform(std::string name);
 
+// 64 bit FNV-1a hash of content as 16 hex digits, to notice changed files.
+std::string content_hash(std::string const& content);
+
+// Calls job(i) for every i < count on up to threads threads, in no
+// particular order. Exceptions of job are rethrown on the calling thread
+// once all jobs are done, the one of the lowest i if there are several.
+void parallel_for(size_t count, unsigned threads, std::function<void(size_t)> const& job);
+
 // Turns vector {"key0", "value0", "key1", "value1"} into map<string,string>
 std::map<std::string, std::string> parse_opts(std::vector<std::string> opts,
                                               std::set<std::string> expected);